@@ -6,6 +6,7 @@ int linear_scan(					// brute-force linear scan (data in disk)
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
 	int   B,							// page size
+	int   max_k,						// max top-k value
 	const float **query,				// query set
 	const Result **R,					// truth set
 	const char *data_folder,			// data folder
@@ -22,9 +23,11 @@ int linear_scan(					// brute-force linear scan (data in disk)
 	// -------------------------------------------------------------------------
 	printf("Top-k FN Search by Linear Scan:\n");
 	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
-	for (int num = 0; num < MAX_ROUND; ++num) {
+	int topk[MAX_ROUND + 1];
+	int rounds = top_k_values(max_k, topk);
+	for (int num = 0; num < rounds; ++num) {
 		gettimeofday(&g_start_time, NULL);
-		int top_k = TOPK[num];
+		int top_k = topk[num];
 		MaxK_List *list = new MaxK_List(top_k);
 		
 		g_ratio  = 0.0f;
@@ -63,6 +66,417 @@ int linear_scan(					// brute-force linear scan (data in disk)
 	return 0;
 }
 
+// -----------------------------------------------------------------------------
+//  KFN_Round: one round (i.e., one top-k value) of c-k-AFN queries, which are 
+//  spread over the threads by parallel_for. each thread owns its k-FN list 
+//  and search context, and each query writes its own output slots. if <batch>
+//  > 0, the queries are spread as batches of <bsearch> instead.
+// -----------------------------------------------------------------------------
+struct KFN_Round {
+	int   qn;							// number of query objects
+	int   top_k;						// top-k value
+	int   batch;						// number of queries per batch (or 0)
+	const float  **query;				// query set
+	const Result **R;					// truth set
+	const char   *data_folder;			// data folder
+	const void   *index;				// index to be searched
+	const float  *hash;					// hash values of queries (or NULL)
+	int   m;							// number of hash values per query
+	const uint64_t *allow;				// allow-list of objects (or NULL)
+	void  **ctx;						// search context of each thread
+	MaxK_List **list;					// k-FN results of each thread
+	MaxK_List **blist;					// k-FN results of each batch slot
+
+	uint64_t (*search)(const KFN_Round*, int, int); // search one query
+	uint64_t (*bsearch)(const KFN_Round*, int, int, int, MaxK_List**);
+												// search a batch of queries
+
+	uint64_t *io;						// i/o of each query (return)
+	float *ratio;						// ratio of each query (return)
+	bool  *partial;						// fewer than top-k results (return)
+	float *recall;						// recall of each query (return)
+	float *time;						// latency (ms) of each query (return)
+	int   *stop;						// stop condition of each query (or NULL)
+
+	Query_Stats *stats;					// statistics of each query (or NULL)
+	float hash_time;					// time (ms) of hashing per query
+	FILE  *sfp;							// file of statistics
+};
+
+// -----------------------------------------------------------------------------
+static void init_round(				// init a round of c-k-AFN queries
+	int   qn,							// number of query objects
+	int   threads,						// number of threads
+	const float **query,				// query set
+	const Result **R,					// truth set
+	const char *data_folder,			// data folder
+	KFN_Round *job)						// round of queries (return)
+{
+	memset(job, 0, sizeof(KFN_Round));
+	job->qn          = qn;
+	job->query       = query;
+	job->R           = R;
+	job->data_folder = data_folder;
+
+	job->ctx    = new void*[threads];
+	job->list   = new MaxK_List*[threads];
+	for (int t = 0; t < threads; ++t) {
+		job->ctx[t]  = NULL;
+		job->list[t] = NULL;
+	}
+	job->io     = new uint64_t[qn];
+	job->ratio  = new float[qn];
+	job->partial = new bool[qn];
+	job->recall = new float[qn];
+	job->time   = new float[qn];
+}
+
+// -----------------------------------------------------------------------------
+static void free_round(				// release a round of c-k-AFN queries
+	int   threads,						// number of threads
+	KFN_Round *job)						// round of queries
+{
+	for (int t = 0; t < threads; ++t) {
+		if (job->list[t] != NULL) { delete job->list[t]; job->list[t] = NULL; }
+	}
+	if (job->blist != NULL) {
+		for (int i = 0; i < threads * job->batch; ++i) delete job->blist[i];
+		delete[] job->blist; job->blist = NULL;
+	}
+	delete[] job->ctx;    job->ctx    = NULL;
+	delete[] job->list;   job->list   = NULL;
+	delete[] job->io;     job->io     = NULL;
+	delete[] job->ratio;  job->ratio  = NULL;
+	delete[] job->partial; job->partial = NULL;
+	delete[] job->recall; job->recall = NULL;
+	delete[] job->time;   job->time   = NULL;
+	if (job->stop != NULL) { delete[] job->stop; job->stop = NULL; }
+	if (job->stats != NULL) {
+		delete[] job->stats; job->stats = NULL;
+		fclose(job->sfp); job->sfp = NULL;
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  keep the statistics of each query, which are appended to the file 
+//  <output_folder><name>_stats.out with one line per query and top-k value
+// -----------------------------------------------------------------------------
+static int init_stats(				// init statistics of a round
+	int   qn,							// number of query objects
+	const char *output_folder,			// output folder
+	const char *name,					// name of method
+	KFN_Round *job)						// round of queries (return)
+{
+	char fname[200];
+	sprintf(fname, "%s%s_stats.out", output_folder, name);
+
+	job->sfp = fopen(fname, "a+");
+	if (!job->sfp) { printf("Could not create %s\n", fname); return 1; }
+
+	fprintf(job->sfp, "# top_k qid rounds index_io data_io candidates "
+		"collisions hash_ms count_ms verify_ms stop radius...\n");
+	job->stats = new Query_Stats[qn];
+	for (int i = 0; i < qn; ++i) reset_stats(&job->stats[i]);
+
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+static void write_stats(			// write statistics of a round
+	int   qn,							// number of query objects
+	int   top_k,						// top-k value
+	KFN_Round *job)						// round of queries
+{
+	for (int i = 0; i < qn; ++i) {
+		Query_Stats *stats = &job->stats[i];
+		const char *stop = "-";
+		if (stats->stop_ != STOP_NONE) stop = stop_name[stats->stop_];
+
+		fprintf(job->sfp, "%d\t%d\t%d\t%llu\t%llu\t%llu\t%llu\t%f\t%f\t%f"
+			"\t%s", top_k, i, stats->rounds_, 
+			(unsigned long long) stats->index_io_, 
+			(unsigned long long) stats->data_io_, 
+			(unsigned long long) stats->cand_, 
+			(unsigned long long) stats->collisions_, 
+			stats->hash_time_ + job->hash_time, stats->count_time_, 
+			stats->verify_time_, stop);
+		for (int j = 0; j < stats->num_radius_; ++j) {
+			fprintf(job->sfp, "\t%f", stats->radius_[j]);
+		}
+		fprintf(job->sfp, "\n");
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  a query with fewer than top-k results (e.g., a filtered search whose 
+//  candidates hold too few allowed objects) has no ratio: it is marked as 
+//  partial and left out of the average ratio, while its missing results 
+//  count as misses in its recall
+// -----------------------------------------------------------------------------
+static void eval_query(				// calc ratio and recall of one query
+	int   qid,							// query id
+	MaxK_List *list,					// k-FN results of this query
+	KFN_Round *job)						// round of queries (return)
+{
+	int top_k = job->top_k;
+	job->recall[qid]  = calc_recall(top_k, job->R[qid], list);
+	job->partial[qid] = list->size() < top_k;
+	if (job->partial[qid]) { job->ratio[qid] = 0.0f; return; }
+
+	float ratio = 0.0f;
+	for (int j = 0; j < top_k; ++j) {
+		ratio += job->R[qid][j].key_ / list->ith_key(j);
+	}
+	job->ratio[qid] = ratio / top_k;
+}
+
+// -----------------------------------------------------------------------------
+static void kfn_worker(				// run one c-k-AFN query of a round
+	int   tid,							// thread id
+	int   qid,							// query id
+	void  *arg)							// round of queries
+{
+	KFN_Round *job = (KFN_Round*) arg;
+	MaxK_List *list = job->list[tid];
+
+	timeval start_time, end_time;
+	gettimeofday(&start_time, NULL);
+	list->reset();
+	job->io[qid] = job->search(job, tid, qid);
+	gettimeofday(&end_time, NULL);
+
+	job->time[qid] = (end_time.tv_sec - start_time.tv_sec) * 1000.0f + 
+		(end_time.tv_usec - start_time.tv_usec) / 1000.0f;
+	eval_query(qid, list, job);
+}
+
+// -----------------------------------------------------------------------------
+//  run the batch <bid> of queries by <bsearch> with the k-FN lists of the 
+//  slots of thread <tid>. the i/o and time of a batch are shared evenly by 
+//  its queries.
+// -----------------------------------------------------------------------------
+static void kfn_batch_worker(		// run one batch of c-k-AFN queries
+	int   tid,							// thread id
+	int   bid,							// batch id
+	void  *arg)							// round of queries
+{
+	KFN_Round *job = (KFN_Round*) arg;
+	MaxK_List **list = &job->blist[tid * job->batch];
+
+	int start = bid * job->batch;
+	int num   = std::min(job->batch, job->qn - start);
+	for (int i = 0; i < num; ++i) list[i]->reset();
+
+	timeval start_time, end_time;
+	gettimeofday(&start_time, NULL);
+	uint64_t io = job->bsearch(job, tid, start, num, list);
+	gettimeofday(&end_time, NULL);
+
+	float time = (end_time.tv_sec - start_time.tv_sec) * 1000.0f + 
+		(end_time.tv_usec - start_time.tv_usec) / 1000.0f;
+	for (int i = 0; i < num; ++i) {
+		int qid = start + i;
+		job->io[qid]   = io / num + (i < (int) (io % num) ? 1 : 0);
+		job->time[qid] = time / num;
+		eval_query(qid, list[i], job);
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  run a round of <qn> queries with <threads> threads. the time of computing
+//  the hash values <hash> of the query set is counted in the throughput.
+// -----------------------------------------------------------------------------
+static void run_round(				// run a round of c-k-AFN queries
+	int   qn,							// number of query objects
+	int   threads,						// number of threads
+	int   top_k,						// top-k value
+	FILE  *fp,							// output file
+	KFN_Round *job)						// round of queries
+{
+	for (int t = 0; t < threads; ++t) {
+		if (job->list[t] != NULL) delete job->list[t];
+		job->list[t] = new MaxK_List(top_k);
+	}
+	job->top_k = top_k;
+	if (job->batch > 0) {
+		int num = threads * job->batch;
+		if (job->blist == NULL) {
+			job->blist = new MaxK_List*[num];
+			for (int i = 0; i < num; ++i) job->blist[i] = NULL;
+		}
+		for (int i = 0; i < num; ++i) {
+			if (job->blist[i] != NULL) delete job->blist[i];
+			job->blist[i] = new MaxK_List(top_k);
+		}
+
+		int nb = (qn + job->batch - 1) / job->batch;
+		parallel_for(nb, threads, kfn_batch_worker, (void*) job);
+	}
+	else {
+		parallel_for(qn, threads, kfn_worker, (void*) job);
+	}
+	gettimeofday(&g_end_time, NULL);
+
+	float wall = g_end_time.tv_sec - g_start_time.tv_sec + 
+		(g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
+	float qps = qn / wall;
+
+	g_ratio   = 0.0f;
+	g_recall  = 0.0f;
+	g_runtime = 0.0f;
+	g_io      = 0;
+	int partial = 0;				// number of queries with short lists
+	for (int i = 0; i < qn; ++i) {
+		if (job->partial[i]) ++partial;
+		else g_ratio += job->ratio[i];
+		g_recall  += job->recall[i];
+		g_runtime += job->time[i];
+		g_io      += job->io[i];
+	}
+	g_ratio   = partial < qn ? g_ratio / (qn - partial) : 0.0f;
+	g_recall  = g_recall / qn;
+	g_runtime = g_runtime / qn;
+	g_io      = (int) ceil((float) g_io / (float) qn);
+
+	printf("  %3d\t\t%.4f\t\t%lld\t\t%.2f\t\t%.1f\t\t%.2f%%\n", top_k, g_ratio, 
+		g_io, g_runtime, qps, g_recall);
+	fprintf(fp, "%d\t%f\t%lld\t%f\t%f\t%f\n", top_k, g_ratio, g_io, 
+		g_runtime, g_recall, qps);
+	if (partial > 0) {				// the ratio is of the other queries
+		printf("\t\tshort lists: %d of %d queries (not in ratio)\n", partial,
+			qn);
+		fprintf(fp, "short\t%d\n", partial);
+	}
+
+	if (job->stop != NULL) {		// number of queries of each stop condition
+		int num[4] = { 0 };
+		for (int i = 0; i < qn; ++i) {
+			if (job->stop[i] != STOP_NONE) ++num[job->stop[i]];
+		}
+		printf("\t\tstops:");
+		for (int i = 0; i < 4; ++i) printf(" %s %d", stop_name[i], num[i]);
+		printf("\n");
+	}
+	if (job->stats != NULL) write_stats(qn, top_k, job);
+}
+
+// -----------------------------------------------------------------------------
+//  set the options of queries in the contexts of a round. the stop condition 
+//  of each query is only kept if one of the limits is set.
+// -----------------------------------------------------------------------------
+static void set_options(			// set options of c-k-AFN queries
+	int   qn,							// number of query objects
+	int   num,							// number of contexts
+	int   sched,						// scheduler of tables
+	int   max_cand,						// budget of candidates (0: default)
+	int   max_io,						// max page i/o (0: no limit)
+	float deadline,						// deadline in ms (0: no limit)
+	RQALSH_Context **ctx,				// search contexts (return)
+	KFN_Round *job)						// round of queries (return)
+{
+	for (int i = 0; i < num; ++i) {
+		ctx[i]->sched_       = sched;
+		ctx[i]->max_cand_    = max_cand;
+		ctx[i]->max_page_io_ = (uint64_t) max_io;
+		ctx[i]->deadline_    = deadline;
+	}
+	if (max_cand > 0 || max_io > 0 || deadline > 0.0f) {
+		if (job->stop == NULL) job->stop = new int[qn];
+		for (int i = 0; i < qn; ++i) job->stop[i] = STOP_NONE;
+	}
+}
+
+// -----------------------------------------------------------------------------
+static uint64_t rqalsh_star_search(	// search one query by RQALSH*
+	const KFN_Round *job,				// round of queries
+	int   tid,							// thread id
+	int   qid)							// query id
+{
+	const RQALSH_STAR *lsh = (const RQALSH_STAR*) job->index;
+	RQALSH_Context *ctx = (RQALSH_Context*) job->ctx[tid];
+	const float *q_val = NULL;
+	if (job->m > 0) q_val = &job->hash[(uint64_t) qid * job->m];
+	if (ctx != NULL) ctx->stats_ = job->stats ? &job->stats[qid] : NULL;
+
+	uint64_t io = lsh->kfn(job->top_k, job->query[qid], job->data_folder, 
+		job->list[tid], q_val, ctx, job->allow);
+	if (job->stop != NULL && ctx != NULL) job->stop[qid] = ctx->stop_;
+	return io;
+}
+
+// -----------------------------------------------------------------------------
+static uint64_t rqalsh_search(		// search one query by RQALSH
+	const KFN_Round *job,				// round of queries
+	int   tid,							// thread id
+	int   qid)							// query id
+{
+	const RQALSH *lsh = (const RQALSH*) job->index;
+	RQALSH_Context *ctx = (RQALSH_Context*) job->ctx[tid];
+	const float *q_val = &job->hash[(uint64_t) qid * job->m];
+	ctx->stats_ = job->stats ? &job->stats[qid] : NULL;
+	ctx->allow_ = job->allow;
+
+	uint64_t io = lsh->kfn(job->top_k, job->query[qid], NULL, 
+		job->data_folder, job->list[tid], q_val, ctx);
+	if (job->stop != NULL) job->stop[qid] = ctx->stop_;
+	return io;
+}
+
+// -----------------------------------------------------------------------------
+//  search the queries <start>, ..., <start>+<num>-1 by RQALSH::kfn_batch, 
+//  where <ctx[tid]> holds one RQALSH_Context per slot
+// -----------------------------------------------------------------------------
+static uint64_t rqalsh_batch_search(// search a batch of queries by RQALSH
+	const KFN_Round *job,				// round of queries
+	int   tid,							// thread id
+	int   start,						// first query id
+	int   num,							// number of queries
+	MaxK_List **list)					// k-FN results of each query (return)
+{
+	const RQALSH *lsh = (const RQALSH*) job->index;
+	RQALSH_Context **ctx = (RQALSH_Context**) job->ctx[tid];
+	for (int i = 0; i < num; ++i) {
+		ctx[i]->stats_ = job->stats ? &job->stats[start + i] : NULL;
+		ctx[i]->allow_ = job->allow;
+	}
+
+	uint64_t io = lsh->kfn_batch(num, job->top_k, &job->query[start], NULL,
+		job->data_folder, list, &job->hash[(uint64_t) start * job->m], ctx);
+	if (job->stop != NULL) {
+		for (int i = 0; i < num; ++i) job->stop[start + i] = ctx[i]->stop_;
+	}
+	return io;
+}
+
+// -----------------------------------------------------------------------------
+static uint64_t drusilla_batch_search(// search a batch by Drusilla_Select
+	const KFN_Round *job,				// round of queries
+	int   tid,							// thread id
+	int   start,						// first query id
+	int   num,							// number of queries
+	MaxK_List **list)					// k-FN results of each query (return)
+{
+	const Drusilla_Select *drusilla = (const Drusilla_Select*) job->index;
+	Query_Stats *stats = job->stats ? &job->stats[start] : NULL;
+
+	return drusilla->search_batch(num, job->top_k, &job->query[start], 
+		job->data_folder, list, stats, job->allow);
+}
+
+// -----------------------------------------------------------------------------
+static uint64_t qdafn_search(		// search one query by QDAFN
+	const KFN_Round *job,				// round of queries
+	int   tid,							// thread id
+	int   qid)							// query id
+{
+	const QDAFN *qdafn = (const QDAFN*) job->index;
+	const float *proj_q = &job->hash[(uint64_t) qid * job->m];
+	Query_Stats *stats  = job->stats ? &job->stats[qid] : NULL;
+
+	return qdafn->search(job->top_k, job->query[qid], job->data_folder, 
+		job->list[tid], proj_q, stats, job->allow);
+}
+
 // -----------------------------------------------------------------------------
 int indexing_of_rqalsh_star(		// indexing of RQALSH*
 	int   n,							// number of data objects
@@ -73,6 +487,10 @@ int indexing_of_rqalsh_star(		// indexing of RQALSH*
 	int   beta,							// false positive percentage
 	float delta,						// error probability
 	float ratio,						// approximation ratio
+	int   family,						// family of hash functions
+	int   threads,						// number of threads of selection
+	int   in_mem,						// keep candidates in memory (0 or 1)
+	int   packed,						// write packed candidate file (0 or 1)
 	const float **data,					// data set
 	const char *output_folder)			// output folder
 {
@@ -87,7 +505,12 @@ int indexing_of_rqalsh_star(		// indexing of RQALSH*
 	// -------------------------------------------------------------------------
 	gettimeofday(&g_start_time, NULL);
 	RQALSH_STAR *lsh = new RQALSH_STAR();
-	lsh->build(n, d, B, L, M, beta, delta, ratio, data, output_folder);
+	if (lsh->build(n, d, B, L, M, beta, delta, ratio, family, data, 
+			output_folder, threads, in_mem, packed)) {
+		delete lsh; lsh = NULL;
+		fclose(fp);
+		return 1;
+	}
 	lsh->display();
 
 	gettimeofday(&g_end_time, NULL);
@@ -113,6 +536,15 @@ int indexing_of_rqalsh_star(		// indexing of RQALSH*
 int kfn_of_rqalsh_star(				// c-k-AFN search of RQALSH*
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
+	int   max_k,						// max top-k value
+	int   threads,						// number of threads
+	int   qthreads,					// number of threads per query
+	int   sched,						// scheduler of tables
+	int   max_cand,						// budget of candidates (0: default)
+	int   max_io,						// max page i/o (0: no limit)
+	float deadline,						// deadline in ms (0: no limit)
+	int   stats,						// dump statistics of queries (0 or 1)
+	const uint64_t *allow,				// allow-list of objects (or NULL)
 	const float **query,				// query set
 	const Result **R,					// truth set
 	const char *data_folder,			// data folder
@@ -128,48 +560,48 @@ int kfn_of_rqalsh_star(				// c-k-AFN search of RQALSH*
 	//  load RQALSH*
 	// -------------------------------------------------------------------------
 	RQALSH_STAR *lsh = new RQALSH_STAR();
-	if (lsh->load(output_folder)) return 1;
+	if (lsh->load(output_folder)) {
+		delete lsh; lsh = NULL;
+		fclose(fp);
+		return 1;
+	}
 	lsh->display();
 
 	// -------------------------------------------------------------------------
 	//  c-k-AFN search by RQALSH*
 	// -------------------------------------------------------------------------
 	printf("Top-k FN Search by RQALSH*: \n");
-	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
-	for (int num = 0; num < MAX_ROUND; ++num) {
+	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tQPS\t\tRecall\n");
+	int   m      = lsh->get_num_hashes();
+	float *q_val = new float[(uint64_t) qn * m + 1];
+
+	KFN_Round job;
+	init_round(qn, threads, query, R, data_folder, &job);
+	if (stats && init_stats(qn, output_folder, "rqalsh_star", &job)) return 1;
+	job.index  = lsh;
+	job.allow  = allow;
+	job.hash   = q_val;
+	job.m      = m;
+	job.search = rqalsh_star_search;
+	for (int t = 0; t < threads && m > 0; ++t) {
+		job.ctx[t] = new RQALSH_Context(lsh->get_index(), qthreads);
+		set_options(qn, 1, sched, max_cand, max_io, deadline, 
+			(RQALSH_Context**) &job.ctx[t], &job);
+	}
+	int topk[MAX_ROUND + 1];
+	int rounds = top_k_values(max_k, topk);
+	for (int num = 0; num < rounds; ++num) {
 		gettimeofday(&g_start_time, NULL);
-		int top_k = TOPK[num];
-		MaxK_List *list = new MaxK_List(top_k);
-
-		g_ratio  = 0.0f;
-		g_recall = 0.0f;
-		g_io     = 0;
-		for (int i = 0; i < qn; ++i) {
-			list->reset();
-			g_io += lsh->kfn(top_k, query[i], data_folder, list);
-			g_recall += calc_recall(top_k, R[i], list);
-
-			float ratio = 0.0f;
-			for (int j = 0; j < top_k; ++j) {
-				ratio += R[i][j].key_ / list->ith_key(j);
-			}
-			g_ratio += ratio / top_k;
-		}
-		delete list; list = NULL;
-		gettimeofday(&g_end_time, NULL);
-		g_runtime = g_end_time.tv_sec - g_start_time.tv_sec + 
-			(g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
-
-		g_ratio   = g_ratio / qn;
-		g_recall  = g_recall / qn;
-		g_runtime = (g_runtime * 1000.0f) / qn;
-		g_io      = (int) ceil((float) g_io / (float) qn);
-
-		printf("  %3d\t\t%.4f\t\t%d\t\t%.2f\t\t%.2f%%\n", top_k, g_ratio, 
-			g_io, g_runtime, g_recall);
-		fprintf(fp, "%d\t%f\t%d\t%f\t%f\n", top_k, g_ratio, g_io, 
-			g_runtime, g_recall);
+		lsh->calc_hash_values(qn, query, q_val);
+		job.hash_time = elapsed_ms(g_start_time) / qn;
+		run_round(qn, threads, topk[num], fp, &job);
+	}
+	for (int t = 0; t < threads; ++t) {
+		delete (RQALSH_Context*) job.ctx[t]; job.ctx[t] = NULL;
 	}
+	free_round(threads, &job);
+	delete[] q_val; q_val = NULL;
+
 	printf("\n");
 	fprintf(fp, "\n");
 	fclose(fp);
@@ -191,6 +623,7 @@ int indexing_of_rqalsh(				// indexing of RQALSH
 	int   beta,							// false positive percentage
 	float delta,						// error probability
 	float ratio,						// approximation ratio
+	int   family,						// family of hash functions
 	const float **data,					// data set
 	const char *output_folder)			// output folder
 {
@@ -209,7 +642,11 @@ int indexing_of_rqalsh(				// indexing of RQALSH
 	strcat(index_path, "indices/");
 
 	RQALSH *lsh = new RQALSH();
-	lsh->build(n, d, B, beta, delta, ratio, data, index_path);
+	if (lsh->build(n, d, B, beta, delta, ratio, family, data, index_path)) {
+		delete lsh; lsh = NULL;
+		fclose(fp);
+		return 1;
+	}
 	lsh->display();
 
 	gettimeofday(&g_end_time, NULL);
@@ -235,6 +672,20 @@ int indexing_of_rqalsh(				// indexing of RQALSH
 int kfn_of_rqalsh(					// c-k-AFN search of RQALSH
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
+	int   max_k,						// max top-k value
+	int   threads,						// number of threads
+	int   qthreads,					// number of threads per query
+	int   batch,						// number of queries per batch
+	float ratio,						// approximation ratio (0: of index)
+	int   sched,						// scheduler of tables
+	int   max_cand,						// budget of candidates (0: default)
+	int   max_io,						// max page i/o (0: no limit)
+	float deadline,						// deadline in ms (0: no limit)
+	float defer,						// admission factor of deferral (0: off)
+	int   rsched,						// schedule of radius
+	float step,							// step of radius (0: sqrt(ratio))
+	int   stats,						// dump statistics of queries (0 or 1)
+	const uint64_t *allow,				// allow-list of objects (or NULL)
 	const float **query,				// query set
 	const Result **R,					// truth set
 	const char *data_folder,			// data folder
@@ -253,49 +704,79 @@ int kfn_of_rqalsh(					// c-k-AFN search of RQALSH
 	strcpy(index_path, output_folder);
 	strcat(index_path, "indices/");
 
-	RQALSH *lsh = new RQALSH();
-	if (lsh->load(index_path)) return 1;
+	RQALSH *base = new RQALSH();
+	if (base->load(index_path)) {
+		delete base; base = NULL;
+		fclose(fp);
+		return 1;
+	}
+
+	// -------------------------------------------------------------------------
+	//  a query-time ratio searches a view of the index (no rebuild)
+	// -------------------------------------------------------------------------
+	RQALSH *lsh = base;
+	if (ratio > 0.0f) {
+		lsh = new RQALSH();
+		if (lsh->view(base, ratio)) return 1;
+	}
 	lsh->display();
 
 	// -------------------------------------------------------------------------
 	//  c-k-AFN search by RQALSH
 	// -------------------------------------------------------------------------
 	printf("Top-k FN Search by RQALSH: \n");
-	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
-	for (int num = 0; num < MAX_ROUND; ++num) {
+	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tQPS\t\tRecall\n");
+	int   m      = lsh->get_num_tables();
+	float *q_val = new float[(uint64_t) qn * m];
+
+	KFN_Round job;
+	init_round(qn, threads, query, R, data_folder, &job);
+	if (stats && init_stats(qn, output_folder, "rqalsh", &job)) return 1;
+	job.index  = lsh;
+	job.allow  = allow;
+	job.hash   = q_val;
+	job.m      = m;
+	job.search  = rqalsh_search;
+	job.bsearch = rqalsh_batch_search;
+	job.batch   = batch;
+	for (int t = 0; t < threads; ++t) {
+		if (batch > 0) {
+			RQALSH_Context **ctx = new RQALSH_Context*[batch];
+			for (int i = 0; i < batch; ++i) ctx[i] = new RQALSH_Context(lsh);
+			set_options(qn, batch, sched, max_cand, max_io, deadline, ctx, &job);
+			job.ctx[t] = ctx;
+		}
+		else {
+			job.ctx[t] = new RQALSH_Context(lsh, qthreads);
+			set_options(qn, 1, sched, max_cand, max_io, deadline, 
+				(RQALSH_Context**) &job.ctx[t], &job);
+			((RQALSH_Context*) job.ctx[t])->defer_  = defer;
+			((RQALSH_Context*) job.ctx[t])->rsched_ = rsched;
+			((RQALSH_Context*) job.ctx[t])->step_   = step;
+		}
+	}
+	int topk[MAX_ROUND + 1];
+	int rounds = top_k_values(max_k, topk);
+	for (int num = 0; num < rounds; ++num) {
 		gettimeofday(&g_start_time, NULL);
-		int top_k = TOPK[num];
-		MaxK_List *list = new MaxK_List(top_k);
-
-		g_ratio  = 0.0f;
-		g_recall = 0.0f;
-		g_io     = 0;
-		for (int i = 0; i < qn; ++i) {
-			list->reset();
-			g_io += lsh->kfn(top_k, query[i], NULL, data_folder, list);
-			g_recall += calc_recall(top_k, R[i], list);
-
-			float ratio = 0.0f;
-			for (int j = 0; j < top_k; ++j) {
-				ratio += R[i][j].key_ / list->ith_key(j);
-			}
-			g_ratio += ratio / top_k;
+		lsh->calc_hash_values(qn, query, q_val);
+		job.hash_time = elapsed_ms(g_start_time) / qn;
+		run_round(qn, threads, topk[num], fp, &job);
+	}
+	for (int t = 0; t < threads; ++t) {
+		if (batch > 0) {
+			RQALSH_Context **ctx = (RQALSH_Context**) job.ctx[t];
+			for (int i = 0; i < batch; ++i) delete ctx[i];
+			delete[] ctx;
 		}
-		delete list; list = NULL;
-		gettimeofday(&g_end_time, NULL);
-		g_runtime = g_end_time.tv_sec - g_start_time.tv_sec + 
-			(g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
-
-		g_ratio   = g_ratio / qn;
-		g_recall  = g_recall / qn;
-		g_runtime = (g_runtime * 1000.0f) / qn;
-		g_io      = (int) ceil((float) g_io / (float) qn);
-
-		printf("  %3d\t\t%.4f\t\t%d\t\t%.2f\t\t%.2f%%\n", top_k, g_ratio, 
-			g_io, g_runtime, g_recall);
-		fprintf(fp, "%d\t%f\t%d\t%f\t%f\n", top_k, g_ratio, g_io, 
-			g_runtime, g_recall);
+		else {
+			delete (RQALSH_Context*) job.ctx[t];
+		}
+		job.ctx[t] = NULL;
 	}
+	free_round(threads, &job);
+	delete[] q_val; q_val = NULL;
+
 	printf("\n");
 	fprintf(fp, "\n");
 	fclose(fp);
@@ -303,7 +784,8 @@ int kfn_of_rqalsh(					// c-k-AFN search of RQALSH
 	// -------------------------------------------------------------------------
 	//  release space
 	// -------------------------------------------------------------------------
-	delete lsh; lsh = NULL;
+	if (lsh != base) { delete lsh; lsh = NULL; }
+	delete base; base = NULL;
 	assert(g_memory == 0);
 
 	return 0;
@@ -316,6 +798,8 @@ int indexing_of_drusilla_select(	// indexing of Drusilla_Select
 	int   B,							// page size
 	int   L,							// number of projection
 	int   M,							// number of candidates
+	int   threads,						// number of threads of selection
+	int   packed,						// write packed candidate file (0 or 1)
 	const float **data,					// data set
 	const char *output_folder)			// output folder
 {
@@ -330,7 +814,11 @@ int indexing_of_drusilla_select(	// indexing of Drusilla_Select
 	// -------------------------------------------------------------------------
 	gettimeofday(&g_start_time, NULL);
 	Drusilla_Select* drusilla = new Drusilla_Select();
-	drusilla->build(n, d, L, M, B, data, output_folder);
+	if (drusilla->build(n, d, L, M, B, data, output_folder, threads, packed)) {
+		delete drusilla; drusilla = NULL;
+		fclose(fp);
+		return 1;
+	}
 	drusilla->display();
 
 	gettimeofday(&g_end_time, NULL);
@@ -356,6 +844,11 @@ int indexing_of_drusilla_select(	// indexing of Drusilla_Select
 int kfn_of_drusilla_select(			// c-k-AFN via Drusilla_Select
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
+	int   max_k,						// max top-k value
+	int   threads,						// number of threads
+	int   batch,						// number of queries per batch (0: all)
+	int   stats,						// dump statistics of queries (0 or 1)
+	const uint64_t *allow,				// allow-list of objects (or NULL)
 	const float **query,				// query set
 	const Result **R,					// truth set
 	const char *data_folder,			// data folder
@@ -378,41 +871,22 @@ int kfn_of_drusilla_select(			// c-k-AFN via Drusilla_Select
 	//  c-k-AFN search via Drusilla_Select
 	// -------------------------------------------------------------------------
 	printf("Top-k FN Search by Drusilla_Select: \n");
-	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
-	for (int num = 0; num < MAX_ROUND; ++num) {
+	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tQPS\t\tRecall\n");
+	KFN_Round job;
+	init_round(qn, threads, query, R, data_folder, &job);
+	if (stats && init_stats(qn, output_folder, "drusilla", &job)) return 1;
+	job.index   = drusilla;
+	job.allow   = allow;
+	job.bsearch = drusilla_batch_search;
+	job.batch   = batch > 0 ? batch : (qn + threads - 1) / threads;
+	int topk[MAX_ROUND + 1];
+	int rounds = top_k_values(max_k, topk);
+	for (int num = 0; num < rounds; ++num) {
 		gettimeofday(&g_start_time, NULL);
-		int top_k = TOPK[num];
-		MaxK_List *list = new MaxK_List(top_k);
-
-		g_ratio  = 0.0f;
-		g_recall = 0.0f;
-		g_io     = 0;
-		for (int i = 0; i < qn; ++i) {
-			list->reset();
-			g_io += drusilla->search(query[i], data_folder, list);
-			g_recall += calc_recall(top_k, R[i], list);
-
-			float ratio = 0.0f;
-			for (int j = 0; j < top_k; ++j) {
-				ratio += R[i][j].key_ / list->ith_key(j);
-			}
-			g_ratio += ratio / top_k;
-		}
-		delete list; list = NULL;
-		gettimeofday(&g_end_time, NULL);
-		g_runtime = g_end_time.tv_sec - g_start_time.tv_sec + 
-			(g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
-
-		g_ratio   = g_ratio / qn;
-		g_recall  = g_recall / qn;
-		g_runtime = (g_runtime * 1000.0f) / qn;
-		g_io      = (int) ceil((float) g_io / (float) qn);
-
-		printf("  %3d\t\t%.4f\t\t%d\t\t%.2f\t\t%.2f%%\n", top_k, g_ratio, 
-			g_io, g_runtime, g_recall);
-		fprintf(fp, "%d\t%f\t%d\t%f\t%f\n", top_k, g_ratio, g_io, 
-			g_runtime, g_recall);
+		run_round(qn, threads, topk[num], fp, &job);
 	}
+	free_round(threads, &job);
+
 	printf("\n");
 	fprintf(fp, "\n");
 	fclose(fp);
@@ -434,6 +908,7 @@ int indexing_of_qdafn(				// indexing of QDAFN
 	int   L,							// number of projections
 	int   M,							// number of candidates
 	float ratio,						// approximation ratio
+	int   family,						// family of projections
 	const float **data,					// data set
 	const char *output_folder)			// output folder
 {
@@ -451,7 +926,11 @@ int indexing_of_qdafn(				// indexing of QDAFN
 	sprintf(index_path, "%sindices/", output_folder);
 
 	QDAFN* qdafn = new QDAFN();
-	qdafn->build(n, d, B, L, M, ratio, data, index_path);
+	if (qdafn->build(n, d, B, L, M, ratio, family, data, index_path)) {
+		delete qdafn; qdafn = NULL;
+		fclose(fp);
+		return 1;
+	}
 	qdafn->display();
 
 	gettimeofday(&g_end_time, NULL);
@@ -477,6 +956,10 @@ int indexing_of_qdafn(				// indexing of QDAFN
 int kfn_of_qdafn(					// c-k-AFN via QDAFN
 	int   qn,							// number of query points
 	int   d,							// dimensionality
+	int   max_k,						// max top-k value
+	int   threads,						// number of threads
+	int   stats,						// dump statistics of queries (0 or 1)
+	const uint64_t *allow,				// allow-list of objects (or NULL)
 	const float **query,				// query set
 	const Result **R,					// truth set
 	const char *data_folder,			// data folder
@@ -495,56 +978,417 @@ int kfn_of_qdafn(					// c-k-AFN via QDAFN
 	sprintf(index_path, "%sindices/", output_folder);
 
 	QDAFN *qdafn = new QDAFN();
-	if (qdafn->load(index_path)) return 1;
+	if (qdafn->load(index_path)) {
+		delete qdafn; qdafn = NULL;
+		fclose(fp);
+		return 1;
+	}
 	qdafn->display();
 
 	// -------------------------------------------------------------------------
 	//  c-k-AFN search via QDAFN
 	// -------------------------------------------------------------------------
 	printf("Top-k FN Search by QDAFN: \n");
-	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
-	for (int num = 0; num < MAX_ROUND; ++num) {
+	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tQPS\t\tRecall\n");
+	int   l       = qdafn->get_num_projections();
+	float *proj_q = new float[(uint64_t) qn * l];
+
+	KFN_Round job;
+	init_round(qn, threads, query, R, data_folder, &job);
+	if (stats && init_stats(qn, output_folder, "qdafn", &job)) return 1;
+	job.index  = qdafn;
+	job.allow  = allow;
+	job.hash   = proj_q;
+	job.m      = l;
+	job.search = qdafn_search;
+	int topk[MAX_ROUND + 1];
+	int rounds = top_k_values(max_k, topk);
+	for (int num = 0; num < rounds; ++num) {
 		gettimeofday(&g_start_time, NULL);
-		int top_k = TOPK[num];
-		MaxK_List *list = new MaxK_List(top_k);
+		qdafn->calc_proj_values(qn, query, proj_q);
+		job.hash_time = elapsed_ms(g_start_time) / qn;
+		run_round(qn, threads, topk[num], fp, &job);
+	}
+	free_round(threads, &job);
+	delete[] proj_q; proj_q = NULL;
 
-		g_ratio  = 0.0f;
-		g_recall = 0.0f;
-		g_io     = 0;
+	printf("\n");
+	fprintf(fp, "\n");
+	fclose(fp);
+
+	// -------------------------------------------------------------------------
+	//  Release space
+	// -------------------------------------------------------------------------
+	delete qdafn; qdafn = NULL;
+	assert(g_memory == 0);
+
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+//  micro-benchmark of the counting engines on the configuration (i.e., <n>,
+//  <m> and <l>) of an existing RQALSH index. for each simulated query, the
+//  tails of the <m> tables are replayed as random chunks of object ids, where
+//  each chunk has the number of ids covered by one key of a leaf node. these
+//  streams are synthetic (uniform ids), so the ranking of the engines may not
+//  be the one of real queries, whose tails are skewed to far objects.
+// -----------------------------------------------------------------------------
+int counting_benchmark(				// micro-benchmark of collision counting
+	int   qn,							// number of simulated queries
+	const char *output_folder)			// output folder
+{
+	char output_set[200];
+	strcpy(output_set, output_folder); strcat(output_set, "counting.out");
+
+	FILE *fp = fopen(output_set, "a+");
+	if (!fp) { printf("Could not create %s\n", output_set); return 1; }
+
+	// -------------------------------------------------------------------------
+	//  load RQALSH
+	// -------------------------------------------------------------------------
+	char index_path[200];
+	strcpy(index_path, output_folder);
+	strcat(index_path, "indices/");
+
+	RQALSH *lsh = new RQALSH();
+	if (lsh->load(index_path)) {
+		delete lsh; lsh = NULL;
+		fclose(fp);
+		return 1;
+	}
+	lsh->display();
+
+	int n = lsh->get_num_objects();
+	int m = lsh->get_num_tables();
+	int l = lsh->get_threshold();
+	int chunk = LEAF_NODE_SIZE / SIZEINT;
+	int pages = 8;					// number of chunks per table
+	int size  = m * pages * chunk;	// number of collisions per query
+
+	int auto_type = Collision_Counter::select_type(n, m, l);
+	printf("Micro-Benchmark of Collision Counting (auto = %s):\n", 
+		counter_name[auto_type]);
+	printf("  (synthetic tails of uniform random ids, not of real queries)\n");
+	printf("  Engine\t\tCounting (ms)\tns/Collision\tFrequent\n");
+
+	// -------------------------------------------------------------------------
+	//  time each counting engine on the same id streams
+	// -------------------------------------------------------------------------
+	int   *ids     = new int[size];
+	float runtime[4] = { 0.0f };
+	int   freq[4]    = { 0 };
+	Collision_Counter *counter[4];
+	for (int t = 0; t < 4; ++t) counter[t] = new Collision_Counter(n, m, l, t);
+
+	for (int i = 0; i < qn; ++i) {
+		for (int j = 0; j < size; ++j) {
+			ids[j] = (int) (((uint64_t) rand() * n) / ((uint64_t) RAND_MAX + 1));
+		}
+		for (int t = 0; t < 4; ++t) {
+			gettimeofday(&g_start_time, NULL);
+			counter[t]->reset();
+			for (int p = 0; p < pages; ++p) {
+				for (int k = 0; k < m; ++k) {
+					int start = (k * pages + p) * chunk;
+					int end   = start + chunk;
+					for (int j = start; j < end; ++j) {
+						if (j + PREFETCH_DIST < end) {
+							counter[t]->prefetch(ids[j + PREFETCH_DIST]);
+						}
+						if (counter[t]->add(ids[j])) ++freq[t];
+					}
+				}
+			}
+			gettimeofday(&g_end_time, NULL);
+			runtime[t] += g_end_time.tv_sec - g_start_time.tv_sec + 
+				(g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
+		}
+	}
+
+	fprintf(fp, "n = %d, m = %d, l = %d, auto = %s, synthetic ids\n", n, m, 
+		l, counter_name[auto_type]);
+	for (int t = 0; t < 4; ++t) {
+		float time = runtime[t] * 1000.0f / qn;
+		float cost = runtime[t] * 1e9f / ((float) qn * size);
+		printf("  %s\t\t%.3f\t\t%.2f\t\t%d\n", counter_name[t], time, 
+			cost, freq[t]);
+		fprintf(fp, "%s\t%f\t%f\t%d\n", counter_name[t], time, cost, freq[t]);
+	}
+	printf("\n");
+	fprintf(fp, "\n");
+	fclose(fp);
+
+	// -------------------------------------------------------------------------
+	//  release space
+	// -------------------------------------------------------------------------
+	for (int t = 0; t < 4; ++t) { delete counter[t]; counter[t] = NULL; }
+	delete[] ids; ids = NULL;
+	delete lsh; lsh = NULL;
+	assert(g_memory == 0);
+
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+//  Range_Result: objects reported by a range-FN search of one query
+// -----------------------------------------------------------------------------
+struct Range_Result {
+	bool  *truth;						// objects beyond r (linear scan)
+	int   num;							// number of reported objects
+	int   hits;							// number of reported objects in truth
+};
+
+// -----------------------------------------------------------------------------
+static void mark_truth(				// callback of linear scan
+	int   id,							// object id
+	float dist,							// distance to query
+	void  *arg)							// range result (Range_Result)
+{
+	Range_Result *res = (Range_Result*) arg;
+	res->truth[id] = true;
+	++res->num;
+}
+
+// -----------------------------------------------------------------------------
+static void check_truth(			// callback of RQALSH::range_fn
+	int   id,							// object id
+	float dist,							// distance to query
+	void  *arg)							// range result (Range_Result)
+{
+	Range_Result *res = (Range_Result*) arg;
+	if (res->truth[id]) ++res->hits;
+	++res->num;
+}
+
+// -----------------------------------------------------------------------------
+int range_of_rqalsh(				// range-FN search of RQALSH vs. linear scan
+	int   n,							// number of data objects
+	int   qn,							// number of query objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	float r,							// range (distance threshold)
+	const float **query,				// query set
+	const char  *data_folder,			// data folder
+	const char  *output_folder)			// output folder
+{
+	char output_set[200];
+	strcpy(output_set, output_folder); strcat(output_set, "range.out");
+
+	FILE *fp = fopen(output_set, "a+");
+	if (!fp) { printf("Could not create %s\n", output_set); return 1; }
+
+	// -------------------------------------------------------------------------
+	//  load RQALSH
+	// -------------------------------------------------------------------------
+	char index_path[200];
+	strcpy(index_path, output_folder);
+	strcat(index_path, "indices/");
+
+	RQALSH *lsh = new RQALSH();
+	if (lsh->load(index_path)) {
+		delete lsh; lsh = NULL;
+		fclose(fp);
+		return 1;
+	}
+	lsh->display();
+
+	// -------------------------------------------------------------------------
+	//  range-FN search by linear scan (truth) and by RQALSH
+	// -------------------------------------------------------------------------
+	int   m      = lsh->get_num_tables();
+	float *q_val = new float[(uint64_t) qn * m];
+	RQALSH_Context *ctx = new RQALSH_Context(lsh);
+
+	Range_Result res;
+	res.truth = new bool[n];
+
+	uint64_t truth_num = 0, truth_io = 0, num = 0, hits = 0, io = 0;
+	float truth_time = 0.0f, time = 0.0f;
+
+	gettimeofday(&g_start_time, NULL);
+	lsh->calc_hash_values(qn, query, q_val);
+	float hash_time = elapsed_ms(g_start_time);
+
+	for (int i = 0; i < qn; ++i) {
+		memset(res.truth, false, n * SIZEBOOL);
+		res.num  = 0;
+		res.hits = 0;
+
+		gettimeofday(&g_start_time, NULL);
+		truth_io += linear_range(n, d, B, r, query[i], data_folder, 
+			mark_truth, &res);
+		truth_time += elapsed_ms(g_start_time);
+		truth_num  += res.num;
+
+		res.num = 0;
+		gettimeofday(&g_start_time, NULL);
+		io   += lsh->range_fn(r, query[i], NULL, data_folder, check_truth, 
+			&res, &q_val[(uint64_t) i * m], ctx);
+		time += elapsed_ms(g_start_time);
+		num  += res.num;
+		hits += res.hits;
+	}
+	float recall = truth_num > 0 ? 100.0f * hits / truth_num : 100.0f;
+	truth_time = truth_time / qn;
+	time = (time + hash_time) / qn;
+
+	printf("Range FN Search (r = %.2f):\n", r);
+	printf("  Method		Objects		Recall		I/O		Time (ms)\n");
+	printf("  Linear		%.1f\t\t%.2f%%\t\t%llu\t\t%.2f\n", 
+		(float) truth_num / qn, 100.0f, 
+		(unsigned long long) ((truth_io + qn - 1) / qn), truth_time);
+	printf("  RQALSH		%.1f\t\t%.2f%%\t\t%llu\t\t%.2f\n\n", 
+		(float) num / qn, recall, (unsigned long long) ((io + qn - 1) / qn), 
+		time);
+
+	fprintf(fp, "r = %f\n", r);
+	fprintf(fp, "Linear\t%f\t%f\t%llu\t%f\n", (float) truth_num / qn, 100.0f,
+		(unsigned long long) ((truth_io + qn - 1) / qn), truth_time);
+	fprintf(fp, "RQALSH\t%f\t%f\t%llu\t%f\n\n", (float) num / qn, recall, 
+		(unsigned long long) ((io + qn - 1) / qn), time);
+	fclose(fp);
+
+	// -------------------------------------------------------------------------
+	//  release space
+	// -------------------------------------------------------------------------
+	delete[] res.truth; res.truth = NULL;
+	delete[] q_val; q_val = NULL;
+	delete ctx; ctx = NULL;
+	delete lsh; lsh = NULL;
+	assert(g_memory == 0);
+
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+int knn_of_rqalsh(					// c-k-ANN search of RQALSH vs. linear scan
+	int   n,							// number of data objects
+	int   qn,							// number of query objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	int   max_k,						// max top-k value
+	float ratio,						// approximation ratio (0: of index)
+	const float **query,				// query set
+	const char  *data_folder,			// data folder
+	const char  *output_folder)			// output folder
+{
+	char output_set[200];
+	strcpy(output_set, output_folder); strcat(output_set, "knn.out");
+
+	FILE *fp = fopen(output_set, "a+");
+	if (!fp) { printf("Could not create %s\n", output_set); return 1; }
+
+	// -------------------------------------------------------------------------
+	//  load RQALSH (a query-time ratio searches a view of the index)
+	// -------------------------------------------------------------------------
+	char index_path[200];
+	strcpy(index_path, output_folder);
+	strcat(index_path, "indices/");
+
+	RQALSH *base = new RQALSH();
+	if (base->load(index_path)) {
+		delete base; base = NULL;
+		fclose(fp);
+		return 1;
+	}
+
+	RQALSH *lsh = base;
+	if (ratio > 0.0f) {
+		lsh = new RQALSH();
+		if (lsh->view(base, ratio)) return 1;
+	}
+	lsh->display();
+
+	// -------------------------------------------------------------------------
+	//  k-NN search by linear scan (truth)
+	// -------------------------------------------------------------------------
+	MinK_List **truth = new MinK_List*[qn];
+	uint64_t truth_io = 0;
+
+	gettimeofday(&g_start_time, NULL);
+	for (int i = 0; i < qn; ++i) {
+		truth[i] = new MinK_List(max_k);
+		truth_io += linear_nn(n, d, B, query[i], data_folder, truth[i]);
+	}
+	float truth_time = elapsed_ms(g_start_time) / qn;
+
+	printf("Top-k NN Search (Linear: I/O = %llu, Time = %.2f ms):\n", 
+		(unsigned long long) ((truth_io + qn - 1) / qn), truth_time);
+	printf("  Top-k\t\tRatio\t\tI/O\t\tTime (ms)\tRecall\n");
+	fprintf(fp, "Linear\t%llu\t%f\n", 
+		(unsigned long long) ((truth_io + qn - 1) / qn), truth_time);
+
+	// -------------------------------------------------------------------------
+	//  c-k-ANN search by RQALSH
+	// -------------------------------------------------------------------------
+	int   m      = lsh->get_num_tables();
+	float *q_val = new float[(uint64_t) qn * m];
+	RQALSH_Context *ctx = new RQALSH_Context(lsh);
+
+	gettimeofday(&g_start_time, NULL);
+	lsh->calc_hash_values(qn, query, q_val);
+	float hash_time = elapsed_ms(g_start_time);
+
+	int topk[MAX_ROUND + 1];
+	int rounds = top_k_values(max_k, topk);
+	for (int num = 0; num < rounds; ++num) {
+		int top_k = topk[num];
+		MinK_List *list = new MinK_List(top_k);
+
+		uint64_t io = 0;
+		float ratio_sum = 0.0f, recall = 0.0f, time = 0.0f;
+		int   partial   = 0;		// number of queries with short lists
 		for (int i = 0; i < qn; ++i) {
 			list->reset();
-			g_io += qdafn->search(top_k, query[i], data_folder, list);
-			g_recall += calc_recall(top_k, R[i], list);
-
-			float ratio = 0.0f;
+			gettimeofday(&g_start_time, NULL);
+			io   += lsh->knn(top_k, query[i], NULL, data_folder, list, 
+				&q_val[(uint64_t) i * m], ctx);
+			time += elapsed_ms(g_start_time);
+
+			// -----------------------------------------------------------------
+			//  ratio of the j-th distances and recall of the true top-k
+			// -----------------------------------------------------------------
+			float ratio_q = 0.0f;
+			int   hits    = 0;
+			float kth     = truth[i]->ith_key(top_k - 1);
 			for (int j = 0; j < top_k; ++j) {
-				ratio += R[i][j].key_ / list->ith_key(j);
+				float t = truth[i]->ith_key(j);
+				ratio_q += t > 0.0f ? list->ith_key(j) / t : 1.0f;
+				if (list->ith_key(j) <= kth) ++hits;
 			}
-			g_ratio += ratio / top_k;
+			if (list->size() < top_k) ++partial; // no ratio (as eval_query)
+			else ratio_sum += ratio_q / top_k;
+			recall    += (float) hits / top_k;
 		}
 		delete list; list = NULL;
-		gettimeofday(&g_end_time, NULL);
-		g_runtime = g_end_time.tv_sec - g_start_time.tv_sec + 
-			(g_end_time.tv_usec - g_start_time.tv_usec) / 1000000.0f;
 
-		g_ratio   = g_ratio / qn;
-		g_recall  = g_recall / qn;
-		g_runtime = (g_runtime * 1000.0f) / qn;
-		g_io      = (int) ceil((float) g_io / (float) qn);
-
-		printf("  %3d\t\t%.4f\t\t%d\t\t%.2f\t\t%.2f%%\n", top_k, g_ratio, 
-			g_io, g_runtime, g_recall);
-		fprintf(fp, "%d\t%f\t%d\t%f\t%f\n", top_k, g_ratio, g_io, 
-			g_runtime, g_recall);
+		ratio_sum = partial < qn ? ratio_sum / (qn - partial) : 0.0f;
+		recall    = 100.0f * recall / qn;
+		time      = (time + hash_time) / qn;
+
+		printf("  %3d\t\t%.4f\t\t%llu\t\t%.2f\t\t%.2f%%\n", top_k, ratio_sum,
+			(unsigned long long) ((io + qn - 1) / qn), time, recall);
+		fprintf(fp, "%d\t%f\t%llu\t%f\t%f\n", top_k, ratio_sum, 
+			(unsigned long long) ((io + qn - 1) / qn), time, recall);
+		if (partial > 0) {
+			printf("\t\tshort lists: %d of %d queries (not in ratio)\n", 
+				partial, qn);
+			fprintf(fp, "short\t%d\n", partial);
+		}
 	}
 	printf("\n");
 	fprintf(fp, "\n");
 	fclose(fp);
 
 	// -------------------------------------------------------------------------
-	//  Release space
+	//  release space
 	// -------------------------------------------------------------------------
-	delete qdafn; qdafn = NULL;
+	for (int i = 0; i < qn; ++i) { delete truth[i]; truth[i] = NULL; }
+	delete[] truth; truth = NULL;
+	delete[] q_val; q_val = NULL;
+	delete ctx; ctx = NULL;
+	if (lsh != base) { delete lsh; lsh = NULL; }
+	delete base; base = NULL;
 	assert(g_memory == 0);
 
 	return 0;
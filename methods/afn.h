@@ -24,6 +24,7 @@ int linear_scan(					// brute-force linear scan (data in disk)
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
 	int   B,							// page size
+	int   max_k,						// max top-k value
 	const float  **query,				// query set
 	const Result **R,					// truth set
 	const char   *data_folder,			// data folder
@@ -39,6 +40,10 @@ int indexing_of_rqalsh_star(		// indexing of RQALSH*
 	int   beta,							// false positive percentage
 	float delta,						// error probability
 	float ratio,						// approximation ratio
+	int   family,						// family of hash functions
+	int   threads,						// number of threads of selection
+	int   in_mem,						// keep candidates in memory (0 or 1)
+	int   packed,						// write packed candidate file (0 or 1)
 	const float **data,					// data set
 	const char  *output_folder);		// output folder
 
@@ -46,6 +51,15 @@ int indexing_of_rqalsh_star(		// indexing of RQALSH*
 int kfn_of_rqalsh_star(				// c-k-AFN search of RQALSH*
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
+	int   max_k,						// max top-k value
+	int   threads,						// number of threads
+	int   qthreads,					// number of threads per query
+	int   sched,						// scheduler of tables
+	int   max_cand,						// budget of candidates (0: default)
+	int   max_io,						// max page i/o (0: no limit)
+	float deadline,						// deadline in ms (0: no limit)
+	int   stats,						// dump statistics of queries (0 or 1)
+	const uint64_t *allow,				// allow-list of objects (or NULL)
 	const float  **query,				// query set
 	const Result **R,					// truth set
 	const char   *data_folder,			// data folder
@@ -59,6 +73,7 @@ int indexing_of_rqalsh(				// indexing of RQALSH
 	int   beta,							// false positive percentage
 	float delta,						// error probability
 	float ratio,						// approximation ratio
+	int   family,						// family of hash functions
 	const float **data,					// data set
 	const char  *output_folder);		// output folder
 
@@ -66,6 +81,20 @@ int indexing_of_rqalsh(				// indexing of RQALSH
 int kfn_of_rqalsh(					// c-k-AFN search of RQALSH
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
+	int   max_k,						// max top-k value
+	int   threads,						// number of threads
+	int   qthreads,					// number of threads per query
+	int   batch,						// number of queries per batch
+	float ratio,						// approximation ratio (0: of index)
+	int   sched,						// scheduler of tables
+	int   max_cand,						// budget of candidates (0: default)
+	int   max_io,						// max page i/o (0: no limit)
+	float deadline,						// deadline in ms (0: no limit)
+	float defer,						// admission factor of deferral (0: off)
+	int   rsched,						// schedule of radius
+	float step,							// step of radius (0: sqrt(ratio))
+	int   stats,						// dump statistics of queries (0 or 1)
+	const uint64_t *allow,				// allow-list of objects (or NULL)
 	const float  **query,				// query set
 	const Result **R,					// truth set
 	const char   *data_folder,			// data folder
@@ -78,6 +107,8 @@ int indexing_of_drusilla_select(	// indexing of Drusilla_Select
 	int   B,							// page size
 	int   L,							// number of projection
 	int   M,							// number of candidates
+	int   threads,						// number of threads of selection
+	int   packed,						// write packed candidate file (0 or 1)
 	const float **data,					// data set
 	const char  *output_folder);		// output folder
 
@@ -85,6 +116,11 @@ int indexing_of_drusilla_select(	// indexing of Drusilla_Select
 int kfn_of_drusilla_select(			// c-k-AFN via Drusilla_Select
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
+	int   max_k,						// max top-k value
+	int   threads,						// number of threads
+	int   batch,						// number of queries per batch (0: all)
+	int   stats,						// dump statistics of queries (0 or 1)
+	const uint64_t *allow,				// allow-list of objects (or NULL)
 	const float  **query,				// query set
 	const Result **R,					// truth set
 	const char   *data_folder,			// data folder
@@ -98,6 +134,7 @@ int indexing_of_qdafn(				// indexing of QDAFN
 	int   L,							// number of projections
 	int   M,							// number of candidates
 	float ratio,						// approximation ratio
+	int   family,						// family of projections
 	const float **data,					// data set
 	const char  *output_folder);		// output folder
 
@@ -105,9 +142,41 @@ int indexing_of_qdafn(				// indexing of QDAFN
 int kfn_of_qdafn(					// c-k-AFN via QDAFN
 	int   qn,							// number of query points
 	int   d,							// dimensionality
+	int   max_k,						// max top-k value
+	int   threads,						// number of threads
+	int   stats,						// dump statistics of queries (0 or 1)
+	const uint64_t *allow,				// allow-list of objects (or NULL)
 	const float  **query,				// query set
 	const Result **R,					// truth set
 	const char   *data_folder,			// data folder
 	const char   *output_folder);		// output folder
 
+// -----------------------------------------------------------------------------
+int counting_benchmark(				// micro-benchmark of collision counting
+	int   qn,							// number of simulated queries
+	const char *output_folder);			// output folder
+
+// -----------------------------------------------------------------------------
+int range_of_rqalsh(				// range-FN search of RQALSH vs. linear scan
+	int   n,							// number of data objects
+	int   qn,							// number of query objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	float r,							// range (distance threshold)
+	const float **query,				// query set
+	const char  *data_folder,			// data folder
+	const char  *output_folder);		// output folder
+
+// -----------------------------------------------------------------------------
+int knn_of_rqalsh(					// c-k-ANN search of RQALSH vs. linear scan
+	int   n,							// number of data objects
+	int   qn,							// number of query objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	int   max_k,						// max top-k value
+	float ratio,						// approximation ratio (0: of index)
+	const float **query,				// query set
+	const char  *data_folder,			// data folder
+	const char  *output_folder);		// output folder
+
 #endif // __AFN_H
@@ -20,6 +20,7 @@ BlockFile::BlockFile(				// constructor
 {
 	strcpy(fname_, name);
 	block_length_ = b_length;
+	dirty_ = false;
 
 	num_blocks_ = 0;				// num of blocks, init to 0
 	// -------------------------------------------------------------------------
@@ -158,6 +159,10 @@ void BlockFile::set_header(			// set remain bytes excluding header
 //  after reading or writing the 2nd data block, file pointer is pointed to 
 //  the 3rd data block. As we know it has read or written 3 blocks, thus 
 //  currently <act_block> = <index> + 1 = 2 + 1 = 3.
+//
+//  reading is positional (pread) and does not move <fp_> or <act_block_>, so 
+//  that several queries can read the same file at the same time. pending 
+//  writes of <fp_> are flushed first, which only happens while building.
 // -----------------------------------------------------------------------------
 bool BlockFile::read_block(			// read a <block> from <index>
 	Block block,						// a <block> (return)
@@ -165,17 +170,10 @@ bool BlockFile::read_block(			// read a <block> from <index>
 {
 	index++;						// extrnl block to intrnl block
 	// assert(index > 0 && index <= num_blocks_);
-	seek_block(index);
+	if (dirty_) { fflush(fp_); dirty_ = false; }
 
-	get_bytes(block, block_length_);
-	if (index + 1 > num_blocks_) {	// <fp_> reaches the end of file
-		fseek(fp_, 0, SEEK_SET);
-		act_block_ = 0;				// <act_block_> rewind to start pos
-	}
-	else {
-		act_block_ = index + 1;		// <act_block_> to next pos
-	}
-	return true;
+	off_t offset = (off_t) index * block_length_;
+	return pread(fileno(fp_), block, block_length_, offset) == block_length_;
 }
 
 // -----------------------------------------------------------------------------
@@ -189,7 +187,7 @@ bool BlockFile::write_block(		// write a <block> into <index>
 {
 	index++;						// extrnl block to intrnl block
 	// assert(index > 0 && index <= num_blocks_);
-	seek_block(index);
+	fseek(fp_, (long) index * block_length_, SEEK_SET);
 
 	put_bytes(block, block_length_);// write this block
 	if (index + 1 > num_blocks_) {	// update <act_block_>
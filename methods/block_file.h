@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <unistd.h>
 
 #include "def.h"
 #include "util.h"
@@ -23,6 +24,7 @@ public:
 	FILE *fp_;						// file pointer
 	char fname_[200];				// file name
 	bool new_flag_;					// specifies if this is a new file
+	bool dirty_;					// has writes not yet flushed to disk
 	
 	int block_length_;				// length of a block
 	int act_block_;					// block num of fp position
@@ -38,7 +40,7 @@ public:
 
 	// -------------------------------------------------------------------------
 	void put_bytes(const char *bytes, int num) // write <bytes> of length <num>
-	{ fwrite(bytes, num, 1, fp_); }
+	{ fwrite(bytes, num, 1, fp_); dirty_ = true; }
 
 	// -------------------------------------------------------------------------
 	void get_bytes(char *bytes, int num) // read <bytes> of length <num>
@@ -79,7 +81,7 @@ public:
 	// -------------------------------------------------------------------------
 	bool read_block(				// read a block <b> in the <pos>
 		Block block,					// a block
-		int   index);					// pos of the block
+		int   index);					// pos of the block (reentrant)
 
 	// -------------------------------------------------------------------------
 	bool write_block(				// write a block <b> in the <pos>
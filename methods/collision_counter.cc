@@ -0,0 +1,129 @@
+#include "collision_counter.h"
+
+// -----------------------------------------------------------------------------
+Collision_Counter::Collision_Counter(// constructor
+	int n,								// number of data objects
+	int m,								// number of hash tables
+	int l,								// collision threshold
+	int type)							// counting engine
+{
+	n_        = n;
+	l_        = l;
+	type_     = (type == COUNTER_AUTO) ? select_type(n, m, l) : type;
+	cnt8_     = NULL;
+	cnt16_    = NULL;
+	cnt32_    = NULL;
+	acnt_     = NULL;
+	checked_  = NULL;
+	slot_     = NULL;
+	capacity_ = 0;
+	mask_     = -1;
+	shift_    = 32;
+	size_     = 0;
+
+	// -------------------------------------------------------------------------
+	//  fall back to wider counters if <l> + 1 cannot be represented
+	// -------------------------------------------------------------------------
+	if (type_ == COUNTER_U8  && l_ >= 255)   type_ = COUNTER_U16;
+	if (type_ == COUNTER_U16 && l_ >= 65535) type_ = COUNTER_INT;
+
+	switch (type_) {
+	case COUNTER_U8:  cnt8_  = new uint8_t[n_];  break;
+	case COUNTER_U16: cnt16_ = new uint16_t[n_]; break;
+	case COUNTER_INT: cnt32_ = new int[n_];      break;
+	case COUNTER_ATOMIC:
+		assert(m < 65535);			// a counter never exceeds <m>
+		acnt_    = new std::atomic<uint16_t>[n_];
+		checked_ = new std::atomic<uint64_t>[(n_ + 63) / 64];
+		break;
+	default:
+		capacity_ = COUNTER_SLOTS;
+		while (capacity_ < 4 * m * LEAF_NODE_SIZE / SIZEINT) capacity_ <<= 1;
+		mask_  = capacity_ - 1;
+		shift_ = 32;
+		for (int c = capacity_; c > 1; c >>= 1) --shift_;
+		slot_  = new Hash_Slot[capacity_];
+		break;
+	}
+	reset();
+}
+
+// -----------------------------------------------------------------------------
+Collision_Counter::~Collision_Counter() // destructor
+{
+	delete[] cnt8_;  cnt8_  = NULL;
+	delete[] cnt16_; cnt16_ = NULL;
+	delete[] cnt32_; cnt32_ = NULL;
+	delete[] acnt_;  acnt_  = NULL;
+	delete[] checked_; checked_ = NULL;
+	delete[] slot_;  slot_  = NULL;
+}
+
+// -----------------------------------------------------------------------------
+//  the dense arrays are preferred when they fit in cache. otherwise, the hash
+//  table is used if it is expected to be smaller than the dense array, where
+//  one scan of each of <m> tables touches at most one leaf key range of ids.
+// -----------------------------------------------------------------------------
+int Collision_Counter::select_type(	// select counting engine
+	int n,								// number of data objects
+	int m,								// number of hash tables
+	int l)								// collision threshold
+{
+	int type  = COUNTER_INT;
+	int width = SIZEINT;
+	if (l < 255)        { type = COUNTER_U8;  width = 1; }
+	else if (l < 65535) { type = COUNTER_U16; width = 2; }
+
+	uint64_t dense  = (uint64_t) n * width;
+	uint64_t sparse = (uint64_t) 4 * m * LEAF_NODE_SIZE / SIZEINT
+		* sizeof(Hash_Slot);
+
+	if (dense > (uint64_t) COUNTER_CACHE && sparse < dense) {
+		type = COUNTER_HASH;
+	}
+	return type;
+}
+
+// -----------------------------------------------------------------------------
+void Collision_Counter::reset()		// reset all counters to 0
+{
+	switch (type_) {
+	case COUNTER_U8:  memset(cnt8_,  0, n_ * sizeof(uint8_t));  break;
+	case COUNTER_U16: memset(cnt16_, 0, n_ * sizeof(uint16_t)); break;
+	case COUNTER_INT: memset(cnt32_, 0, n_ * SIZEINT);          break;
+	case COUNTER_ATOMIC:
+		for (int i = 0; i < n_; ++i) {
+			acnt_[i].store(0, std::memory_order_relaxed);
+		}
+		for (int i = 0; i < (n_ + 63) / 64; ++i) {
+			checked_[i].store(0, std::memory_order_relaxed);
+		}
+		break;
+	default:
+		memset(slot_, -1, capacity_ * sizeof(Hash_Slot));
+		size_ = 0;
+		break;
+	}
+}
+
+// -----------------------------------------------------------------------------
+void Collision_Counter::grow()		// double the capacity of hash table
+{
+	int old_capacity = capacity_;
+	Hash_Slot *old_slot = slot_;
+
+	capacity_ <<= 1;
+	mask_  = capacity_ - 1;
+	shift_ = shift_ - 1;
+	slot_  = new Hash_Slot[capacity_];
+	memset(slot_, -1, capacity_ * sizeof(Hash_Slot));
+
+	for (int i = 0; i < old_capacity; ++i) {
+		if (old_slot[i].id_ == -1) continue;
+
+		int pos = hash(old_slot[i].id_);
+		while (slot_[pos].id_ != -1) pos = (pos + 1) & mask_;
+		slot_[pos] = old_slot[i];
+	}
+	delete[] old_slot; old_slot = NULL;
+}
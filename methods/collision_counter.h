@@ -0,0 +1,167 @@
+#ifndef __COLLISION_COUNTER_H
+#define __COLLISION_COUNTER_H
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include <atomic>
+
+#include "def.h"
+
+// -----------------------------------------------------------------------------
+//  options of counting engines
+// -----------------------------------------------------------------------------
+const int COUNTER_AUTO = -1;		// select engine by <n>, <m> and <l>
+const int COUNTER_INT  = 0;			// int array of size <n>
+const int COUNTER_U8   = 1;			// 8-bit saturating array of size <n>
+const int COUNTER_U16  = 2;			// 16-bit saturating array of size <n>
+const int COUNTER_HASH = 3;			// open-addressing table of touched ids
+const int COUNTER_ATOMIC = 4;		// atomic 16-bit array shared by threads
+
+static const char *counter_name[5] = { "int", "uint8", "uint16", "hash", 
+	"atomic" };
+
+// -----------------------------------------------------------------------------
+//  Hash_Slot: one slot of the open-addressing table (<id_> = -1 is empty)
+// -----------------------------------------------------------------------------
+struct Hash_Slot {
+	int id_;						// object id
+	int cnt_;						// collision count
+};
+
+// -----------------------------------------------------------------------------
+//  Collision_Counter: collision counters of dynamic separation counting.
+//
+//  Each counter saturates at <l> + 1, so that <add> returns true exactly once
+//  per object, i.e., when it becomes frequent. This replaces the arrays of
+//  <freq> and <checked> with a single array that is 4x to 8x smaller, or with
+//  a small hash table of the touched ids when <n> is too large to be cached.
+// -----------------------------------------------------------------------------
+class Collision_Counter {
+public:
+	Collision_Counter(				// constructor
+		int n,							// number of data objects
+		int m,							// number of hash tables
+		int l,							// collision threshold
+		int type = COUNTER_AUTO);		// counting engine
+
+	~Collision_Counter();			// destructor
+
+	// -------------------------------------------------------------------------
+	static int select_type(			// select counting engine
+		int n,							// number of data objects
+		int m,							// number of hash tables
+		int l);							// collision threshold
+
+	// -------------------------------------------------------------------------
+	void reset();					// reset all counters to 0
+
+	// -------------------------------------------------------------------------
+	inline int get_type() { return type_; }
+
+	// -------------------------------------------------------------------------
+	inline void prefetch(			// prefetch the counter of an object
+		int id)							// object id
+	{
+		switch (type_) {
+		case COUNTER_U8:  __builtin_prefetch(&cnt8_[id],  1, 1); break;
+		case COUNTER_U16: __builtin_prefetch(&cnt16_[id], 1, 1); break;
+		case COUNTER_INT: __builtin_prefetch(&cnt32_[id], 1, 1); break;
+		case COUNTER_ATOMIC: __builtin_prefetch(&acnt_[id], 1, 1); break;
+		default: __builtin_prefetch(&slot_[hash(id)], 1, 1); break;
+		}
+	}
+
+	// -------------------------------------------------------------------------
+	//  add one collision from one of several threads (COUNTER_ATOMIC only). 
+	//  counters are bumped with relaxed atomics, and an object over <l> is 
+	//  claimed by its <checked_> bit, so exactly one thread gets true.
+	// -------------------------------------------------------------------------
+	inline bool add_shared(			// add one collision (thread-safe)
+		int id)							// object id
+	{
+		int cnt = acnt_[id].fetch_add(1, std::memory_order_relaxed) + 1;
+		if (cnt <= l_) return false;
+
+		uint64_t bit = (uint64_t) 1 << (id & 63);
+		std::atomic<uint64_t> &word = checked_[id >> 6];
+		if (word.load(std::memory_order_relaxed) & bit) return false;
+		return !(word.fetch_or(bit, std::memory_order_relaxed) & bit);
+	}
+
+	// -------------------------------------------------------------------------
+	inline bool add(				// add one collision for an object
+		int id)							// object id
+	{
+		switch (type_) {
+		case COUNTER_U8:
+			if (cnt8_[id] > l_) return false;
+			return ++cnt8_[id] > l_;
+		case COUNTER_U16:
+			if (cnt16_[id] > l_) return false;
+			return ++cnt16_[id] > l_;
+		case COUNTER_INT:
+			if (cnt32_[id] > l_) return false;
+			return ++cnt32_[id] > l_;
+		case COUNTER_ATOMIC:
+			return add_shared(id);
+		default:
+			return add_hash(id);
+		}
+	}
+
+protected:
+	int n_;							// number of data objects
+	int l_;							// collision threshold
+	int type_;						// counting engine
+
+	uint8_t  *cnt8_;				// 8-bit  counters
+	uint16_t *cnt16_;				// 16-bit counters
+	int      *cnt32_;				// 32-bit counters
+
+	std::atomic<uint16_t> *acnt_;	// atomic 16-bit counters
+	std::atomic<uint64_t> *checked_;// bitset of claimed objects
+
+	Hash_Slot *slot_;				// open-addressing table
+	int capacity_;					// number of slots (power of 2)
+	int mask_;						// <capacity_> - 1
+	int shift_;						// 32 - log2(<capacity_>)
+	int size_;						// number of touched ids
+
+	// -------------------------------------------------------------------------
+	//  multiplicative hashing: take the high bits of the product, since its 
+	//  low k bits depend only on the low k bits of <id>
+	// -------------------------------------------------------------------------
+	inline int hash(int id) {
+		return (int) (((uint32_t) id * 2654435761U) >> shift_);
+	}
+
+	// -------------------------------------------------------------------------
+	inline bool add_hash(			// add one collision (hash table)
+		int id)							// object id
+	{
+		int pos = hash(id);
+		while (slot_[pos].id_ != id && slot_[pos].id_ != -1) {
+			pos = (pos + 1) & mask_;
+		}
+		if (slot_[pos].id_ == -1) {
+			slot_[pos].id_  = id;
+			slot_[pos].cnt_ = 0;
+			if (++size_ * 2 > capacity_) {
+				grow();				// keep load factor below 0.5
+				pos = hash(id);
+				while (slot_[pos].id_ != id) pos = (pos + 1) & mask_;
+			}
+		}
+		if (slot_[pos].cnt_ > l_) return false;
+		return ++slot_[pos].cnt_ > l_;
+	}
+
+	// -------------------------------------------------------------------------
+	void grow();					// double the capacity of hash table
+};
+
+#endif // __COLLISION_COUNTER_H
@@ -47,5 +47,23 @@ const int   CANDIDATES     = 100;
 const int   BFHEAD_LENGTH  = SIZEINT * 2;
 const int   LEAF_NODE_SIZE = 4096;
 const int   MAGIC          = 36553368;
+const int   PREFETCH_DIST  = 16;
+const int   COUNTER_SLOTS  = 1 << 16;
+const int   COUNTER_CACHE  = 8 << 20;
+const int   GEMM_BLK_D     = 512;
+const int   GEMM_BLK_N     = 64;
+const int   GEMM_BLK_Q     = 256;
+const int   STATS_RADII    = 32;
+const int   ALIGN_BYTES    = 64;
+const int   KURT_SAMPLES   = 1000;
+const int   HADAMARD_ROUNDS = 3;
+const int   BULK_BUFFER    = 256 << 20;
+const float RADIUS_MIN_STEP = 1.05f;
+const int   PCA_SAMPLE     = 2000;
+const int   PCA_DIRS       = 32;
+const int   PCA_ITERS      = 10;
+const int   PCA_QUERIES    = 100;
+const int   PCA_FAR        = 100;
+const int   HEAP_K         = 64;
 
 #endif // __DEF_H
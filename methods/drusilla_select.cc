@@ -9,6 +9,7 @@ Drusilla_Select::Drusilla_Select()	// default constructor
 	m_     = -1;
 	B_     = -1;
 	cand_  = NULL;
+	pack_path_[0] = '\0';
 }
 
 // -----------------------------------------------------------------------------
@@ -26,7 +27,9 @@ int Drusilla_Select::build(			// build index
 	int   m,							// number of candidates on each proj
 	int   B,							// page size
 	const float **data,					// data objects
-	const char  *path)					// index path
+	const char  *path,					// index path
+	int   threads,						// number of threads of selection
+	int   packed)						// write packed candidate file (0 or 1)
 {
 	// -------------------------------------------------------------------------
 	//  init parameters
@@ -44,7 +47,7 @@ int Drusilla_Select::build(			// build index
 	int size = l_ * m_;
 	g_memory += SIZEINT * size;
 	cand_ = new int[size];
-	select(data, cand_);
+	select(data, threads, cand_);
 
 	// -------------------------------------------------------------------------
 	//  write parameter to disk
@@ -59,76 +62,78 @@ int Drusilla_Select::build(			// build index
 	fwrite(&m_,     SIZEINT, 1,    fp);
 	fwrite(cand_,   SIZEINT, size, fp);
 	fclose(fp);
-	
+
+	// -------------------------------------------------------------------------
+	//  write the candidates to their own packed data file if necessary
+	// -------------------------------------------------------------------------
+	if (packed) {
+		strcpy(pack_path_, path); strcat(pack_path_, "drusilla.cand");
+		return write_packed_data(size, dim_, B_, cand_, data, pack_path_);
+	}
 	return 0;
 }
 
+// -----------------------------------------------------------------------------
+//  each iteration scores the runs of ids in parallel, and merges the top-m of
+//  the runs and their largest norms in the order of ids (see Select_Round)
 // -----------------------------------------------------------------------------
 void Drusilla_Select::select(		// drusilla select
 	const float **data,					// data objects
+	int   threads,						// number of threads
 	int   *cand)						// candidate id (return)
 {
 	// -------------------------------------------------------------------------
-	//  calc the shift data
+	//  calc the centroid and the l2-norm of shift data
 	// -------------------------------------------------------------------------
 	int   max_id = -1;
 	float max_norm = -1.0f;
 	float *norm = new float[n_pts_];
-	float **shift_data = new float*[n_pts_];
-	for (int i = 0; i < n_pts_; ++i) shift_data[i] = new float[dim_];
+	float *centroid = new float[dim_];
 
-	calc_shift_data(data, max_id, max_norm, norm, shift_data);
+	calc_shift_norm(data, centroid, max_id, max_norm, norm);
 
 	// -------------------------------------------------------------------------
 	//  drusilla select
 	// -------------------------------------------------------------------------
+	int    chunks = std::max(1, std::min(threads, n_pts_));
 	float  *proj  = new float[dim_];
 	Result *score = new Result[n_pts_];
+	Result *top   = new Result[chunks * m_];
 	bool   *close_angle = new bool[n_pts_];
 
+	Select_Round round;
+	round.n_           = n_pts_;
+	round.d_           = dim_;
+	round.m_           = m_;
+	round.chunks_      = chunks;
+	round.data_        = data;
+	round.centroid_    = centroid;
+	round.proj_        = proj;
+	round.norm_        = norm;
+	round.close_angle_ = close_angle;
+	round.score_       = score;
+	round.max_id_      = new int[chunks];
+	round.max_norm_    = new float[chunks];
+
 	for (int i = 0; i < l_; ++i) {
 		// ---------------------------------------------------------------------
 		//  select the projection vector with largest norm and normalize it
 		// ---------------------------------------------------------------------
 		for (int j = 0; j < dim_; ++j) {
-			proj[j] = shift_data[max_id][j] / norm[max_id];
+			proj[j] = (data[max_id][j] - centroid[j]) / norm[max_id];
 		}
 
 		// ---------------------------------------------------------------------
-		//  calculate offsets and distortions
+		//  calculate offsets and distortions, and the top-m of each run
 		// ---------------------------------------------------------------------
-		for (int j = 0; j < n_pts_; ++j) {
-			score[j].id_ = j;
-			close_angle[j] = false;
-
-			if (norm[j] > 0.0f) {
-				float offset = calc_inner_product(dim_, shift_data[j], proj);
-
-				float distortion = 0.0F;
-				for (int k = 0; k < dim_; ++k) {
-					distortion += SQR(shift_data[j][k] - offset * proj[k]);
-				}
-				distortion = sqrt(distortion);
-
-				score[j].key_ = fabs(offset) - fabs(distortion);
-				if (atan(distortion / fabs(offset)) < ANGLE) {
-					close_angle[j] = true;
-				}
-			}
-			else if (fabs(norm[j]) < FLOATZERO) {
-				score[j].key_ = MINREAL + 1.0f;
-			}
-			else {
-				score[j].key_ = MINREAL;
-			}
-		}
+		parallel_for(chunks, threads, score_task, &round);
 
 		// ---------------------------------------------------------------------
 		//  collect the idects that are well-represented by this projection
 		// ---------------------------------------------------------------------
-		qsort(score, n_pts_, sizeof(Result), ResultCompDesc);
+		merge_top_m(&round, top);
 		for (int j = 0; j < m_; ++j) {
-			int id = score[j].id_;
+			int id = top[j].id_;
 			cand[i * m_ + j] = id;
 			
 			norm[id] = -1.0f;
@@ -137,12 +142,8 @@ void Drusilla_Select::select(		// drusilla select
 		// ---------------------------------------------------------------------
 		//  find the next largest norm and the corresponding idect
 		// ---------------------------------------------------------------------
-		max_id = -1;
-		max_norm = -1.0f;
-		for (int j = 0; j < n_pts_; ++j) {
-			if (norm[j] > 0.0f && close_angle[j]) { norm[j] = 0.0f; }
-			if (norm[j] > max_norm) { max_norm = norm[j]; max_id = j; }
-		}
+		parallel_for(chunks, threads, max_norm_task, &round);
+		max_id = merge_max_norm(&round, max_norm);
 	}
 	// -------------------------------------------------------------------------
 	//  release space
@@ -151,25 +152,64 @@ void Drusilla_Select::select(		// drusilla select
 	delete[] close_angle; close_angle = NULL;
 	delete[] proj;        proj        = NULL;
 	delete[] score;       score       = NULL;
+	delete[] centroid;    centroid    = NULL;
+	delete[] top;         top         = NULL;
+	delete[] round.max_id_;   round.max_id_   = NULL;
+	delete[] round.max_norm_; round.max_norm_ = NULL;
+}
 
-	for (int i = 0; i < n_pts_; ++i) {
-		delete[] shift_data[i]; shift_data[i] = NULL;
+// -----------------------------------------------------------------------------
+void Drusilla_Select::score_task(	// score one run of ids
+	int   tid,							// thread id
+	int   c,							// run id
+	void  *arg)							// round of selection (Select_Round)
+{
+	Select_Round *round = (Select_Round*) arg;
+	int   dim  = round->d_;
+	const float *proj = round->proj_;
+	const float *norm = round->norm_;
+	bool   *close_angle = round->close_angle_;
+	Result *score = round->score_;
+
+	int lo = chunk_begin(round->n_, round->chunks_, c);
+	int hi = chunk_begin(round->n_, round->chunks_, c + 1);
+	for (int j = lo; j < hi; ++j) {
+		score[j].id_ = j;
+		close_angle[j] = false;
+
+		if (norm[j] > 0.0f) {
+			float offset = calc_shift_inner_product(dim, round->data_[j], 
+				round->centroid_, proj);
+			float distortion = SQR(norm[j]) - offset * offset;
+			distortion = sqrt(MAX(distortion, 0.0f));
+
+			score[j].key_ = fabs(offset) - fabs(distortion);
+			if (atan(distortion / fabs(offset)) < ANGLE) {
+				close_angle[j] = true;
+			}
+		}
+		else if (fabs(norm[j]) < FLOATZERO) {
+			score[j].key_ = MINREAL + 1.0f;
+		}
+		else {
+			score[j].key_ = MINREAL;
+		}
 	}
-	delete[] shift_data; shift_data = NULL;
+	top_m_desc(hi - lo, round->m_, &score[lo]);
 }
 
 // -----------------------------------------------------------------------------
-void Drusilla_Select::calc_shift_data( // calculate shift data objects
+void Drusilla_Select::calc_shift_norm( // calc centroid and l2-norm of shift data
 	const float **data,					// data objects
+	float *centroid,					// centroid of data objects (return)
 	int   &max_id,						// data id with max l2-norm (return)
 	float &max_norm,					// max l2-norm (return)
-	float *norm,						// l2-norm of shift data (return)
-	float **shift_data) 				// shift data (return)
+	float *norm)						// l2-norm of shift data (return)
 {
 	// -------------------------------------------------------------------------
 	//  calculate the centroid of data objects
 	// -------------------------------------------------------------------------
-	std::vector<float> centroid(dim_, 0.0f);
+	memset(centroid, 0, dim_ * SIZEFLOAT);
 	for (int i = 0; i < n_pts_; ++i) {
 		for (int j = 0; j < dim_; ++j) {
 			centroid[j] += data[i][j];
@@ -178,7 +218,7 @@ void Drusilla_Select::calc_shift_data( // calculate shift data objects
 	for (int i = 0; i < dim_; ++i) centroid[i] /= n_pts_;
 
 	// -------------------------------------------------------------------------
-	//  calc shift data and their l2-norm and find max l2-norm and its id
+	//  calc l2-norm of shift data and find max l2-norm and its id
 	// -------------------------------------------------------------------------
 	max_id   = -1;
 	max_norm = MINREAL;
@@ -187,7 +227,6 @@ void Drusilla_Select::calc_shift_data( // calculate shift data objects
 		norm[i] = 0.0f;
 		for (int j = 0; j < dim_; ++j) {
 			float tmp = data[i][j] - centroid[j];
-			shift_data[i][j] = tmp;
 			norm[i] += SQR(tmp);
 		}
 		norm[i] = sqrt(norm[i]);
@@ -205,6 +244,7 @@ void Drusilla_Select::display()		// display parameters
 	printf("    l    = %d\n", l_);
 	printf("    m    = %d\n", m_);
 	printf("    B    = %d\n", B_);
+	printf("    pack = %s\n", pack_path_[0] != '\0' ? "yes" : "no");
 	printf("    path = %s\n", path_);
 	printf("\n");
 }
@@ -232,6 +272,14 @@ int Drusilla_Select::load(			// load index
 	cand_ = new int[size];
 	fread(cand_, SIZEINT, size, fp);
 	fclose(fp);
+
+	// -------------------------------------------------------------------------
+	//  read candidates from their packed data file if it exists
+	// -------------------------------------------------------------------------
+	char fname[200];
+	strcpy(fname, path); strcat(fname, "drusilla.cand");
+	fp = fopen(fname, "rb");
+	if (fp) { fclose(fp); strcpy(pack_path_, fname); }
 	
 	return 0;
 }
@@ -240,18 +288,168 @@ int Drusilla_Select::load(			// load index
 uint64_t Drusilla_Select::search(	// c-k-AFN search
 	const float *query,					// query point
 	const char  *data_folder,			// new format data folder
-	MaxK_List   *list)					// top-k results (return)
+	MaxK_List   *list,					// top-k results (return)
+	Query_Stats *stats,					// statistics of query (optional)
+	const uint64_t *allow) const		// allow-list (optional)
 {
-	float *data = new float[dim_];	
+	timeval start_time;				// start time of this query
+	if (stats != NULL) {
+		reset_stats(stats);
+		gettimeofday(&start_time, NULL);
+	}
+
 	int size = l_ * m_;
+	int num  = 0;					// number of verified candidates
+	uint64_t io = 0;				// number of data pages read
+	if (pack_path_[0] != '\0') {
+		io = packed_scan(size, dim_, B_, cand_, pack_path_, query, allow, 
+			list, num);
+	}
+	else {
+		float *data = new float[dim_];	
+		for (int i = 0; i < size; ++i) {
+			int id = cand_[i];
+			if (allow != NULL && !is_allowed(allow, id)) continue;
+			read_data_new_format(id, dim_, B_, data_folder, data);
+
+			float dist = calc_l2_dist(dim_, (const float *) data, query);
+			list->insert(dist, id + 1);
+			++num;
+		}
+		delete[] data; data = NULL;
+		io = num;
+	}
+
+	if (stats != NULL) {			// all candidates are verified
+		stats->data_io_     = io;
+		stats->cand_        = num;
+		stats->verify_time_ = elapsed_ms(start_time);
+		stats->stop_        = STOP_CAND;
+	}
+
+	return io;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t Drusilla_Select::read_candidates( // read allowed candidates as rows
+	const char *data_folder,			// new format data folder
+	const uint64_t *allow,				// allow-list (or NULL)
+	int   *pos,							// positions of rows (return)
+	float *mat,							// rows from new_matrix (return)
+	int   &num) const					// number of rows (return)
+{
+	int size = l_ * m_;
+	if (pack_path_[0] != '\0') {
+		return read_packed_data(size, dim_, B_, cand_, pack_path_, allow, pos, 
+			mat, num);
+	}
+
+	int ld = pad_dim(dim_);
+	num = 0;
 	for (int i = 0; i < size; ++i) {
 		int id = cand_[i];
-		read_data_new_format(id, dim_, B_, data_folder, data);
+		if (allow != NULL && !is_allowed(allow, id)) continue;
+		read_data_new_format(id, dim_, B_, data_folder, 
+			&mat[(uint64_t) num * ld]);
+		pos[num++] = i;
+	}
+	return (uint64_t) num;
+}
+
+// -----------------------------------------------------------------------------
+//  the squared distances of a block of <GEMM_BLK_Q> queries to all candidates
+//  are ||x||^2 + ||q||^2 - 2 q^T x by one GEMM. as the rounding error of each 
+//  one is at most <eps>, a candidate whose distance is less than the k-th 
+//  largest one by more than <eps> cannot be a k-FN, so only the rest are 
+//  verified by calc_l2_dist in their order. the i/o and time of the batch 
+//  are shared by its queries.
+// -----------------------------------------------------------------------------
+uint64_t Drusilla_Select::search_batch(	// c-k-AFN search of a batch of queries
+	int   qn,							// number of queries
+	int   top_k,						// top-k value
+	const float **query,				// queries
+	const char  *data_folder,			// new format data folder
+	MaxK_List  **list,					// top-k results of each query (return)
+	Query_Stats *stats,					// statistics of each query (optional)
+	const uint64_t *allow) const		// allow-list (optional)
+{
+	timeval start_time;				// start time of this batch
+	gettimeofday(&start_time, NULL);
 
-		float dist = calc_l2_dist(dim_, (const float *) data, query);
-		list->insert(dist, id + 1);
+	// -------------------------------------------------------------------------
+	//  read the allowed candidates and calc their squared l2-norms
+	// -------------------------------------------------------------------------
+	int   size = l_ * m_;
+	int   ld   = pad_dim(dim_);
+	int   *pos = new int[size];
+	float *mat = new_matrix(size, dim_);
+	int   num  = 0;					// number of allowed candidates
+	uint64_t io = read_candidates(data_folder, allow, pos, mat, num);
+
+	float *norm = new float[num];
+	float max_norm = 0.0f;
+	for (int j = 0; j < num; ++j) {
+		const float *x = &mat[(uint64_t) j * ld];
+		norm[j] = calc_inner_product(dim_, x, x);
+		if (norm[j] > max_norm) max_norm = norm[j];
+	}
+
+	// -------------------------------------------------------------------------
+	//  filter and verify the candidates of each block of queries
+	// -------------------------------------------------------------------------
+	float *dist = new float[(uint64_t) MIN(GEMM_BLK_Q, qn) * num];
+	float *kth  = new float[num];
+	int   *keep = new int[num];
+	for (int q0 = 0; q0 < qn; q0 += GEMM_BLK_Q) {
+		int nq = MIN(GEMM_BLK_Q, qn - q0);
+		calc_inner_products(nq, num, dim_, &query[q0], mat, ld, dist);
+
+		for (int i = 0; i < nq; ++i) {
+			const float *q = query[q0 + i];
+			float *row = &dist[(uint64_t) i * num];
+			float q_norm = calc_inner_product(dim_, q, q);
+			for (int j = 0; j < num; ++j) {
+				row[j] = norm[j] + q_norm - 2.0f * row[j];
+			}
+
+			float thr = MINREAL;	// threshold of squared distances
+			if (num > top_k) {
+				float r   = sqrt(max_norm) + sqrt(q_norm);
+				float eps = 4.0f * (dim_ + 2) * FLT_EPSILON * r * r;
+
+				memcpy(kth, row, num * SIZEFLOAT);
+				std::nth_element(kth, kth + num - top_k, kth + num);
+				thr = kth[num - top_k] - eps;
+			}
+			int cnt = 0;
+			for (int j = 0; j < num; ++j) {
+				keep[cnt] = j; cnt += (row[j] >= thr);
+			}
+
+			MaxK_List *l = list[q0 + i];
+			for (int c = 0; c < cnt; ++c) {
+				int j = keep[c];
+				float d = calc_l2_dist(dim_, &mat[(uint64_t) j * ld], q);
+				l->insert(d, cand_[pos[j]] + 1);
+			}
+		}
 	}
-	delete[] data; data = NULL;
+	delete[] keep; keep = NULL;
+	delete[] kth;  kth  = NULL;
+	delete[] dist; dist = NULL;
+	delete[] norm; norm = NULL;
+	delete[] pos;  pos  = NULL;
+	delete_matrix(mat); mat = NULL;
 
-	return (uint64_t) size;
+	if (stats != NULL) {			// all candidates are filtered
+		float time = elapsed_ms(start_time);
+		for (int i = 0; i < qn; ++i) {
+			reset_stats(&stats[i]);
+			stats[i].data_io_     = io / qn + (i < (int) (io % qn) ? 1 : 0);
+			stats[i].cand_        = num;
+			stats[i].verify_time_ = time / qn;
+			stats[i].stop_        = STOP_CAND;
+		}
+	}
+	return io;
 }
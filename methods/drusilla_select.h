@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <cfloat>
 #include <vector>
 
 #include "def.h"
@@ -30,7 +31,9 @@ public:
 		int   m,						// number of candidates on each proj
 		int   B,						// page size
 		const float **data,				// data objects
-		const char  *path);				// index path
+		const char  *path,				// index path
+		int   threads = 1,				// number of threads of selection
+		int   packed = 0);				// write packed candidate file (0 or 1)
 
 	// -------------------------------------------------------------------------
 	int load(						// load index
@@ -39,11 +42,30 @@ public:
 	// -------------------------------------------------------------------------
 	void display();					// display parameters
 
+	// -------------------------------------------------------------------------
+	//  c-k-AFN search: verify all candidates, which are read from their own 
+	//  dense pages if they are packed
 	// -------------------------------------------------------------------------
 	uint64_t search(				// c-k-AFN search
 		const float *query,				// query object
 		const char  *data_folder,		// new format data folder
-		MaxK_List   *list);				// top-k results (return)
+		MaxK_List   *list,				// top-k results (return)
+		Query_Stats *stats = NULL,		// statistics of query (optional)
+		const uint64_t *allow = NULL) const; // allow-list (optional)
+
+	// -------------------------------------------------------------------------
+	//  c-k-AFN search of a batch of queries: the candidates are read once for
+	//  the batch, and the distances of all pairs are filtered by GEMM before
+	//  the survivors are verified, so the results are the same as search()
+	// -------------------------------------------------------------------------
+	uint64_t search_batch(			// c-k-AFN search of a batch of queries
+		int   qn,						// number of queries
+		int   top_k,					// top-k value
+		const float **query,			// queries
+		const char  *data_folder,		// new format data folder
+		MaxK_List  **list,				// top-k results of each query (return)
+		Query_Stats *stats = NULL,		// statistics of each query (optional)
+		const uint64_t *allow = NULL) const; // allow-list (optional)
 
 protected:
 	int  n_pts_;					// number of data objects
@@ -52,20 +74,36 @@ protected:
 	int  m_;						// number of candidates
 	int  B_;						// page size
 	char path_[200];				// address of index
+	char pack_path_[200];			// packed data file of candidates (or "")
 	int  *cand_;					// candidates on each projection
 
 	// -------------------------------------------------------------------------
 	void select(					// drusilla select
 		const float **data,				// data objects
+		int  threads,					// number of threads
 		int  *cand);					// candidate id (return)
 
 	// -------------------------------------------------------------------------
-	void calc_shift_data(			// calculate shift data objects
+	uint64_t read_candidates(		// read allowed candidates as rows
+		const char *data_folder,		// new format data folder
+		const uint64_t *allow,			// allow-list (or NULL)
+		int   *pos,						// positions of rows (return)
+		float *mat,						// rows from new_matrix (return)
+		int   &num) const;				// number of rows (return)
+
+	// -------------------------------------------------------------------------
+	static void score_task(			// score one run of ids
+		int   tid,						// thread id
+		int   c,						// run id
+		void  *arg);					// round of selection (Select_Round)
+
+	// -------------------------------------------------------------------------
+	void calc_shift_norm(			// calc centroid and l2-norm of shift data
 		const float **data,				// data objects
+		float *centroid,				// centroid of data objects (return)
 		int   &max_id,					// data id with max l2-norm (return)
 		float &max_norm,				// max l2-norm (return)
-		float *norm,					// l2-norm of shift data (return)
-		float **shift_data); 			// shift data (return)
+		float *norm);					// l2-norm of shift data (return)
 };
 
 #endif // __DRUSILLA_SELECT_H
@@ -15,54 +15,114 @@ void usage() 						// usage of the package
 		"--------------------------------------------------------------------\n"
 		" Usage of the Package for External c-k-AFN Search:                  \n"
 		"--------------------------------------------------------------------\n"
-		"    -alg   (integer)   options of algorithms (0 - 9)\n"
+		"    -alg   (integer)   options of algorithms (0 - 12)\n"
 		"    -n     (integer)   number of data  objects\n"
 		"    -qn    (integer)   number of query objects\n"
+		"    -k     (integer)   max top-k value of truth set and search, whose\n"
+		"                       rounds are the top-k values 1, 2, 5, 10 below\n"
+		"                       k and k itself (default 10)\n"
 		"    -d     (integer)   dimensionality\n"
 		"    -B     (integer)   page size\n"
 		"    -L	    (integer)   number of projection\n"
 		"    -M     (integer)   number of candidates\n"
 		"    -beta  (integer)   numerb of false positives\n"
 		"    -delta (real)      error probability\n"
-		"    -c     (real)      approximation ratio (c > 1)\n"
+		"    -c     (real)      approximation ratio (c > 1). the search of\n"
+		"                       RQALSH may use any c >= c of its index\n"
 		"    -ds    (string)    address of data  set\n"
 		"    -qs    (string)    address of query set\n"
 		"    -ts    (string)    address of truth set\n"
 		"    -df    (string)    data folder to store new format of data\n"
 		"    -of    (string)    output folder to store output results\n"
+		"    -threads (integer) number of query threads, or threads of the\n"
+		"                       selection of alg 1 and 5 (default 1)\n"
+		"    -qthreads (integer) number of threads per query (default 1)\n"
+		"    -batch (integer)   number of queries per batch of RQALSH, which\n"
+		"                       shares the leaf pages of the tails and gives the\n"
+		"                       results of the per-query search (default 0; not\n"
+		"                       with -qthreads -sched -max_io -defer -rsched\n"
+		"                       -step),\n"
+		"                       or per GEMM batch of Drusilla_Select (default 0:\n"
+		"                       the query set split over the threads)\n"
+		"    -sched (integer)   scheduler of tables of RQALSH: 0 - round robin,\n"
+		"                       1 - priority of projected distance (default 0)\n"
+		"    -max_cand (integer) budget of candidates per query (default 100)\n"
+		"    -max_io (integer)  max page I/O per query (default 0: no limit)\n"
+		"    -deadline (real)   deadline (ms) per query (default 0: no limit)\n"
+		"    -defer (real)      admit defer * max_cand candidates and verify\n"
+		"                       max_cand of them by projected lower bounds\n"
+		"                       (RQALSH, default 0: off, or >= 1)\n"
+		"    -rsched (integer)  schedule of radius of RQALSH: 0 - divide by c,\n"
+		"                       1 - divide by -step, 2 - adaptive (default 0)\n"
+		"    -step  (real)      step of radius for -rsched 1 (default sqrt(c))\n"
+		"    -r     (real)      range (distance threshold) of range-FN search\n"
+		"    -proj  (integer)   family of hash functions of RQALSH and QDAFN:\n"
+		"                       0 - gaussian, 1 - very sparse {-1, 0, +1}\n"
+		"                       (RQALSH only), 2 - randomized Hadamard,\n"
+		"                       3 - principal directions and gaussian\n"
+		"                       (RQALSH only) (default 0)\n"
+		"    -stats (integer)   dump statistics of each query (default 0)\n"
+		"    -sel   (real)      selectivity of a random allow-list of filtered\n"
+		"                       search, whose truth is found by linear scan\n"
+		"                       (alg 2, 4, 6 and 8 with -n -B, default 1: off)\n"
+		"    -mem   (integer)   keep the candidates of RQALSH* in memory in its\n"
+		"                       index, so they are verified with no data I/O\n"
+		"                       (alg 1, default 0)\n"
+		"    -pack  (integer)   write the candidates of RQALSH* or Drusilla_Select\n"
+		"                       to a packed data file in their index, so they\n"
+		"                       are read from dense pages (alg 1 and 5, default 0)\n"
 		"\n"
 		"--------------------------------------------------------------------\n"
 		" The Options of Algorithms (-alg) are:                              \n"
 		"--------------------------------------------------------------------\n"
 		"    0 - Ground-Truth\n"
-		"        Params: -alg 0 -n -qn -d -ds -qs -ts\n"
+		"        Params: -alg 0 -n -qn -d -ds -qs -ts [-k]\n"
 		"\n"
 		"    1 - Indexing of RQALSH*\n"
-		"        Params: -alg 1 -n -d -B -L -M -beta -delta -c -ds -df -of\n"
+		"        Params: -alg 1 -n -d -B -L -M -beta -delta -c -ds -df -of [-proj]\n"
+		"                [-threads -mem -pack]\n"
 		"\n"
 		"    2 - c-k-AFN Search of RQALSH*\n"
-		"        Params: -alg 2 -qn -d -qs -ts -df -of\n"
+		"        Params: -alg 2 -qn -d -qs -ts -df -of [-k -threads -qthreads]\n"
+		"                [-sched -max_cand -max_io -deadline -stats -sel -n -B]\n"
 		"\n"
 		"    3 - Indexing of RQALSH\n"
-		"        Params: -alg 3 -n -d -B -beta -delta -c -ds -df -of\n"
+		"        Params: -alg 3 -n -d -B -beta -delta -c -ds -df -of [-proj]\n"
 		"\n"
 		"    4 - c-k-AFN Search of RQALSH\n"
-		"        Params: -alg 4 -qn -d -qs -ts -df -of\n"
+		"        Params: -alg 4 -qn -d -qs -ts -df -of [-threads -qthreads -batch]\n"
+		"                [-k -c -sched -max_cand -max_io -deadline -defer -rsched]\n"
+		"                [-step -stats -sel -n -B]\n"
 		"\n"
 		"    5 - Indexing of Drusilla_Select\n"
-		"        Params: -alg 5 -n -d -B -L -M -ds -df -of\n\n"
+		"        Params: -alg 5 -n -d -B -L -M -ds -df -of [-threads -pack]\n\n"
 		"\n"
 		"    6 - c-k-AFN Search of Drusilla_Select\n"
-		"        Params: -alg 6 -qn -d -qs -ts -df -of\n"
+		"        Params: -alg 6 -qn -d -qs -ts -df -of [-k -threads -batch -stats]\n"
+		"                [-sel -n -B]\n"
 		"\n"
 		"    7 - Indexing of QDAFN\n"
-		"        Params: -alg 7 -n -d -B -L -M -c -ds -df -of\n\n"
+		"        Params: -alg 7 -n -d -B -L -M -c -ds -df -of [-proj]\n\n"
 		"\n"
 		"    8 - c-k-AFN Search of QDAFN\n"
-		"        Params: -alg 8 -qn -d -qs -ts -df -of\n"
+		"        Params: -alg 8 -qn -d -qs -ts -df -of [-k -threads -stats]\n"
+		"                [-sel -n -B]\n"
 		"\n"
 		"    9 - k-FN Search of Linear Scan\n"
-		"        Params: -alg 9 -n -qn -d -B -qs -ts -df -of\n"
+		"        Params: -alg 9 -n -qn -d -B -qs -ts -df -of [-k]\n"
+		"\n"
+		"   10 - Micro-Benchmark of Collision Counting (RQALSH index, on\n"
+		"        synthetic tails of uniform random ids)\n"
+		"        Params: -alg 10 -qn -of\n"
+		"\n"
+		"   11 - Range-FN Search of RQALSH vs. Linear Scan (objects\n"
+		"        beyond distance -r, and recall against linear scan)\n"
+		"        Params: -alg 11 -n -qn -d -B -r -qs -df -of\n"
+		"\n"
+		"   12 - c-k-ANN Search of RQALSH vs. Linear Scan (nearest\n"
+		"        neighbors on the index of alg 3, and ratio and recall\n"
+		"        against linear scan)\n"
+		"        Params: -alg 12 -n -qn -d -B -qs -df -of [-k -c]\n"
 		"\n"
 		"--------------------------------------------------------------------\n"
 		" Author: Qiang HUANG  (huangq2011@gmail.com)                        \n"
@@ -92,6 +152,24 @@ int main(int nargs, char** args)
 	int    beta    = -1;			// false positive percentage
 	float  delta   = -1.0f;			// error probability
 	float  ratio   = -1.0f;			// approximation ratio
+	int    threads = 1;				// number of query threads
+	int    qthreads = 1;			// number of threads per query
+	int    batch   = 0;				// number of queries per batch (0: off)
+	int    sched   = 0;				// scheduler of tables (round robin)
+	int    max_cand = 0;			// budget of candidates (0: CANDIDATES)
+	int    max_io  = 0;				// max page i/o per query (0: no limit)
+	float  deadline = 0.0f;			// deadline (ms) per query (0: no limit)
+	float  defer   = 0.0f;			// admission factor of deferral (0: off)
+	int    rsched  = 0;				// schedule of radius (divide by ratio)
+	float  step    = 0.0f;			// step of radius (0: sqrt(ratio))
+	int    stats   = 0;				// dump statistics of each query (0 or 1)
+	float  range   = -1.0f;			// range of range-FN search
+	int    family  = 0;				// family of hash functions (gaussian)
+	float  sel     = 1.0f;			// selectivity of allow-list (1: off)
+	int    max_k   = MAXK;			// max top-k value
+	int    in_mem  = 0;				// keep candidates of RQALSH* in memory
+	int    packed  = 0;				// write packed candidate data file
+	uint64_t *allow = NULL;			// allow-list of filtered search
 	float  **data  = NULL;			// data set
 	float  **query = NULL;			// query set
 	Result **R     = NULL;			// k-NN ground truth
@@ -102,7 +180,7 @@ int main(int nargs, char** args)
 		if (strcmp(args[cnt], "-alg") == 0) {
 			alg = atoi(args[++cnt]);
 			printf("alg           = %d\n", alg);
-			if (alg < 0 || alg > 9) {
+			if (alg < 0 || alg > 12) {
 				failed = true;
 				break;
 			}
@@ -123,6 +201,14 @@ int main(int nargs, char** args)
 				break;
 			}
 		}
+		else if (strcmp(args[cnt], "-k") == 0) {
+			max_k = atoi(args[++cnt]);
+			printf("k             = %d\n", max_k);
+			if (max_k <= 0) {
+				failed = true;
+				break;
+			}
+		}
 		else if (strcmp(args[cnt], "-d") == 0) {
 			d = atoi(args[++cnt]);
 			printf("d             = %d\n", d);
@@ -179,6 +265,134 @@ int main(int nargs, char** args)
 				break;
 			}
 		}
+		else if (strcmp(args[cnt], "-threads") == 0) {
+			threads = atoi(args[++cnt]);
+			printf("threads       = %d\n", threads);
+			if (threads <= 0) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-qthreads") == 0) {
+			qthreads = atoi(args[++cnt]);
+			printf("qthreads      = %d\n", qthreads);
+			if (qthreads <= 0) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-batch") == 0) {
+			batch = atoi(args[++cnt]);
+			printf("batch         = %d\n", batch);
+			if (batch < 0) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-sched") == 0) {
+			sched = atoi(args[++cnt]);
+			printf("sched         = %d\n", sched);
+			if (sched != SCHED_ROUND_ROBIN && sched != SCHED_PRIORITY) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-max_cand") == 0) {
+			max_cand = atoi(args[++cnt]);
+			printf("max_cand      = %d\n", max_cand);
+			if (max_cand < 0) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-max_io") == 0) {
+			max_io = atoi(args[++cnt]);
+			printf("max_io        = %d\n", max_io);
+			if (max_io < 0) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-deadline") == 0) {
+			deadline = (float) atof(args[++cnt]);
+			printf("deadline      = %.2f\n", deadline);
+			if (deadline < 0.0f) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-defer") == 0) {
+			defer = (float) atof(args[++cnt]);
+			printf("defer         = %.2f\n", defer);
+			if (defer != 0.0f && defer < 1.0f) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-rsched") == 0) {
+			rsched = atoi(args[++cnt]);
+			printf("rsched        = %d\n", rsched);
+			if (rsched < 0 || rsched > 2) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-step") == 0) {
+			step = (float) atof(args[++cnt]);
+			printf("step          = %.2f\n", step);
+			if (step <= 1.0f) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-r") == 0) {
+			range = (float) atof(args[++cnt]);
+			printf("range         = %.2f\n", range);
+			if (range <= 0.0f) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-proj") == 0) {
+			family = atoi(args[++cnt]);
+			printf("proj          = %d\n", family);
+			if (family < 0 || family > 3) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-stats") == 0) {
+			stats = atoi(args[++cnt]);
+			printf("stats         = %d\n", stats);
+			if (stats != 0 && stats != 1) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-mem") == 0) {
+			in_mem = atoi(args[++cnt]);
+			printf("mem           = %d\n", in_mem);
+			if (in_mem != 0 && in_mem != 1) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-pack") == 0) {
+			packed = atoi(args[++cnt]);
+			printf("pack          = %d\n", packed);
+			if (packed != 0 && packed != 1) {
+				failed = true;
+				break;
+			}
+		}
+		else if (strcmp(args[cnt], "-sel") == 0) {
+			sel = (float) atof(args[++cnt]);
+			printf("sel           = %.3f\n", sel);
+			if (sel <= 0.0f || sel > 1.0f) {
+				failed = true;
+				break;
+			}
+		}
 		else if (strcmp(args[cnt], "-ds") == 0) {
 			strncpy(data_set, args[++cnt], sizeof(data_set));
 			printf("data_set      = %s\n", data_set);
@@ -221,6 +435,13 @@ int main(int nargs, char** args)
 	}
 	printf("\n");
 
+	if (alg == 4 && batch > 0 && (qthreads > 1 || sched != SCHED_ROUND_ROBIN ||
+		max_io > 0 || defer != 0.0f || rsched != RADIUS_RATIO || step != 0.0f)) {
+		printf("-batch cannot be used with -qthreads, -sched, -max_io, -defer, "
+			"-rsched or -step\n");
+		return 1;
+	}
+
 	// -------------------------------------------------------------------------
 	//  read data set, query set, and ground truth file
 	// -------------------------------------------------------------------------
@@ -234,7 +455,8 @@ int main(int nargs, char** args)
 		}
 	}
 
-	if (alg == 0 || alg == 2 || alg == 4 || alg == 6 || alg == 8 || alg == 9) {
+	if (alg == 0 || alg == 2 || alg == 4 || alg == 6 || alg == 8 || alg == 9 ||
+		alg == 11 || alg == 12) {
 		query = new float*[qn];
 		for (int i = 0; i < qn; ++i) query[i] = new float[d];
 		if (read_bin_data(qn, d, query_set, query) == 1) return 1;
@@ -242,57 +464,84 @@ int main(int nargs, char** args)
 
 	if (alg == 2 || alg == 4 || alg == 6 || alg == 8 || alg == 9) {
 		R = new Result*[qn];
-		for (int i = 0; i < qn; ++i) R[i] = new Result[MAXK];
-		if (read_ground_truth(qn, truth_set, R) == 1) return 1;
+		for (int i = 0; i < qn; ++i) R[i] = new Result[max_k];
+		if (read_ground_truth(qn, max_k, truth_set, R) == 1) return 1;
+	}
+
+	if ((alg == 2 || alg == 4 || alg == 6 || alg == 8) && sel < 1.0f) {
+		if (n <= 0 || B <= 0) { printf("-sel needs -n and -B\n"); return 1; }
+
+		allow = new uint64_t[allow_words(n)];
+		gen_allow_list(n, sel, allow);
+		filter_truth(n, qn, d, B, max_k, (const float **) query, data_folder, 
+			allow, R);
 	}
 
 	// -------------------------------------------------------------------------
 	//  methods
 	// -------------------------------------------------------------------------
+	int ret = 0;					// status of the method
 	switch (alg) {
 	case 0:
-		ground_truth(n, qn, d, (const float **) data, (const float **) query, 
-			truth_set);
+		ret = ground_truth(n, qn, d, max_k, (const float **) data, 
+			(const float **) query, truth_set);
 		break;
 	case 1:
-		indexing_of_rqalsh_star(n, d, B, L, M, beta, delta, ratio,
-			(const float **) data, output_folder);
+		ret = indexing_of_rqalsh_star(n, d, B, L, M, beta, delta, ratio, 
+			family, threads, in_mem, packed, (const float **) data, output_folder);
 		break;
 	case 2:
-		kfn_of_rqalsh_star(qn, d, (const float **) query, (const Result **) R, 
-			data_folder, output_folder);
+		ret = kfn_of_rqalsh_star(qn, d, max_k, threads, qthreads, sched, 
+			max_cand, max_io, deadline, stats, allow, (const float **) query, 
+			(const Result **) R, data_folder, output_folder);
 		break;
 	case 3:
-		indexing_of_rqalsh(n, d, B, beta, delta, ratio, (const float **) data, 
-			output_folder);
+		ret = indexing_of_rqalsh(n, d, B, beta, delta, ratio, family, 
+			(const float **) data, output_folder);
 		break;
 	case 4:
-		kfn_of_rqalsh(qn, d, (const float **) query, (const Result **) R, 
-			data_folder, output_folder);
+		ret = kfn_of_rqalsh(qn, d, max_k, threads, qthreads, batch, ratio, 
+			sched, max_cand, max_io, deadline, defer, rsched, step, stats, allow, 
+			(const float **) query, (const Result **) R, data_folder, 
+			output_folder);
 		break;
 	case 5:
-		indexing_of_drusilla_select(n, d, B, L, M, (const float **) data, 
-			output_folder);
+		ret = indexing_of_drusilla_select(n, d, B, L, M, threads, packed, 
+			(const float **) data, output_folder);
 		break;
 	case 6:
-		kfn_of_drusilla_select(qn, d, (const float **) query, (const Result **) R, 
-			data_folder, output_folder);
+		ret = kfn_of_drusilla_select(qn, d, max_k, threads, batch, stats, 
+			allow, (const float **) query, (const Result **) R, data_folder, 
+			output_folder);
 		break;
 	case 7:
-		indexing_of_qdafn(n, d, B, L, M, ratio, (const float **) data, 
-			output_folder);
+		ret = indexing_of_qdafn(n, d, B, L, M, ratio, family, 
+			(const float **) data, output_folder);
 		break;
 	case 8:
-		kfn_of_qdafn(qn, d, (const float **) query, (const Result **) R, 
-			data_folder, output_folder);
+		ret = kfn_of_qdafn(qn, d, max_k, threads, stats, allow, 
+			(const float **) query, (const Result **) R, data_folder, 
+			output_folder);
 		break;
 	case 9:
-		linear_scan(n, qn, d, B, (const float **) query, (const Result **) R, 
+		ret = linear_scan(n, qn, d, B, max_k, (const float **) query, 
+			(const Result **) R, data_folder, output_folder);
+		break;
+	case 10:
+		ret = counting_benchmark(qn, output_folder);
+		break;
+	case 11:
+		ret = range_of_rqalsh(n, qn, d, B, range, (const float **) query, 
+			data_folder, output_folder);
+		break;
+	case 12:
+		ret = knn_of_rqalsh(n, qn, d, B, max_k, ratio, (const float **) query, 
 			data_folder, output_folder);
 		break;
 	default:
 		printf("Parameters Error!\n");
 		usage();
+		ret = 1;
 		break;
 	}
 
@@ -303,7 +552,8 @@ int main(int nargs, char** args)
 		for (int i = 0; i < n; ++i) { delete[] data[i]; data[i] = NULL; }
 		delete[] data; data  = NULL;
 	}
-	if (alg == 0 || alg == 2 || alg == 4 || alg == 6 || alg == 8 || alg == 9) {
+	if (alg == 0 || alg == 2 || alg == 4 || alg == 6 || alg == 8 || alg == 9 ||
+		alg == 11 || alg == 12) {
 		for (int i = 0; i < qn; ++i) { delete[] query[i]; query[i] = NULL; }
 		delete[] query; query = NULL;
 	}
@@ -311,6 +561,7 @@ int main(int nargs, char** args)
 		for (int i = 0; i < qn; ++i) { delete[] R[i]; R[i] = NULL; }
 		delete[] R; R = NULL;
 	}
+	if (allow != NULL) { delete[] allow; allow = NULL; }
 
-	return 0;
+	return ret;
 }
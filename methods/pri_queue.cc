@@ -44,12 +44,36 @@ int ResultCompDesc(					// compare function for qsort (descending)
 	return ret;
 }
 
+// -----------------------------------------------------------------------------
+static bool result_desc(			// strict order of ResultCompDesc
+	const Result &a,					// 1st item
+	const Result &b)					// 2nd item
+{
+	if (a.key_ != b.key_) return a.key_ > b.key_;
+	return a.id_ < b.id_;
+}
+
+// -----------------------------------------------------------------------------
+void top_m_desc(					// top-m items in descending order
+	int   n,							// number of items
+	int   m,							// number of top items
+	Result *items)						// items (return, top-m in front)
+{
+	if (m < n) {
+		std::nth_element(items, items + m, items + n, result_desc);
+		n = m;
+	}
+	std::sort(items, items + n, result_desc);
+}
+
 // -----------------------------------------------------------------------------
 MaxK_List::MaxK_List(				// constructor (given max size)
 	int max)							// max size
 {
 	num_ = 0;
 	k_ = max;
+	heap_ = max > HEAP_K;
+	sorted_ = true;
 	list_ = new Result[max + 1];
 }
 
@@ -66,6 +90,27 @@ float MaxK_List::insert(			// insert item
 	float key,							// key of item
 	int id)								// id of item
 {
+	if (heap_) {
+		if (num_ == k_) {
+			if (key <= list_[0].key_) return list_[0].key_;
+
+			list_[0].key_ = key;		// replace the k-th largest item
+			list_[0].id_  = id;
+			sift_down(0);
+		}
+		else {
+			int i = num_++;			// move up the new item
+			while (i > 0 && list_[(i-1)/2].key_ > key) {
+				list_[i] = list_[(i-1)/2];
+				i = (i - 1) / 2;
+			}
+			list_[i].key_ = key;
+			list_[i].id_  = id;
+		}
+		sorted_ = false;
+		return min_key();
+	}
+
 	int i = 0;
 	for (i = num_; i > 0; i--) {
 		if (list_[i-1].key_ < key) list_[i] = list_[i - 1];
@@ -77,3 +122,63 @@ float MaxK_List::insert(			// insert item
 
 	return min_key();
 }
+
+// -----------------------------------------------------------------------------
+void MaxK_List::sift_down(			// move down an item of the heap
+	int pos)							// position of item
+{
+	Result tmp = list_[pos];
+	while (true) {
+		int child = 2 * pos + 1;
+		if (child >= num_) break;
+		if (child + 1 < num_ && list_[child+1].key_ < list_[child].key_) {
+			++child;
+		}
+		if (list_[child].key_ >= tmp.key_) break;
+
+		list_[pos] = list_[child];
+		pos = child;
+	}
+	list_[pos] = tmp;
+}
+
+// -----------------------------------------------------------------------------
+void MaxK_List::sort_heap()			// sort the heap in ascending order
+{
+	qsort(list_, num_, sizeof(Result), ResultComp);
+	sorted_ = true;
+}
+
+// -----------------------------------------------------------------------------
+MinK_List::MinK_List(				// constructor (given max size)
+	int max)							// max size
+{
+	num_ = 0;
+	k_ = max;
+	list_ = new Result[max + 1];
+}
+
+// -----------------------------------------------------------------------------
+MinK_List::~MinK_List() 			// destructor
+{
+	if (list_ != NULL) {
+		delete[] list_; list_ = NULL;
+	}
+}
+
+// -----------------------------------------------------------------------------
+float MinK_List::insert(			// insert item
+	float key,							// key of item
+	int id)								// id of item
+{
+	int i = 0;
+	for (i = num_; i > 0; i--) {
+		if (list_[i-1].key_ > key) list_[i] = list_[i - 1];
+		else break;
+	}
+	list_[i].key_ = key;				// store new item here
+	list_[i].id_ = id;
+	if (num_ < k_) ++num_;			// increase the number of items
+
+	return max_key();
+}
@@ -16,6 +16,17 @@ struct Result {						// basic data structure
 	int   id_;
 };
 
+// -----------------------------------------------------------------------------
+struct Cmp {						// cmp func for priority
+	bool operator()(Result a, Result b) {
+		if (fabs(a.key_ - b.key_) < FLOATZERO) {
+			return (a.id_ > b.id_);
+		}
+		if (a.key_ > b.key_) return false;
+		else return true;
+	}
+};
+
 // -----------------------------------------------------------------------------
 int ResultComp(						// compare function for qsort (ascending)
 	const void *e1,						// 1st element
@@ -26,26 +37,102 @@ int ResultCompDesc(					// compare function for qsort (descending)
 	const void *e1,						// 1st element
 	const void *e2);					// 2nd element
 
+// -----------------------------------------------------------------------------
+//  top_m_desc: move the top-m items to the front in the order of qsort with 
+//  ResultCompDesc (ties by id), without sorting the others. the first m items
+//  are the same as those of qsort, since the order is total for unique ids.
+// -----------------------------------------------------------------------------
+void top_m_desc(					// top-m items in descending order
+	int   n,							// number of items
+	int   m,							// number of top items
+	Result *items);						// items (return, top-m in front)
+
 // -----------------------------------------------------------------------------
 //  MaxK_List: the structure is one which maintains the largest k values (of 
 //  type float) and associated object id (of type int).
+//
+//  For k <= HEAP_K, the list is sorted in descending order by insertion. For
+//  larger k, it is a binary min-heap whose root is the k-th largest key, so a
+//  key no larger than the root is rejected at once and the others cost 
+//  O(log k). The heap is sorted in ascending order (which is still a min-
+//  heap) when its i-th key is asked for.
 // -----------------------------------------------------------------------------
 class MaxK_List {
 public:
 	MaxK_List(int max);				// constructor (given max size)
 	~MaxK_List();					// destructor
 
+	// -------------------------------------------------------------------------
+	inline void reset() { num_ = 0; sorted_ = true; }
+
+	// -------------------------------------------------------------------------
+	inline float max_key()	{ return num_ > 0 ? item(0).key_ : MINREAL; }
+
+	// -------------------------------------------------------------------------
+	inline float min_key() { 
+		if (num_ < k_) return MINREAL;
+		return heap_ ? list_[0].key_ : list_[k_-1].key_;
+	}
+
+	// -------------------------------------------------------------------------
+	inline float ith_key(int i) { return i < num_ ? item(i).key_ : MINREAL; }
+
+	// -------------------------------------------------------------------------
+	inline int ith_id(int i) { return i < num_ ? item(i).id_ : MININT; }
+
+	// -------------------------------------------------------------------------
+	inline int size() { return num_; }
+
+	// -------------------------------------------------------------------------
+	inline bool isFull() { if (num_ >= k_) return true; else return false; }
+
+	// -------------------------------------------------------------------------
+	float insert(					// insert item
+		float key,						// key of item
+		int id);						// id of item
+
+private:
+	int  k_;						// max numner of keys
+	int  num_;						// number of key current active
+	bool heap_;						// binary min-heap (k > HEAP_K) or list
+	bool sorted_;					// the heap is sorted in ascending order
+	Result *list_;					// the list itself
+
+	// -------------------------------------------------------------------------
+	inline const Result &item(int i) { // i-th largest item
+		if (!heap_) return list_[i];
+		if (!sorted_) sort_heap();
+		return list_[num_ - 1 - i];
+	}
+
+	// -------------------------------------------------------------------------
+	void sift_down(					// move down an item of the heap
+		int pos);						// position of item
+
+	// -------------------------------------------------------------------------
+	void sort_heap();				// sort the heap in ascending order
+};
+
+// -----------------------------------------------------------------------------
+//  MinK_List: the structure is one which maintains the smallest k values (of 
+//  type float) and associated object id (of type int).
+// -----------------------------------------------------------------------------
+class MinK_List {
+public:
+	MinK_List(int max);				// constructor (given max size)
+	~MinK_List();					// destructor
+
 	// -------------------------------------------------------------------------
 	inline void reset() { num_ = 0; }
 
 	// -------------------------------------------------------------------------
-	inline float max_key()	{ return num_ > 0 ? list_[0].key_ : MINREAL; }
+	inline float min_key() { return num_ > 0 ? list_[0].key_ : MAXREAL; }
 
 	// -------------------------------------------------------------------------
-	inline float min_key() { return num_ == k_ ? list_[k_-1].key_ : MINREAL; }
+	inline float max_key() { return num_ == k_ ? list_[k_-1].key_ : MAXREAL; }
 
 	// -------------------------------------------------------------------------
-	inline float ith_key(int i) { return i < num_ ? list_[i].key_ : MINREAL; }
+	inline float ith_key(int i) { return i < num_ ? list_[i].key_ : MAXREAL; }
 
 	// -------------------------------------------------------------------------
 	inline int ith_id(int i) { return i < num_ ? list_[i].id_ : MININT; }
@@ -131,9 +131,12 @@ QDAFN::QDAFN()						// default constructor
 	B_       = -1;
 	l_       = -1;
 	m_       = -1;
-	page_io_ = -1;
-	dist_io_ = -1;
+	pdim_    = -1;
 	proj_    = NULL;
+	family_  = PROJ_GAUSSIAN;
+	hdim_    = -1;
+	nblk_    = 0;
+	sign_    = NULL;
 	table_   = NULL;
 	trees_   = NULL;
 }
@@ -141,9 +144,14 @@ QDAFN::QDAFN()						// default constructor
 // -----------------------------------------------------------------------------
 QDAFN::~QDAFN()						// destructor
 {
-	for (int i = 0; i < l_; ++i) { delete[] proj_[i]; proj_[i] = NULL; }
-	delete[] proj_; proj_ = NULL;
-	g_memory -= SIZEFLOAT * l_ * dim_;
+	if (proj_ != NULL) {
+		g_memory -= SIZEFLOAT * l_ * pdim_;
+		delete_matrix(proj_); proj_ = NULL;
+	}
+	if (sign_ != NULL) {
+		g_memory -= SIZEFLOAT * nblk_ * HADAMARD_ROUNDS * hdim_;
+		delete[] sign_; sign_ = NULL;
+	}
 
 	if (trees_ != NULL) {
 		for (int i = 0; i < l_; ++i) {
@@ -168,6 +176,7 @@ int QDAFN::build(					// build index
 	int   l,							// number of projections
 	int   m,							// number of candidates
 	float ratio,						// approximation ratio
+	int   family,						// family of projections
 	const float **data,					// data objects
 	const char  *path)					// index path
 {
@@ -200,17 +209,27 @@ int QDAFN::build(					// build index
 	}
 
 	// -------------------------------------------------------------------------
-	//  generate random projection directions
+	//  generate random projection directions (the sparse and pca families of
+	//  RQALSH are not supported, so they fall back to the gaussian one)
 	// -------------------------------------------------------------------------
 	zigset(MAGIC + 17); 			// use fix seed 
 	// zigset(MAGIC + time(NULL));
 
-	g_memory += SIZEFLOAT * l_ * dim_;
-	proj_ = new float*[l_];
-	for (int i = 0; i < l_; ++i) {
-		proj_[i] = new float[dim_];
-		for (int j = 0; j < dim_; ++j) {
-			proj_[i][j] = RNOR / sqrt((float) dim_);
+	family_ = family == PROJ_HADAMARD ? PROJ_HADAMARD : PROJ_GAUSSIAN;
+	if (family_ == PROJ_HADAMARD) {
+		init_hadamard();
+		int size = nblk_ * HADAMARD_ROUNDS * hdim_;
+		for (int i = 0; i < size; ++i) sign_[i] = UNI < 0.5 ? -1.0f : 1.0f;
+	}
+	else {
+		pdim_ = pad_dim(dim_);
+		g_memory += SIZEFLOAT * l_ * pdim_;
+		proj_ = new_matrix(l_, dim_);
+		for (int i = 0; i < l_; ++i) {
+			float *proj = &proj_[(uint64_t) i * pdim_];
+			for (int j = 0; j < dim_; ++j) {
+				proj[j] = RNOR / sqrt((float) dim_);
+			}
 		}
 	}
 
@@ -233,7 +252,27 @@ int QDAFN::build(					// build index
 	fwrite(&B_,     SIZEINT, 1, fp);
 	fwrite(&l_,     SIZEINT, 1, fp);
 	fwrite(&m_,     SIZEINT, 1, fp);
-	for (int i = 0; i < l_; ++i) fwrite(proj_[i], SIZEFLOAT, dim_, fp);
+	fwrite(&family_, SIZEINT, 1, fp);
+	if (family_ == PROJ_HADAMARD) {
+		write_signs(nblk_ * HADAMARD_ROUNDS * hdim_, sign_, fp);
+	}
+	else {
+		write_matrix(l_, dim_, proj_, fp);
+	}
+
+	// -------------------------------------------------------------------------
+	//  the Hadamard projections of all objects are computed for a group of
+	//  projections that fits in BULK_BUFFER at once
+	// -------------------------------------------------------------------------
+	int   group = 0;					// max number of projections in a group
+	int   first = 0;					// first projection of current group
+	int   num   = 0;					// number of projections of the group
+	float *val  = NULL;					// n x num projections of the group
+	if (family_ == PROJ_HADAMARD) {
+		group = BULK_BUFFER / SIZEFLOAT / n_pts_;
+		group = std::max(1, std::min(l_, group));
+		val = new float[(uint64_t) n_pts_ * group];
+	}
 
 	// -------------------------------------------------------------------------
 	//  build index (QAB+tree or simply array)
@@ -242,9 +281,16 @@ int QDAFN::build(					// build index
 		Result *table = new Result[n_pts_];
 		trees_ = new B_Tree*[l_];
 		for (int i = 0; i < l_; ++i) {
+			if (val != NULL && i == first + num) {
+				first = i;
+				num   = std::min(group, l_ - i);
+				calc_hadamard_projs(n_pts_, dim_, hdim_, first, first + num, 
+					sign_, data, val);
+			}
 			for (int j = 0; j < n_pts_; ++j) {
 				table[j].id_  = j;
-				table[j].key_ = calc_proj(i, data[j]);
+				table[j].key_ = val != NULL ? val[(uint64_t) j*num + i-first] :
+					calc_proj(i, data[j]);
 			}
 			qsort(table, n_pts_, sizeof(Result), ResultComp);
 
@@ -260,21 +306,33 @@ int QDAFN::build(					// build index
 		delete[] table; table = NULL;
 	}
 	else {
+		Result *table = new Result[n_pts_];
+		g_memory += sizeof(Result) * l_ * m_;
 		table_ = new Result*[l_];
 		for (int i = 0; i < l_; ++i) {
-			table_[i] = new Result[n_pts_];
+			if (val != NULL && i == first + num) {
+				first = i;
+				num   = std::min(group, l_ - i);
+				calc_hadamard_projs(n_pts_, dim_, hdim_, first, first + num, 
+					sign_, data, val);
+			}
 			for (int j = 0; j < n_pts_; ++j) {
-				table_[i][j].id_  = j;
-				table_[i][j].key_ = calc_proj(i, data[j]);
+				table[j].id_  = j;
+				table[j].key_ = val != NULL ? val[(uint64_t) j*num + i-first] :
+					calc_proj(i, data[j]);
 			}
-			qsort(table_[i], n_pts_, sizeof(Result), ResultComp);
+			qsort(table, n_pts_, sizeof(Result), ResultComp);
 
 			// -----------------------------------------------------------------
-			//  store in the 'para' file
+			//  keep the top-m objects and store them in the 'para' file
 			// -----------------------------------------------------------------
+			table_[i] = new Result[m_];
+			memcpy(table_[i], table, sizeof(Result) * m_);
 			fwrite(table_[i], sizeof(Result), m_, fp);
 		}
+		delete[] table; table = NULL;
 	}
+	if (val != NULL) { delete[] val; val = NULL; }
 	fclose(fp);
 	
 	return 0;
@@ -283,9 +341,38 @@ int QDAFN::build(					// build index
 // -----------------------------------------------------------------------------
 float QDAFN::calc_proj(				// calc projection of input data object
 	int   id,							// projection vector id
-	const float *data)					// input data object
+	const float *data) const			// input data object
 {
-	return calc_inner_product(dim_, (const float*) proj_[id], data);
+	if (family_ == PROJ_HADAMARD) {
+		float val = 0.0f;
+		calc_hadamard_projs(1, dim_, hdim_, id, id + 1, sign_, &data, &val);
+		return val;
+	}
+	return calc_inner_product(dim_, &proj_[(uint64_t) id * pdim_], data);
+}
+
+// -----------------------------------------------------------------------------
+void QDAFN::init_hadamard()			// init sizes of Hadamard family
+{
+	hdim_ = hadamard_dim(dim_);
+	nblk_ = (l_ + hdim_ - 1) / hdim_;
+
+	int size = nblk_ * HADAMARD_ROUNDS * hdim_;
+	g_memory += SIZEFLOAT * size;
+	sign_ = new float[size];
+}
+
+// -----------------------------------------------------------------------------
+void QDAFN::calc_proj_values(		// calc projections of a batch of queries
+	int   qn,							// number of queries
+	const float **query,				// queries
+	float *proj_q) const				// qn x l projections (return)
+{
+	if (family_ == PROJ_HADAMARD) {
+		calc_hadamard_projs(qn, dim_, hdim_, 0, l_, sign_, query, proj_q);
+		return;
+	}
+	calc_inner_products(qn, l_, dim_, query, proj_, pdim_, proj_q);
 }
 
 // -----------------------------------------------------------------------------
@@ -306,6 +393,7 @@ void QDAFN::display()				// display parameters
 	printf("    l    = %d\n", l_);
 	printf("    m    = %d\n", m_);
 	printf("    algo = %s\n", algoname[2]);
+	printf("    proj = %s\n", proj_name[family_]);
 	printf("    path = %s\n", path_);
 	printf("\n");
 }
@@ -334,12 +422,27 @@ int QDAFN::load(					// load index
 	fread(&B_,     SIZEINT, 1, fp);
 	fread(&l_,     SIZEINT, 1, fp);
 	fread(&m_,     SIZEINT, 1, fp);
+	fread(&family_, SIZEINT, 1, fp);
+	if (family_ != PROJ_GAUSSIAN && family_ != PROJ_HADAMARD) {
+		printf("Unknown family %d in %s, please rebuild the index\n", 
+			family_, fname);
+		fclose(fp);
+		return 1;
+	}
 
-	g_memory += SIZEFLOAT * l_ * dim_;
-	proj_ = new float*[l_];
-	for (int i = 0; i < l_; ++i) {
-		proj_[i] = new float[dim_];
-		fread(proj_[i], SIZEFLOAT, dim_, fp);
+	// -------------------------------------------------------------------------
+	//  the family tag is followed by the sign diagonals (Hadamard) or by the
+	//  l x d matrix (Gaussian)
+	// -------------------------------------------------------------------------
+	if (family_ == PROJ_HADAMARD) {
+		init_hadamard();
+		read_signs(nblk_ * HADAMARD_ROUNDS * hdim_, sign_, fp);
+	}
+	else {
+		pdim_ = pad_dim(dim_);
+		g_memory += SIZEFLOAT * l_ * pdim_;
+		proj_ = new_matrix(l_, dim_);
+		read_matrix(l_, dim_, proj_, fp);
 	}
 
 	if (m_ > CANDIDATES) {
@@ -375,18 +478,53 @@ uint64_t QDAFN::search(				// c-k-AFN search
 	int   top_k,						// top-k value
 	const float *query,					// query object
 	const char *data_folder,			// new format data folder
-	MaxK_List *list)					// top-k results (return)
+	MaxK_List *list,					// top-k results (return)
+	const float *proj_q,				// projection of query (optional)
+	Query_Stats *stats,					// statistics of query (optional)
+	const uint64_t *allow) const		// allow-list (optional)
 {
-	if (m_ > CANDIDATES) return ext_search(top_k, query, data_folder, list);
-	else return int_search(top_k, query, data_folder, list);
+	timeval start_time;				// start time of this query
+	if (stats != NULL) {
+		reset_stats(stats);
+		gettimeofday(&start_time, NULL);
+	}
+
+	float *proj = new float[l_];
+	if (proj_q != NULL) {
+		memcpy(proj, proj_q, l_ * SIZEFLOAT);
+	}
+	else {
+		calc_proj_values(1, &query, proj);
+		if (stats != NULL) stats->hash_time_ = elapsed_ms(start_time);
+	}
+
+	uint64_t io = 0;
+	if (m_ > CANDIDATES) {
+		io = ext_search(top_k, query, proj, data_folder, list, stats, 
+			allow);
+	}
+	else {
+		io = int_search(top_k, query, proj, data_folder, list, stats, 
+			allow);
+	}
+	if (stats != NULL) {
+		stats->stop_       = STOP_CAND;
+		stats->count_time_ = elapsed_ms(start_time) - stats->hash_time_ - 
+			stats->verify_time_;
+	}
+	delete[] proj; proj = NULL;
+	return io;
 }
 
 // -----------------------------------------------------------------------------
 uint64_t QDAFN::int_search(			// internal search
 	int   top_k,						// top-k value
 	const float *query,					// query object
+	const float *proj_q,				// projection of query
 	const char *data_folder,			// new format data folder
-	MaxK_List *list)					// top-k results (return)
+	MaxK_List *list,					// top-k results (return)
+	Query_Stats *stats,					// statistics of query (return)
+	const uint64_t *allow) const		// allow-list (or NULL)
 {
 	// -------------------------------------------------------------------------
 	//  allocation and initialize <proj_q>
@@ -394,9 +532,6 @@ uint64_t QDAFN::int_search(			// internal search
 	std::vector<int>  next(l_, 0);
 	std::vector<bool> checked(n_pts_, false);
 
-	float *proj_q = new float[l_];
-	for (int i = 0; i < l_; ++i) proj_q[i] = calc_proj(i, query);;
-
 	float *data = new float[dim_];
 	for (int i = 0; i < dim_; ++i) data[i] = -1.0f;
 
@@ -414,8 +549,8 @@ uint64_t QDAFN::int_search(			// internal search
 		pri_queue.push(q_item);
 	}
 
-	dist_io_ = 0;
-	for (int i = 0; i < cand; ++i) {
+	uint64_t dist_io = 0;			// i/os for distance computation
+	for (int i = 0; i < cand; ) {
 		// ---------------------------------------------------------------------
 		//  get obj with largest proj dist and remove it from the queue
 		// ---------------------------------------------------------------------
@@ -428,14 +563,21 @@ uint64_t QDAFN::int_search(			// internal search
 		// ---------------------------------------------------------------------
 		int pid = q_item.id_;
 		int id  = table_[pid][next[pid]].id_;
-		if (!checked[id]) {
+		bool allowed = allow == NULL || is_allowed(allow, id);
+		if (allowed) ++i;			// the others take no budget
+		if (allowed && !checked[id]) {
+			timeval start_time;
+			if (stats != NULL) gettimeofday(&start_time, NULL);
+
 			checked[id] = true;
 			read_data_new_format(id, dim_, B_, data_folder, data);
 
 			float dist = calc_l2_dist(dim_, (const float *) data, query);
 			list->insert(dist, id + 1);
-			++dist_io_;
+			++dist_io;
+			if (stats != NULL) stats->verify_time_ += elapsed_ms(start_time);
 		}
+		if (stats != NULL) ++stats->collisions_;
 		// ---------------------------------------------------------------------
 		//  update priority queue
 		// ---------------------------------------------------------------------
@@ -449,18 +591,23 @@ uint64_t QDAFN::int_search(			// internal search
 	// -------------------------------------------------------------------------
 	while (!pri_queue.empty()) pri_queue.pop();
 
-	delete[] proj_q; proj_q = NULL;
-	delete[] data;   data   = NULL;
-
-	return dist_io_;
+	delete[] data; data = NULL;
+	if (stats != NULL) {
+		stats->data_io_ = dist_io;
+		stats->cand_    = dist_io;
+	}
+	return dist_io;
 }
 
 // -----------------------------------------------------------------------------
 uint64_t QDAFN::ext_search(			// external search
 	int   top_k,						// top-k value
 	const float *query,					// query object
+	const float *proj_q,				// projection of query
 	const char *data_folder,			// new format data folder
-	MaxK_List *list)					// top-k results (return)
+	MaxK_List *list,					// top-k results (return)
+	Query_Stats *stats,					// statistics of query (return)
+	const uint64_t *allow) const		// allow-list (or NULL)
 {
 	// -------------------------------------------------------------------------
 	//  allocation and initialization
@@ -470,7 +617,6 @@ uint64_t QDAFN::ext_search(			// external search
 	float *data = new float[dim_];
 	for (int i = 0; i < dim_; ++i) data[i] = 0.0f;
 
-	float *proj_q = new float[l_];
 	QDAFN_Page *page = new QDAFN_Page[l_];
 	for (int i = 0; i < l_; ++i) {
 		page[i].node_ = NULL;
@@ -478,11 +624,11 @@ uint64_t QDAFN::ext_search(			// external search
 	}
 
 	// -------------------------------------------------------------------------
-	//  compute hash value <proj_q> of query and init page buffers <page> 
+	//  init page buffers <page> by the projection <proj_q> of query
 	// -------------------------------------------------------------------------
-	page_io_ = 0;					// page i/os for search
-	dist_io_ = 0;					// i/os for distance computation
-	init_buffer(query, page, proj_q);
+	uint64_t page_io = 0;			// page i/os for search
+	uint64_t dist_io = 0;			// i/os for distance computation
+	init_buffer(page, page_io);
 
 	// -------------------------------------------------------------------------
 	//  c-k-AFN search
@@ -500,7 +646,7 @@ uint64_t QDAFN::ext_search(			// external search
 		}
 	}
 
-	for (int i = 0; i < cand; ++i) {
+	for (int i = 0; i < cand; ) {
 		// ---------------------------------------------------------------------
 		//  get obj with largest proj dist and remove it from the queue
 		// ---------------------------------------------------------------------
@@ -513,19 +659,26 @@ uint64_t QDAFN::ext_search(			// external search
 		// ---------------------------------------------------------------------
 		int j = q_item.id_;
 		int id = page[j].node_->get_son(page[j].pos_);
-		if (!checked[id]) {
+		bool allowed = allow == NULL || is_allowed(allow, id);
+		if (allowed) ++i;			// the others take no budget
+		if (allowed && !checked[id]) {
+			timeval start_time;
+			if (stats != NULL) gettimeofday(&start_time, NULL);
+
 			checked[id] = true;
 			read_data_new_format(id, dim_, B_, data_folder, data);
 
 			float dist = calc_l2_dist(dim_, (const float *) data, query);
 			list->insert(dist, id + 1);
-			++dist_io_;
+			++dist_io;
+			if (stats != NULL) stats->verify_time_ += elapsed_ms(start_time);
 		}
+		if (stats != NULL) ++stats->collisions_;
 
 		// ---------------------------------------------------------------------
 		//  update priority queue
 		// ---------------------------------------------------------------------
-		update_page(&page[j]);
+		update_page(&page[j], page_io);
 		if (page[j].node_) {
 			q_item.key_ = calc_dist(proj_q[j], &page[j]);
 			pri_queue.push(q_item);
@@ -536,8 +689,7 @@ uint64_t QDAFN::ext_search(			// external search
 	// -------------------------------------------------------------------------
 	while (!pri_queue.empty()) pri_queue.pop();
 
-	delete[] proj_q; proj_q = NULL;
-	delete[] data;   data   = NULL;
+	delete[] data; data = NULL;
 
 	for (int i = 0; i < l_; ++i) {
 		if (page[i].node_ != NULL) { 
@@ -545,26 +697,27 @@ uint64_t QDAFN::ext_search(			// external search
 		}
 	}
 	delete[] page; page = NULL;
-
-	return page_io_ + dist_io_;
+	if (stats != NULL) {
+		stats->index_io_ = page_io;
+		stats->data_io_  = dist_io;
+		stats->cand_     = dist_io;
+	}
+	return page_io + dist_io;
 }
 
 // -----------------------------------------------------------------------------
 void QDAFN::init_buffer(			// init page buffer
-	const float *query,					// query point
 	QDAFN_Page *page,					// buffer page (return)
-	float *proj_q)						// projection of query (return)
+	uint64_t &page_io) const			// page I/O for search (return)
 {
 	int block = -1;
 	B_Node *node = NULL;
 
 	for (int i = 0; i < l_; ++i) {
-		proj_q[i] = calc_proj(i, query);
-
 		block = trees_[i]->root_;
 		node = new B_Node();
 		node->init_restore(trees_[i], block);
-		++page_io_;
+		++page_io;
 
 		if (node->get_level() == 0) {
 			// -----------------------------------------------------------------
@@ -585,14 +738,14 @@ void QDAFN::init_buffer(			// init page buffer
 
 				node = new B_Node();
 				node->init_restore(trees_[i], block);
-				++page_io_;
+				++page_io;
 			}
 
 			block = node->get_son(0);
 			page[i].node_ = new B_Node();
 			page[i].node_->init_restore(trees_[i], block);
 			page[i].pos_ = 0;
-			++page_io_;
+			++page_io;
 
 			if (node != NULL) {
 				delete node; node = NULL;
@@ -603,7 +756,8 @@ void QDAFN::init_buffer(			// init page buffer
 
 // -----------------------------------------------------------------------------
 void QDAFN::update_page(			// update right node info
-	QDAFN_Page *page)					// page buffer
+	QDAFN_Page *page,					// page buffer (return)
+	uint64_t &page_io) const			// page I/O for search (return)
 {
 	B_Node *node = NULL;
 	B_Node *old_node = NULL;
@@ -616,7 +770,7 @@ void QDAFN::update_page(			// update right node info
 		if (node != NULL) {
 			page->node_ = node;
 			page->pos_ = 0;
-			++page_io_;
+			++page_io;
 		}
 		else {
 			page->node_ = NULL;
@@ -629,7 +783,7 @@ void QDAFN::update_page(			// update right node info
 // -----------------------------------------------------------------------------
 inline float QDAFN::calc_dist(		// calc proj_dist
 	float proj_q,						// projection of query
-	const QDAFN_Page *page)				// page buffer
+	const QDAFN_Page *page) const		// page buffer
 {
 	float key = page->node_->get_key(page->pos_);
 	return fabs(key - proj_q);
@@ -20,17 +20,6 @@ class  B_Node;
 class  B_Tree;
 class  MaxK_List;
 
-// -----------------------------------------------------------------------------
-struct Cmp {						// cmp func for priority
-	bool operator()(Result a, Result b) {
-		if (fabs(a.key_ - b.key_) < FLOATZERO) {
-			return (a.id_ > b.id_);
-		}
-		if (a.key_ > b.key_) return false;
-		else return true;
-	}
-};
-
 // -----------------------------------------------------------------------------
 //  Ziggurat Method standard normal pseudorandom number generator code from 
 //  George Marsaglia and Wai Wan Tsang (2000).
@@ -91,6 +80,7 @@ public:
 		int   l,						// number of projections
 		int   m,						// number of candidates
 		float ratio,					// approximation ratio
+		int   family,					// family of projections
 		const float **data,				// data objects
 		const char  *path);				// index path
 
@@ -106,7 +96,19 @@ public:
 		int   top_k,					// top-k value
 		const float *query,				// query object
 		const char *data_folder,		// new format data folder
-		MaxK_List *list);				// top-k results (return)
+		MaxK_List *list,				// top-k results (return)
+		const float *proj_q = NULL,		// projection of query (optional)
+		Query_Stats *stats = NULL,		// statistics of query (optional)
+		const uint64_t *allow = NULL) const; // allow-list (optional)
+
+	// -------------------------------------------------------------------------
+	inline int get_num_projections() { return l_; }
+
+	// -------------------------------------------------------------------------
+	void calc_proj_values(			// calc projections of a batch of queries
+		int   qn,						// number of queries
+		const float **query,			// queries
+		float *proj_q) const;			// qn x l projections (return)
 
 protected:
 	int    n_pts_;					// number of data objects <n>
@@ -116,16 +118,23 @@ protected:
 	int    m_;						// number of candidates <m>
 	char   path_[200];				// path to store index
 
-	float  **proj_;					// random projection vectors
+	int    pdim_;					// row stride of <proj_> (padded <dim_>)
+	float  *proj_;					// l x pdim projection vectors (aligned)
+	int    family_;					// family of projections
+	int    hdim_;					// size of Hadamard transform (power of 2)
+	int    nblk_;					// number of Hadamard blocks
+	float  *sign_;					// nblk x HADAMARD_ROUNDS x hdim signs
 	Result **table_;				// projected distance arrays
 	B_Tree **trees_;				// B+ trees
-	uint64_t page_io_;				// page I/O for search
-	uint64_t dist_io_;				// random I/O to compute Euclidean dist
 
 	// -------------------------------------------------------------------------
 	float calc_proj(				// calc projection of input data object
 		int   id,						// projection vector id
-		const float *data);				// input data object 
+		const float *data) const;		// input data object 
+
+	// -------------------------------------------------------------------------
+	void init_hadamard();			// init sizes of Hadamard family
+
 
 	// -------------------------------------------------------------------------
 	void get_tree_filename(			// get file name of tree
@@ -136,30 +145,36 @@ protected:
 	uint64_t int_search(			// internal search
 		int   top_k,					// top-k value
 		const float *query,				// query object
+		const float *proj_q,			// projection of query
 		const char  *data_folder,		// new format data folder
-		MaxK_List   *list);				// top-k results (return)
+		MaxK_List   *list,				// top-k results (return)
+		Query_Stats *stats,				// statistics of query (return)
+		const uint64_t *allow) const;	// allow-list (or NULL)
 
 	// -------------------------------------------------------------------------
 	uint64_t ext_search(			// external search
 		int   top_k,					// top-k value
 		const float *query,				// query object
+		const float *proj_q,			// projection of query
 		const char  *data_folder,		// new format data folder
-		MaxK_List   *list);				// top-k results (return)
+		MaxK_List   *list,				// top-k results (return)
+		Query_Stats *stats,				// statistics of query (return)
+		const uint64_t *allow) const;	// allow-list (or NULL)
 
 	// -------------------------------------------------------------------------
 	void init_buffer(				// init page buffer
-		const float *query,				// query point
 		QDAFN_Page *page,				// buffer page (return)
-		float *proj_q);					// projection of query (return)
+		uint64_t &page_io) const;		// page I/O for search (return)
 
 	// -------------------------------------------------------------------------
 	void update_page(				// update page
-		QDAFN_Page *page);				// page buffer (return)
+		QDAFN_Page *page,				// page buffer (return)
+		uint64_t &page_io) const;		// page I/O for search (return)
 
 	// -------------------------------------------------------------------------
 	float calc_dist(				// calc projected distance
 		float proj_q,					// projection of query
-		const QDAFN_Page *page);		// page buffer
+		const QDAFN_Page *page) const;	// page buffer
 };
 
 #endif // __QDAFN_H
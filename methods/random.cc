@@ -65,6 +65,22 @@ float new_gaussian_prob(			// calc new gaussian probability
 	return new_gaussian_cdf(x, 0.001F);
 }
 
+// -----------------------------------------------------------------------------
+//  a sparse projection is close to gaussian but with heavier tails. for a 
+//  symmetric distribution with excess kurtosis <kurt>, the Edgeworth expansion
+//  gives F(x) = Phi(x) - phi(x) * kurt / 24 * (x^3 - 3x), so the probability 
+//  in [-x, x] is corrected by 2 * phi(x) * kurt / 24 * (x^3 - 3x).
+// -----------------------------------------------------------------------------
+float new_sparse_prob(				// calc new probability of sparse projection
+	float x,							// x = w / (2 * r)
+	float kurt)							// excess kurtosis of projection
+{
+	float ret = new_gaussian_cdf(x, 0.001F);
+	ret -= 2.0F * gaussian_pdf(x) * kurt / 24.0F * (x * x * x - 3.0F * x);
+
+	return std::max(0.0F, std::min(1.0F, ret));
+}
+
 // -----------------------------------------------------------------------------
 //  probability vs. w for a fixed ratio c
 // -----------------------------------------------------------------------------
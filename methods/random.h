@@ -58,6 +58,11 @@ float orig_gaussian_prob(			// calc original gaussian probability
 float new_gaussian_prob(			// calc new gaussian probability
 	float x);							// x = w / (2 * r)
 
+// -----------------------------------------------------------------------------
+float new_sparse_prob(				// calc new probability of sparse projection
+	float x,							// x = w / (2 * r)
+	float kurt);						// excess kurtosis of projection
+
 // -----------------------------------------------------------------------------
 //  probability vs. w for a fixed ratio c
 // -----------------------------------------------------------------------------
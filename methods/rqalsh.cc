@@ -1,5 +1,180 @@
 #include "rqalsh.h"
 
+// -----------------------------------------------------------------------------
+RQALSH_Context::RQALSH_Context(		// constructor
+	const RQALSH *lsh,					// index to be searched
+	int   threads)						// number of threads per query
+{
+	int dim  = lsh->get_dim();
+	m_       = lsh->get_num_tables();
+	threads_ = threads;
+	page_io_ = 0;
+	dist_io_ = 0;
+
+	max_cand_    = 0;
+	max_page_io_ = 0;
+	deadline_    = 0.0f;
+	stop_        = STOP_NONE;
+	sched_       = SCHED_ROUND_ROBIN;
+	defer_       = 0.0f;
+	rsched_      = RADIUS_RATIO;
+	step_        = 0.0f;
+	stats_       = NULL;
+	allow_       = NULL;
+
+	flag_    = new bool[m_];
+	q_val_   = new float[m_];
+	data_    = new float[dim];
+	counter_ = new Collision_Counter(lsh->get_num_objects(), m_, 
+		lsh->get_threshold(), threads_ > 1 ? COUNTER_ATOMIC : COUNTER_AUTO);
+	nn_counter_ = NULL;
+
+	wdata_ = new float*[threads_];
+	wio_   = new uint64_t[threads_];
+	for (int i = 0; i < threads_; ++i) {
+		wdata_[i] = new float[dim];
+		wio_[i]   = 0;
+	}
+	queue_size_ = CANDIDATES + MAXK;
+	queue_ = new Result[queue_size_];
+
+	bound_      = NULL;
+	defer_list_ = NULL;
+	defer_size_ = 0;
+	num_defer_  = 0;
+
+	lptrs_ = new Page*[m_];
+	rptrs_ = new Page*[m_];
+	for (int i = 0; i < m_; ++i) {
+		lptrs_[i] = new Page();
+		rptrs_[i] = new Page();
+	}
+
+	// -------------------------------------------------------------------------
+	//  each thread keeps the packed data file open with the pages it read
+	// -------------------------------------------------------------------------
+	pack_ = NULL;
+	const char *packed = lsh->get_packed();
+	if (packed != NULL) {
+		pack_ = new Packed_File[threads_];
+		for (int i = 0; i < threads_; ++i) {
+			if (open_packed_file(lsh->get_page_size(), packed, &pack_[i])) {
+				for (int j = 0; j <= i; ++j) close_packed_file(&pack_[j]);
+				delete[] pack_; pack_ = NULL;
+				break;
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+RQALSH_Context::~RQALSH_Context()	// destructor
+{
+	for (int i = 0; i < m_; ++i) {
+		delete lptrs_[i]; lptrs_[i] = NULL;
+		delete rptrs_[i]; rptrs_[i] = NULL;
+	}
+	delete[] lptrs_; lptrs_ = NULL;
+	delete[] rptrs_; rptrs_ = NULL;
+
+	delete counter_; counter_ = NULL;
+	if (nn_counter_ != NULL) { delete nn_counter_; nn_counter_ = NULL; }
+	delete[] flag_;  flag_    = NULL;
+	delete[] q_val_; q_val_   = NULL;
+	delete[] data_;  data_    = NULL;
+
+	for (int i = 0; i < threads_; ++i) {
+		delete[] wdata_[i]; wdata_[i] = NULL;
+	}
+	delete[] wdata_; wdata_ = NULL;
+	delete[] wio_;   wio_   = NULL;
+	delete[] queue_; queue_ = NULL;
+
+	if (bound_ != NULL) { delete[] bound_; bound_ = NULL; }
+	if (defer_list_ != NULL) { delete[] defer_list_; defer_list_ = NULL; }
+	if (pack_ != NULL) {
+		for (int i = 0; i < threads_; ++i) close_packed_file(&pack_[i]);
+		delete[] pack_; pack_ = NULL;
+	}
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH_Context::reset_pack()	// forget the pages read of packed file
+{
+	if (pack_ == NULL) return;
+	for (int i = 0; i < threads_; ++i) reset_packed_file(&pack_[i]);
+}
+
+// -----------------------------------------------------------------------------
+uint64_t RQALSH_Context::get_pack_io() const // pages read from packed file
+{
+	uint64_t io = 0;
+	if (pack_ != NULL) {
+		for (int i = 0; i < threads_; ++i) io += pack_[i].io_;
+	}
+	return io;
+}
+
+// -----------------------------------------------------------------------------
+RQALSH_Session::RQALSH_Session(		// constructor
+	const RQALSH *lsh,					// index to be searched
+	int   top_k,						// top-k value
+	const float *query,					// query object
+	const int   *index,					// mapping index for data objects
+	const char  *data_folder,			// data folder
+	MaxK_List   *list,					// k-FN results (return)
+	const float *q_val,					// hash values of query (optional)
+	RQALSH_Context *ctx)				// search context (optional)
+{
+	gettimeofday(&start_, NULL);
+
+	lsh_         = lsh;
+	top_k_       = top_k;
+	query_       = query;
+	index_       = index;
+	data_folder_ = data_folder;
+	list_        = list;
+	own_         = NULL;
+	if (ctx == NULL) ctx = own_ = new RQALSH_Context(lsh);
+	ctx_         = ctx;
+	rounds_      = 0;
+	done_        = false;
+
+	lsh_->kfn_start(q_val, this);
+}
+
+// -----------------------------------------------------------------------------
+RQALSH_Session::~RQALSH_Session()	// destructor
+{
+	finish();
+	if (own_ != NULL) { delete own_; own_ = NULL; }
+}
+
+// -----------------------------------------------------------------------------
+bool RQALSH_Session::next()			// run one round, false if search ends
+{
+	if (done_) return false;
+
+	++rounds_;
+	if (!lsh_->kfn_round(this)) finish();
+	return !done_;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t RQALSH_Session::get_io() const // page i/o of index and data so far
+{
+	return ctx_->page_io_ + lsh_->calc_data_io(ctx_);
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH_Session::finish()		// release leaf nodes and fill statistics
+{
+	if (done_) return;
+
+	lsh_->kfn_finish(this);
+	done_ = true;
+}
+
 // -----------------------------------------------------------------------------
 RQALSH::RQALSH()					// constructor
 {
@@ -12,24 +187,57 @@ RQALSH::RQALSH()					// constructor
 	w_     = -1.0f;
 	m_     = -1;
 	l_     = -1;
+	nn_w_  = -1.0f;
+	nn_l_  = -1;
+	pdim_  = -1;
 	a_     = NULL;
-	trees_ = NULL;
 
-	dist_io_ = -1;
-	page_io_ = -1;
+	family_   = PROJ_GAUSSIAN;
+	kurt_     = 0.0f;
+	scale_    = 1.0f;
+	sp_start_ = NULL;
+	sp_mid_   = NULL;
+	sp_idx_   = NULL;
+	hdim_     = -1;
+	nblk_     = 0;
+	sign_     = NULL;
+	inv_norm_ = NULL;
+	trees_ = NULL;
+	base_  = NULL;
+	resident_ = NULL;
+	packed_[0] = '\0';
 }
 
 // -----------------------------------------------------------------------------
 RQALSH::~RQALSH()					// destructor
 {
-	for (int i = 0; i < m_; ++i) {
-		delete[] a_[i]; a_[i] = NULL;
-		delete trees_[i]; trees_[i] = NULL;
+	if (base_ != NULL) return;		// the members are owned by <base_>
+
+	if (trees_ != NULL) {			// NULL if build stopped early
+		for (int i = 0; i < m_; ++i) {
+			delete trees_[i]; trees_[i] = NULL;
+		}
+		delete[] trees_; trees_ = NULL;
 	}
-	delete[] a_; a_ = NULL;
-	delete[] trees_; trees_ = NULL;
 
-	g_memory -= SIZEFLOAT * m_ * dim_;
+	if (a_ != NULL) {
+		g_memory -= SIZEFLOAT * m_ * pdim_;
+		delete_matrix(a_); a_ = NULL;
+	}
+	if (sign_ != NULL) {
+		g_memory -= SIZEFLOAT * nblk_ * HADAMARD_ROUNDS * hdim_;
+		delete[] sign_; sign_ = NULL;
+	}
+	if (inv_norm_ != NULL) {
+		g_memory -= SIZEFLOAT * m_;
+		delete[] inv_norm_; inv_norm_ = NULL;
+	}
+	if (sp_start_ != NULL) {
+		g_memory -= SIZEINT * (2 * m_ + 1 + sp_start_[m_]);
+		delete[] sp_start_; sp_start_ = NULL;
+		delete[] sp_mid_;   sp_mid_   = NULL;
+		delete[] sp_idx_;   sp_idx_   = NULL;
+	}
 }
 
 // -----------------------------------------------------------------------------
@@ -40,6 +248,7 @@ int RQALSH::build(					// build index
 	int   beta,							// false positive percentage
 	float delta,						// error probability
 	float ratio,						// approximation ratio
+	int   family,						// family of hash functions
 	const float **data,					// data objects
 	const char *path)					// index path
 {
@@ -55,33 +264,61 @@ int RQALSH::build(					// build index
 	strcpy(path_, path); create_dir(path_);
 
 	// -------------------------------------------------------------------------
-	//  init <w_> <m_> and <l_> (auto tuning-w)
+	//  very sparse projections (Li et al., KDD 2006) keep 1 / s of entries 
+	//  with s = sqrt(d), and their tails are corrected by the kurtosis
 	// -------------------------------------------------------------------------
-	w_ = sqrt((8.0f * log(ratio_)) / (ratio_ * ratio_ - 1.0f));
-	
-	float p1 = calc_l2_prob(w_ / 2.0f);
-	float p2 = calc_l2_prob(w_ * ratio_ / 2.0f);
+	family_ = family;
+	float s = std::max(1.0f, (float) sqrt((float) dim_));
+	if (family_ == PROJ_SPARSE) {
+		scale_ = sqrt(s);
+		kurt_  = calc_kurtosis(s, data);
+	}
 
-	float para1 = sqrt(log(2.0f / beta_));
-	float para2 = sqrt(log(1.0f / delta_));
-	float para3 = 2.0f * (p1 - p2) * (p1 - p2);
-	float eta   = para1 / para2;
-	float alpha = (eta * p1 + p2) / (1.0f + eta);
+	// -------------------------------------------------------------------------
+	//  init <w_> <m_> and <l_> (auto tuning-w)
+	// -------------------------------------------------------------------------
+	calc_params(ratio_, w_, m_, l_);
 
-	m_ = (int) ceil((para1 + para2) * (para1 + para2) / para3);
-	l_ = (int) ceil(alpha * m_);
+	float *pc = NULL;				// hash functions of pca family
+	if (family_ == PROJ_PCA) {
+		pc = new float[(uint64_t) m_ * dim_];
+		init_pca(data, pc);
+	}
 
 	// -------------------------------------------------------------------------
-	//  generate hash functions
+	//  generate hash functions. the Hadamard family only keeps the random 
+	//  sign diagonals of ceil(m / hdim) blocks of transforms, and the sparse
+	//  family only keeps the index lists of its nonzeros.
 	// -------------------------------------------------------------------------
-	g_memory += SIZEFLOAT * m_ * dim_;
-	a_ = new float*[m_];
-	for (int i = 0; i < m_; ++i) {
-		a_[i] = new float[dim_];
-		for (int j = 0; j < dim_; ++j) {
-			a_[i][j] = gaussian(0.0f, 1.0f);
+	if (family_ == PROJ_HADAMARD) {
+		init_hadamard();
+		int size = nblk_ * HADAMARD_ROUNDS * hdim_;
+		for (int i = 0; i < size; ++i) {
+			sign_[i] = uniform(0.0f, 1.0f) < 0.5f ? -1.0f : 1.0f;
+		}
+	}
+	else if (family_ == PROJ_SPARSE) {
+		init_sparse(s);
+	}
+	else {
+		pdim_ = pad_dim(dim_);
+		g_memory += SIZEFLOAT * m_ * pdim_;
+		a_ = new_matrix(m_, dim_);
+		for (int i = 0; i < m_; ++i) {
+			float *a = &a_[(uint64_t) i * pdim_];
+			if (family_ == PROJ_PCA) {
+				memcpy(a, &pc[(uint64_t) i * dim_], dim_ * SIZEFLOAT);
+			}
+			else {
+				for (int j = 0; j < dim_; ++j) {
+					a[j] = gaussian(0.0f, 1.0f);
+				}
+			}
 		}
 	}
+	if (pc != NULL) { delete[] pc; pc = NULL; }
+	init_norms();
+	init_nn();
 
 	// -------------------------------------------------------------------------
 	//  write parameters to disk
@@ -96,13 +333,320 @@ int RQALSH::build(					// build index
 	return 0;
 }
 
+// -----------------------------------------------------------------------------
+void RQALSH::calc_params(			// calc <w> <m> and <l> of a ratio
+	float ratio,						// approximation ratio
+	float &w,							// bucket width (return)
+	int   &m,							// number of hashtables (return)
+	int   &l) const						// collision threshold (return)
+{
+	w = sqrt((8.0f * log(ratio)) / (ratio * ratio - 1.0f));
+	
+	float p1 = calc_l2_prob(w / 2.0f);
+	float p2 = calc_l2_prob(w * ratio / 2.0f);
+	calc_tables(p1, p2, m, l);
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH::calc_tables(			// calc <m> and <l> of <p1> and <p2>
+	float p1,							// collision prob of far objects
+	float p2,							// collision prob of close objects
+	int   &m,							// number of hashtables (return)
+	int   &l) const						// collision threshold (return)
+{
+	float para1 = sqrt(log(2.0f / beta_));
+	float para2 = sqrt(log(1.0f / delta_));
+	float para3 = 2.0f * (p1 - p2) * (p1 - p2);
+	float eta   = para1 / para2;
+	float alpha = (eta * p1 + p2) / (1.0f + eta);
+
+	m = (int) ceil((para1 + para2) * (para1 + para2) / para3);
+	l = (int) ceil(alpha * m);
+}
+
 // -----------------------------------------------------------------------------
 inline float RQALSH::calc_l2_prob(	// calc prob <p1_> and <p2_> of L2 dist
-	float x)							// x = w / (2.0 * r)
+	float x) const						// x = w / (2.0 * r)
 {
+	if (family_ == PROJ_SPARSE) return 1.0f - new_sparse_prob(x, kurt_);
 	return 1.0f - new_gaussian_prob(x);
 }
 
+// -----------------------------------------------------------------------------
+//  the projection of v by entries of excess kurtosis (s - 3) has the excess
+//  kurtosis (s - 3) * sum(v_j^4) / (sum(v_j^2))^2, which is averaged over the
+//  differences of random pairs of data objects
+// -----------------------------------------------------------------------------
+float RQALSH::calc_kurtosis(		// estimate excess kurtosis of projection
+	float s,							// sparsity (1 / s nonzeros)
+	const float **data)					// data objects
+{
+	double sum = 0.0;
+	int    num = 0;
+	for (int i = 0; i < KURT_SAMPLES; ++i) {
+		const float *x = data[rand() % n_pts_];
+		const float *y = data[rand() % n_pts_];
+
+		double v2 = 0.0, v4 = 0.0;
+		for (int j = 0; j < dim_; ++j) {
+			double v = x[j] - y[j];
+			v2 += v * v;
+			v4 += v * v * v * v;
+		}
+		if (v2 > 0.0) { sum += v4 / (v2 * v2); ++num; }
+	}
+	if (num == 0) return 0.0f;
+	return (float) ((s - 3.0) * sum / num);
+}
+
+// -----------------------------------------------------------------------------
+//  the parameters of QALSH for the m tables of the index: a close object 
+//  collides in a table if its projected distance is within <nn_w_> / 2 
+//  times the radius, with prob p1 for distance r and p2 for distance c * r
+// -----------------------------------------------------------------------------
+void RQALSH::init_nn()				// init <nn_w_> and <nn_l_>
+{
+	float c2 = ratio_ * ratio_;
+	nn_w_ = sqrt((8.0f * c2 * log(ratio_)) / (c2 - 1.0f));
+
+	float p1 = 1.0f - calc_l2_prob(nn_w_ / 2.0f);
+	float p2 = 1.0f - calc_l2_prob(nn_w_ / (2.0f * ratio_));
+
+	float para1 = sqrt(log(2.0f / beta_));
+	float para2 = sqrt(log(1.0f / delta_));
+	float eta   = para1 / para2;
+	float alpha = (eta * p1 + p2) / (1.0f + eta);
+
+	nn_l_ = (int) ceil(alpha * m_);
+}
+
+// -----------------------------------------------------------------------------
+//  the pca family puts the top principal directions of a sample ahead of 
+//  gaussian rows. a query of the sample should collide with its furthest 1 /
+//  PCA_FAR objects at their own distance, but not with the objects within 1
+//  / ratio of them at ratio times their distance. the scale of a direction 
+//  maximizes the gap of the two rates on the sample, and a direction is kept
+//  if the gap beats the gaussian rows.
+//
+//  the principal directions are fixed, so the collisions of a pair are not 
+//  independent across tables, and <m_> and <l_> are re-derived from counts:
+//  <m_> is the smallest prefix of rows with some <l_> which at most delta of
+//  far pairs miss and at most beta of close pairs reach. far objects lie 
+//  along directions of high variance, so fewer tables are needed, but the 
+//  guarantee of beta and delta only holds on the sample.
+// -----------------------------------------------------------------------------
+void RQALSH::init_pca(				// init hash functions of pca family
+	const float **data,					// data objects
+	float *a)							// m x d hash functions (return)
+{
+	int ns = std::min(n_pts_, PCA_SAMPLE);
+	int nq = std::min(ns, PCA_QUERIES);
+	int k  = std::min(dim_, PCA_DIRS);
+	int nf = std::max(1, ns / PCA_FAR);	// number of far objects of a query
+
+	const float **sample = new const float*[ns];
+	for (int i = 0; i < ns; ++i) {
+		sample[i] = ns < n_pts_ ? data[rand() % n_pts_] : data[i];
+	}
+	float *pc = new float[k * dim_];
+	for (int i = 0; i < k * dim_; ++i) pc[i] = gaussian(0.0f, 1.0f);
+	calc_pca(ns, dim_, k, PCA_ITERS, sample, pc);
+
+	// -------------------------------------------------------------------------
+	//  find the far and close pairs (id_ = q * ns + i, key_ = distance)
+	// -------------------------------------------------------------------------
+	Result *far_pair   = new Result[nq * ns];
+	Result *close_pair = new Result[nq * ns];
+	float  *dist = new float[ns];
+	float  *kth  = new float[ns];
+	int    num1  = 0;				// number of far pairs
+	int    num2  = 0;				// number of close pairs
+
+	for (int q = 0; q < nq; ++q) {
+		for (int i = 0; i < ns; ++i) {
+			dist[i] = calc_l2_dist(dim_, sample[q], sample[i]);
+		}
+		memcpy(kth, dist, ns * SIZEFLOAT);
+		std::nth_element(kth, kth + ns - nf, kth + ns);
+		float far = kth[ns - nf];
+		if (far <= 0.0f) continue;
+
+		for (int i = 0; i < ns; ++i) {
+			Result pair; pair.id_ = q * ns + i; pair.key_ = dist[i];
+			if (dist[i] >= far) far_pair[num1++] = pair;
+			else if (dist[i] > 0.0f && dist[i] <= far / ratio_) {
+				close_pair[num2++] = pair;
+			}
+		}
+	}
+
+	// -------------------------------------------------------------------------
+	//  a direction u scaled by s collides for |<u, o - q>| / ||o - q|| >= 
+	//  w / (2s) (far) or w * ratio / (2s) (close). the rates of the far pairs
+	//  are the candidates of w / (2s).
+	// -------------------------------------------------------------------------
+	float gap  = calc_l2_prob(w_ / 2.0f) - calc_l2_prob(w_ * ratio_ / 2.0f);
+	float *proj = new float[ns];
+	float *z1 = new float[std::max(1, num1)];
+	float *z2 = new float[std::max(1, num2)];
+	int   npc = 0;
+
+	for (int t = 0; t < k && num1 > 0 && num2 > 0 && npc < m_; ++t) {
+		const float *u = &pc[t * dim_];
+		for (int i = 0; i < ns; ++i) {
+			proj[i] = calc_inner_product(dim_, u, sample[i]);
+		}
+		for (int j = 0; j < num1; ++j) {
+			int q = far_pair[j].id_ / ns, i = far_pair[j].id_ % ns;
+			z1[j] = fabs(proj[i] - proj[q]) / far_pair[j].key_;
+		}
+		for (int j = 0; j < num2; ++j) {
+			int q = close_pair[j].id_ / ns, i = close_pair[j].id_ % ns;
+			z2[j] = fabs(proj[i] - proj[q]) / close_pair[j].key_;
+		}
+		std::sort(z1, z1 + num1, std::greater<float>());
+		std::sort(z2, z2 + num2);
+
+		float best = gap, tau = -1.0f;
+		for (int j = 0; j < num1; ++j) {
+			if (z1[j] <= 0.0f) break;
+			if (j + 1 < num1 && z1[j + 1] == z1[j]) continue;
+
+			float x1 = (float) (j + 1) / num1;
+			float x2 = (float) (z2 + num2 - std::lower_bound(z2, z2 + num2, 
+				ratio_ * z1[j])) / num2;
+			if (x1 - x2 > best) { best = x1 - x2; tau = z1[j]; }
+		}
+		if (tau <= 0.0f) continue;
+
+		float scale = w_ / (2.0f * tau);
+		float *v = &a[npc * dim_];
+		for (int j = 0; j < dim_; ++j) v[j] = scale * u[j];
+		++npc;
+	}
+	for (int i = npc * dim_; i < m_ * dim_; ++i) a[i] = gaussian(0.0f, 1.0f);
+
+	// -------------------------------------------------------------------------
+	//  re-derive <m_> and <l_> by the collision counts of prefixes of rows
+	// -------------------------------------------------------------------------
+	int *cnt1 = new int[std::max(1, num1)];
+	int *cnt2 = new int[std::max(1, num2)];
+	int *tmp  = new int[std::max(1, std::max(num1, num2))];
+	int miss  = std::min(num1 - 1, (int) floor(delta_ * num1));
+	int hit   = std::min(num2 - 1, (int) floor(beta_  * num2));
+	memset(cnt1, 0, num1 * SIZEINT);
+	memset(cnt2, 0, num2 * SIZEINT);
+
+	for (int m = 1; m <= m_ && num1 > 0 && num2 > 0; ++m) {
+		const float *v = &a[(m - 1) * dim_];
+		for (int i = 0; i < ns; ++i) {
+			proj[i] = calc_inner_product(dim_, v, sample[i]);
+		}
+		for (int j = 0; j < num1; ++j) {
+			int q = far_pair[j].id_ / ns, i = far_pair[j].id_ % ns;
+			if (fabs(proj[i] - proj[q]) >= w_ * far_pair[j].key_ / 2.0f) {
+				++cnt1[j];
+			}
+		}
+		for (int j = 0; j < num2; ++j) {
+			int q = close_pair[j].id_ / ns, i = close_pair[j].id_ % ns;
+			float width = w_ * ratio_ * close_pair[j].key_ / 2.0f;
+			if (fabs(proj[i] - proj[q]) >= width) ++cnt2[j];
+		}
+
+		// at most <miss> far pairs have less than <lmax> collisions
+		memcpy(tmp, cnt1, num1 * SIZEINT);
+		std::nth_element(tmp, tmp + miss, tmp + num1);
+		int lmax = tmp[miss];
+
+		// at most <hit> close pairs have <lmin> or more collisions
+		memcpy(tmp, cnt2, num2 * SIZEINT);
+		std::nth_element(tmp, tmp + num2 - 1 - hit, tmp + num2);
+		int lmin = tmp[num2 - 1 - hit] + 1;
+
+		// a candidate has more than <l_> collisions
+		if (lmin <= lmax) { m_ = m; l_ = (lmin + lmax + 1) / 2 - 1; break; }
+	}
+
+	delete[] sample;     sample     = NULL;
+	delete[] pc;         pc         = NULL;
+	delete[] far_pair;   far_pair   = NULL;
+	delete[] close_pair; close_pair = NULL;
+	delete[] dist;       dist       = NULL;
+	delete[] kth;        kth        = NULL;
+	delete[] proj;       proj       = NULL;
+	delete[] z1;         z1         = NULL;
+	delete[] z2;         z2         = NULL;
+	delete[] cnt1;       cnt1       = NULL;
+	delete[] cnt2;       cnt2       = NULL;
+	delete[] tmp;        tmp        = NULL;
+}
+
+// -----------------------------------------------------------------------------
+//  the nonzeros (+/- <scale_>) of each row are kept as two index lists, i.e., 
+//  the positives in [sp_start_[i], sp_mid_[i]) and the negatives in 
+//  [sp_mid_[i], sp_start_[i+1]), so that a hash value is sums and a multiply 
+//  by <scale_>. each entry is nonzero with probability 1 / s.
+// -----------------------------------------------------------------------------
+void RQALSH::init_sparse(			// generate index lists of sparse family
+	float s)							// sparsity (1 / s nonzeros)
+{
+	std::vector<int> idx, neg;
+	sp_start_ = new int[m_ + 1];
+	sp_mid_   = new int[m_];
+	for (int i = 0; i < m_; ++i) {
+		sp_start_[i] = (int) idx.size();
+		neg.clear();
+		for (int j = 0; j < dim_; ++j) {
+			float u = uniform(0.0f, s);
+			if (u < 0.5f) idx.push_back(j);
+			else if (u < 1.0f) neg.push_back(j);
+		}
+		sp_mid_[i] = (int) idx.size();
+		idx.insert(idx.end(), neg.begin(), neg.end());
+	}
+	int nnz = (int) idx.size();
+	sp_start_[m_] = nnz;
+	sp_idx_ = new int[nnz > 0 ? nnz : 1];
+	if (nnz > 0) memcpy(sp_idx_, &idx[0], nnz * SIZEINT);
+	g_memory += SIZEINT * (2 * m_ + 1 + nnz);
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH::init_hadamard()		// init sizes of Hadamard family
+{
+	hdim_ = hadamard_dim(dim_);
+	nblk_ = (m_ + hdim_ - 1) / hdim_;
+
+	int size = nblk_ * HADAMARD_ROUNDS * hdim_;
+	g_memory += SIZEFLOAT * size;
+	sign_ = new float[size];
+}
+
+// -----------------------------------------------------------------------------
+//  each row of the Hadamard family is sqrt(hdim) times a unit vector in the
+//  space of hdim dimensions, so 1 / sqrt(hdim) keeps the lower bounds valid
+// -----------------------------------------------------------------------------
+void RQALSH::init_norms()			// init norms of hash functions
+{
+	g_memory += SIZEFLOAT * m_;
+	inv_norm_ = new float[m_];
+	for (int i = 0; i < m_; ++i) {
+		float norm = 0.0f;
+		if (family_ == PROJ_HADAMARD) {
+			norm = sqrt((float) hdim_);
+		}
+		else if (family_ == PROJ_SPARSE) {
+			norm = scale_ * sqrt((float) (sp_start_[i+1] - sp_start_[i]));
+		}
+		else {
+			const float *a = &a_[(uint64_t) i * pdim_];
+			norm = sqrt(calc_inner_product(dim_, a, a));
+		}
+		inv_norm_[i] = norm > 0.0f ? 1.0f / norm : 0.0f;
+	}
+}
+
 // -----------------------------------------------------------------------------
 int RQALSH::write_params()			// write parameters to disk
 {
@@ -127,8 +671,21 @@ int RQALSH::write_params()			// write parameters to disk
 	fwrite(&w_,     SIZEFLOAT, 1, fp);
 	fwrite(&m_,     SIZEINT,   1, fp);
 	fwrite(&l_,     SIZEINT,   1, fp);
+	fwrite(&family_, SIZEINT,  1, fp);
 
-	for (int i = 0; i < m_; ++i) fwrite(a_[i], SIZEFLOAT, dim_, fp);
+	if (family_ == PROJ_HADAMARD) {
+		write_signs(nblk_ * HADAMARD_ROUNDS * hdim_, sign_, fp);
+	}
+	else if (family_ == PROJ_SPARSE) {
+		fwrite(&kurt_,    SIZEFLOAT, 1, fp);
+		fwrite(&scale_,   SIZEFLOAT, 1, fp);
+		fwrite(sp_start_, SIZEINT, m_ + 1, fp);
+		fwrite(sp_mid_,   SIZEINT, m_, fp);
+		fwrite(sp_idx_,   SIZEINT, sp_start_[m_], fp);
+	}
+	else {
+		write_matrix(m_, dim_, a_, fp);
+	}
 	fclose(fp);	
 
 	return 0;
@@ -143,11 +700,32 @@ int RQALSH::bulkload(				// build QAB+Trees by bulkloading
 	// -------------------------------------------------------------------------
 	Result *table = new Result[n_pts_];
 
+	// -------------------------------------------------------------------------
+	//  one Hadamard transform gives the hash values of many tables, so they
+	//  are computed for a group of tables that fits in BULK_BUFFER at once
+	// -------------------------------------------------------------------------
+	int   group = 0;					// max number of tables in a group
+	int   first = 0;					// first table of current group
+	int   num   = 0;					// number of tables of current group
+	float *val  = NULL;					// n x num hash values of the group
+	if (family_ == PROJ_HADAMARD) {
+		group = BULK_BUFFER / SIZEFLOAT / n_pts_;
+		group = std::max(1, std::min(m_, group));
+		val = new float[(uint64_t) n_pts_ * group];
+	}
+
 	trees_ = new QAB_Tree*[m_];
 	for (int i = 0; i < m_; ++i) {
+		if (val != NULL && i == first + num) {
+			first = i;
+			num   = std::min(group, m_ - i);
+			calc_hadamard_projs(n_pts_, dim_, hdim_, first, first + num, 
+				sign_, data, val);
+		}
 		for (int j = 0; j < n_pts_; ++j) {
 			table[j].id_  = j;
-			table[j].key_ = calc_hash_value(i, data[j]);
+			table[j].key_ = val != NULL ? val[(uint64_t) j*num + i-first] : 
+				calc_hash_value(i, data[j]);
 		}
 		qsort(table, n_pts_, sizeof(Result), ResultComp);
 
@@ -158,6 +736,7 @@ int RQALSH::bulkload(				// build QAB+Trees by bulkloading
 		if (trees_[i]->bulkload(n_pts_, (const Result *) table)) return 1;
 	}
 	delete[] table; table = NULL;
+	if (val != NULL) { delete[] val; val = NULL; }
 
 	return 0;
 }
@@ -165,9 +744,41 @@ int RQALSH::bulkload(				// build QAB+Trees by bulkloading
 // -----------------------------------------------------------------------------
 float RQALSH::calc_hash_value( 		// calc hash value
 	int   tid,							// hash table id
-	const float *data)					// one data object
+	const float *data) const			// one data object
 {
-	return calc_inner_product(dim_, a_[tid], data);
+	if (family_ == PROJ_HADAMARD) {
+		float val = 0.0f;
+		calc_hadamard_projs(1, dim_, hdim_, tid, tid + 1, sign_, &data, &val);
+		return val;
+	}
+	if (family_ == PROJ_SPARSE) {
+		float pos = 0.0f, neg = 0.0f;
+		int   mid = sp_mid_[tid];
+		for (int k = sp_start_[tid]; k < mid; ++k) pos += data[sp_idx_[k]];
+		for (int k = mid; k < sp_start_[tid+1]; ++k) neg += data[sp_idx_[k]];
+		return scale_ * (pos - neg);
+	}
+	return calc_inner_product(dim_, &a_[(uint64_t) tid * pdim_], data);
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH::calc_hash_values(		// calc hash values of a batch of queries
+	int   qn,							// number of queries
+	const float **query,				// queries
+	float *q_val) const					// qn x m hash values (return)
+{
+	if (family_ == PROJ_HADAMARD) {
+		calc_hadamard_projs(qn, dim_, hdim_, 0, m_, sign_, query, q_val);
+		return;
+	}
+	if (family_ == PROJ_SPARSE) {
+		for (int i = 0; i < qn; ++i) {
+			float *val = &q_val[(uint64_t) i * m_];
+			for (int j = 0; j < m_; ++j) val[j] = calc_hash_value(j, query[i]);
+		}
+		return;
+	}
+	calc_inner_products(qn, m_, dim_, query, a_, pdim_, q_val);
 }
 
 // -----------------------------------------------------------------------------
@@ -191,6 +802,10 @@ void RQALSH::display()				// display parameters
 	printf("    w     = %f\n",   w_);
 	printf("    m     = %d\n",   m_);
 	printf("    l     = %d\n",   l_);
+	printf("    proj  = %s\n",   proj_name[family_]);
+	if (family_ == PROJ_SPARSE && kurt_ != 0.0f) {
+		printf("    kurt  = %f\n",   kurt_);
+	}
 	printf("    path  = %s\n",   path_);
 	printf("\n");
 }
@@ -204,6 +819,8 @@ int RQALSH::load(					// load index
 	// -------------------------------------------------------------------------
 	strcpy(path_, path);
 	if (read_params()) return 1;
+	init_norms();
+	init_nn();
 
 	// -------------------------------------------------------------------------
 	//  load qab-tree for k-FN search
@@ -228,178 +845,1291 @@ int RQALSH::read_params()			// read parameters from disk
 	FILE *fp = fopen(fname, "rb");
 	if (!fp) { printf("Could not open %s\n", fname); return 1; }
 
-	fread(&n_pts_, SIZEINT,   1, fp);
-	fread(&dim_,   SIZEINT,   1, fp);
-	fread(&B_,     SIZEINT,   1, fp);
-	fread(&beta_,  SIZEFLOAT, 1, fp);
-	fread(&delta_, SIZEFLOAT, 1, fp);
-	fread(&ratio_, SIZEFLOAT, 1, fp);
-	fread(&w_,     SIZEFLOAT, 1, fp);
-	fread(&m_,     SIZEINT,   1, fp);
-	fread(&l_,     SIZEINT,   1, fp);
-	
-	g_memory += SIZEFLOAT * m_ * dim_;
-	a_ = new float*[m_];
-	for (int i = 0; i < m_; ++i) {
-		a_[i] = new float[dim_];
-		fread(a_[i], SIZEFLOAT, dim_, fp);
+	fread(&n_pts_, SIZEINT,   1, fp);
+	fread(&dim_,   SIZEINT,   1, fp);
+	fread(&B_,     SIZEINT,   1, fp);
+	fread(&beta_,  SIZEFLOAT, 1, fp);
+	fread(&delta_, SIZEFLOAT, 1, fp);
+	fread(&ratio_, SIZEFLOAT, 1, fp);
+	fread(&w_,     SIZEFLOAT, 1, fp);
+	fread(&m_,     SIZEINT,   1, fp);
+	fread(&l_,     SIZEINT,   1, fp);
+	fread(&family_, SIZEINT,  1, fp);
+	if (family_ < PROJ_GAUSSIAN || family_ > PROJ_PCA) {
+		printf("Unknown family %d in %s, please rebuild the index\n", 
+			family_, fname);
+		fclose(fp);
+		return 1;
+	}
+	
+	// -------------------------------------------------------------------------
+	//  the family tag is followed by the sign diagonals (Hadamard), by the 
+	//  kurtosis, scale and index lists (sparse), or by the m x d matrix
+	// -------------------------------------------------------------------------
+	if (family_ == PROJ_HADAMARD) {
+		init_hadamard();
+		read_signs(nblk_ * HADAMARD_ROUNDS * hdim_, sign_, fp);
+	}
+	else if (family_ == PROJ_SPARSE) {
+		fread(&kurt_,  SIZEFLOAT, 1, fp);
+		fread(&scale_, SIZEFLOAT, 1, fp);
+		sp_start_ = new int[m_ + 1];
+		sp_mid_   = new int[m_];
+		fread(sp_start_, SIZEINT, m_ + 1, fp);
+		fread(sp_mid_,   SIZEINT, m_, fp);
+
+		int nnz = sp_start_[m_];
+		sp_idx_ = new int[nnz > 0 ? nnz : 1];
+		fread(sp_idx_, SIZEINT, nnz, fp);
+		g_memory += SIZEINT * (2 * m_ + 1 + nnz);
+	}
+	else {
+		pdim_ = pad_dim(dim_);
+		g_memory += SIZEFLOAT * m_ * pdim_;
+		a_ = new_matrix(m_, dim_);
+		read_matrix(m_, dim_, a_, fp);
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+//  the sorted projections do not depend on ratio. a larger ratio needs fewer
+//  tables (m decreases with ratio), so the view uses a prefix of the tables.
+// -----------------------------------------------------------------------------
+int RQALSH::view(					// view index with another ratio
+	const RQALSH *base,					// loaded index
+	float ratio)						// approximation ratio
+{
+	*this = *base;
+	base_ = base;
+	if (family_ == PROJ_PCA) {
+		printf("The pca family fixes m and l at the ratio of its index\n");
+		return 1;
+	}
+	ratio_ = ratio;
+	calc_params(ratio_, w_, m_, l_);
+	init_nn();
+
+	if (ratio_ < base->ratio_ || m_ > base->m_) {
+		printf("Ratio %.2f needs %d tables, but the index has %d (c = %.2f)\n", 
+			ratio_, m_, base->m_, base->ratio_);
+		return 1;
+	}
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t RQALSH::kfn(				// c-k-AFN search
+	int   top_k,						// top-k value
+	const float *query,					// query object
+	const int *index,					// mapping index for data objects
+	const char *data_folder,			// data folder
+	MaxK_List *list,					// k-FN results (return)
+	const float *hash_val,				// hash values of query (optional)
+	RQALSH_Context *ctx) const			// search context (optional)
+{
+	RQALSH_Session session(this, top_k, query, index, data_folder, list, 
+		hash_val, ctx);
+	while (session.next()) {}
+
+	return session.get_io();
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH::kfn_start(				// start c-k-AFN search of a session
+	const float *hash_val,				// hash values of query (optional)
+	RQALSH_Session *s) const			// search session (return)
+{
+	RQALSH_Context *ctx = s->ctx_;
+	float *q_val = ctx->q_val_;
+	Page  **lptrs = ctx->lptrs_;
+	Page  **rptrs = ctx->rptrs_;
+	Query_Stats *stats = ctx->stats_;
+
+	if (stats != NULL) reset_stats(stats);
+	if (hash_val != NULL) {
+		memcpy(q_val, hash_val, m_ * SIZEFLOAT);
+	}
+	else {
+		calc_hash_values(1, &s->query_, q_val);
+		if (stats != NULL) stats->hash_time_ = elapsed_ms(s->start_);
+	}
+
+	// -------------------------------------------------------------------------
+	//  initialize parameters
+	// -------------------------------------------------------------------------
+	init_search_params(ctx);
+
+	int budget = ctx->max_cand_ > 0 ? ctx->max_cand_ : CANDIDATES;
+	s->candidates_ = budget + s->top_k_ - 1; // threshold of candidates
+	s->verify_     = s->candidates_;
+	s->kdist_  = MINREAL;
+	s->radius_ = find_radius(q_val, (const Page**) lptrs, (const Page**) rptrs);
+	s->width_  = s->radius_ * w_ / 2.0f;
+
+	Count_Round &round = s->round_;
+	round.lsh_         = this;
+	round.ctx_         = ctx;
+	round.query_       = s->query_;
+	round.index_       = s->index_;
+	round.data_folder_ = s->data_folder_;
+	round.candidates_  = s->candidates_;
+	round.start_       = s->start_;
+	round.num_cand_    = 0;
+	round.limit_       = STOP_NONE;
+
+	if (ctx->threads_ > 1 && s->candidates_ > ctx->queue_size_) {
+		delete[] ctx->queue_;
+		ctx->queue_size_ = s->candidates_;
+		ctx->queue_ = new Result[ctx->queue_size_];
+	}
+
+	// -------------------------------------------------------------------------
+	//  deferral admits <defer_> times more candidates than it verifies
+	// -------------------------------------------------------------------------
+	s->defer_ = ctx->defer_ >= 1.0f && ctx->threads_ <= 1;
+	if (s->defer_) {
+		s->candidates_ = (int) ceil(ctx->defer_ * budget) + s->top_k_ - 1;
+		if (ctx->bound_ == NULL) ctx->bound_ = new float[n_pts_];
+		memset(ctx->bound_, 0, n_pts_ * SIZEFLOAT);
+
+		if (s->candidates_ > ctx->defer_size_) {
+			delete[] ctx->defer_list_;
+			ctx->defer_size_ = s->candidates_;
+			ctx->defer_list_ = new Result[ctx->defer_size_];
+		}
+	}
+
+	// -------------------------------------------------------------------------
+	//  the priority scheduler keeps a max-heap of the projected distances of 
+	//  all (table, side) pairs, where <id_> = 2 * table + 1 for the left side
+	// -------------------------------------------------------------------------
+	s->priority_ = ctx->sched_ == SCHED_PRIORITY && ctx->threads_ <= 1;
+	if (s->priority_) {
+		Result item;
+		for (int i = 0; i < m_; ++i) {
+			if (lptrs[i]->size_ != -1) {
+				item.key_ = calc_dist(q_val[i], lptrs[i]);
+				item.id_  = 2 * i + 1;
+				s->heap_.push(item);
+			}
+			if (rptrs[i]->size_ != -1) {
+				item.key_ = calc_dist(q_val[i], rptrs[i]);
+				item.id_  = 2 * i;
+				s->heap_.push(item);
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+bool RQALSH::kfn_round(				// one round of c-k-AFN search
+	RQALSH_Session *s) const			// search session (return)
+{
+	RQALSH_Context *ctx = s->ctx_;
+	bool  *flag  = ctx->flag_;
+	float *q_val = ctx->q_val_;
+	Page  **lptrs = ctx->lptrs_;
+	Page  **rptrs = ctx->rptrs_;
+	Query_Stats *stats = ctx->stats_;
+	uint64_t &dist_io = ctx->dist_io_;
+	uint64_t &page_io = ctx->page_io_;
+
+	const float *query = s->query_;
+	const int   *index = s->index_;
+	const char  *data_folder = s->data_folder_;
+	MaxK_List   *list = s->list_;
+	const timeval &start_time = s->start_;
+
+	int   top_k      = s->top_k_;
+	int   candidates = s->candidates_;
+	int   limit      = STOP_NONE;	// limit of query reached in counting
+	float &kdist     = s->kdist_;	// k-th furthest neighbor distance
+	float &radius    = s->radius_;
+	float &width     = s->width_;	// bucket width
+	Count_Round &round = s->round_;
+	std::priority_queue<Result, std::vector<Result>, Cmp> &heap = s->heap_;
+
+	// -------------------------------------------------------------------------
+	//  step 1: initialize the stop condition for current round
+	// -------------------------------------------------------------------------
+	int num_flag = 0;
+	memset(flag, true, m_ * SIZEBOOL);
+	if (stats != NULL) add_radius(radius, stats);
+
+	// -------------------------------------------------------------------------
+	//  step 2 (multiple threads): split the hash tables across threads, and 
+	//  then insert the candidates in the order of verification queue
+	// -------------------------------------------------------------------------
+	if (ctx->threads_ > 1) {
+		round.width_ = width;
+		parallel_for(ctx->threads_, ctx->threads_, count_task, &round);
+
+		int num = std::min(round.num_cand_.load(), candidates);
+		for (; (int) dist_io < num; ++dist_io) {
+			Result *cand = &ctx->queue_[dist_io];
+			kdist = list->insert(cand->key_, cand->id_ + 1);
+		}
+		for (int i = 0; i < ctx->threads_; ++i) {
+			page_io += ctx->wio_[i]; ctx->wio_[i] = 0;
+		}
+		limit = round.limit_.load();
+		num_flag = m_;				// all tables are done in this round
+	}
+
+	// -------------------------------------------------------------------------
+	//  step 2 (priority): scan the most extreme chunk of all tables until it 
+	//  is within <width>. the chunks of a round are the same as those of 
+	//  round robin, but the most extreme ones are verified first.
+	// -------------------------------------------------------------------------
+	if (s->priority_) {
+		while (!heap.empty() && heap.top().key_ > width) {
+			Result item = heap.top();
+			heap.pop();
+
+			int  i    = item.id_ / 2;
+			bool left = item.id_ % 2 == 1;
+			Page *ptr = left ? lptrs[i] : rptrs[i];
+			bool more = s->defer_ ? defer_chunk(i, ptr, left, s) : 
+				count_chunk(ptr, left, candidates, query, index, data_folder, 
+				ctx, list, kdist);
+
+			if (left) update_left_buffer(rptrs[i], lptrs[i], page_io);
+			else update_right_buffer(lptrs[i], rptrs[i], page_io);
+			if (ptr->size_ != -1) {
+				item.key_ = calc_dist(q_val[i], ptr);
+				heap.push(item);
+			}
+			limit = check_limits(ctx, start_time, page_io);
+			if (!more || limit != STOP_NONE) break;
+		}
+		num_flag = m_;				// all tables are done in this round
+	}
+
+	// -------------------------------------------------------------------------
+	//  step 2: find frequent objects (dynamic separation counting)
+	// -------------------------------------------------------------------------
+	while (num_flag < m_) {
+		for (int i = 0; i < m_; ++i) {
+			if (!flag[i]) continue;
+
+			// -----------------------------------------------------------------
+			//  step 2.1: compute <ldist> and <rdist>
+			// -----------------------------------------------------------------
+			Page *lptr = lptrs[i];
+			Page *rptr = rptrs[i];
+
+			float ldist = -1.0f;
+			float rdist = -1.0f;
+			if (lptr->size_ != -1) ldist = calc_dist(q_val[i], lptr);
+			if (rptr->size_ != -1) rdist = calc_dist(q_val[i], rptr);
+
+			// -----------------------------------------------------------------
+			//  step 2.2: determine the closer direction (left or right) and 
+			//  do separation counting to find frequent objects.
+			//
+			//  For the frequent object, we calc the Lp distance with query, 
+			//  and update the c-k-AFN results.
+			// -----------------------------------------------------------------
+			if (ldist > width && ldist > rdist) {
+				if (s->defer_) defer_chunk(i, lptr, true, s);
+				else count_chunk(lptr, true, candidates, query, index, 
+					data_folder, ctx, list, kdist);
+				update_left_buffer(rptr, lptr, page_io);
+				limit = check_limits(ctx, start_time, page_io);
+			}
+			else if (rdist > width && ldist <= rdist) {
+				if (s->defer_) defer_chunk(i, rptr, false, s);
+				else count_chunk(rptr, false, candidates, query, index, 
+					data_folder, ctx, list, kdist);
+				update_right_buffer(lptr, rptr, page_io);
+				limit = check_limits(ctx, start_time, page_io);
+			}
+			else {
+				flag[i] = false;
+				++num_flag;
+			}
+			if (num_flag >= m_ || dist_io+ctx->num_defer_ >= candidates) break;
+			if (limit != STOP_NONE) break;
+		}
+		if (num_flag >= m_ || dist_io + ctx->num_defer_ >= candidates) break;
+		if (limit != STOP_NONE) break;
+	}
+	// -------------------------------------------------------------------------
+	//  step 3: stop conditions 1 & 2, and the limits of query
+	// -------------------------------------------------------------------------
+	if (dist_io + ctx->num_defer_ >= candidates) { 
+		ctx->stop_ = STOP_CAND; return false; 
+	}
+	if (limit != STOP_NONE) { ctx->stop_ = limit; return false; }
+	if (kdist > radius / ratio_ && dist_io >= top_k) {
+		ctx->stop_ = STOP_NORMAL; return false;
+	}
+	if (exhausted((const Page**) lptrs, (const Page**) rptrs)) {
+		ctx->stop_ = STOP_NORMAL; return false;
+	}
+
+	// -------------------------------------------------------------------------
+	//  step 4: auto-update <radius>
+	// -------------------------------------------------------------------------
+	radius = next_radius(radius, ctx);
+	width  = radius * w_ / 2.0f;
+
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+bool RQALSH::exhausted(				// all page buffers are at the ends
+	const Page **lptrs,					// left buffers
+	const Page **rptrs) const			// right buffers
+{
+	for (int i = 0; i < m_; ++i) {
+		if (lptrs[i]->size_ != -1 || rptrs[i]->size_ != -1) return false;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+//  all the page buffers are within the bucket width of <radius> at the end of
+//  a round, so the median of their projected distances is the width of a 
+//  round where about half of them have a chunk to scan
+// -----------------------------------------------------------------------------
+float RQALSH::next_radius(			// radius of next round
+	float radius,						// radius of this round
+	const RQALSH_Context *ctx) const	// search context
+{
+	if (ctx->rsched_ == RADIUS_STEP) {
+		float step = ctx->step_ > 1.0f ? ctx->step_ : sqrt(ratio_);
+		return radius / step;
+	}
+	else if (ctx->rsched_ == RADIUS_ADAPTIVE) {
+		std::vector<float> list;
+		for (int i = 0; i < m_; ++i) {
+			const Page *lptr = ctx->lptrs_[i];
+			const Page *rptr = ctx->rptrs_[i];
+			float q_val = ctx->q_val_[i];
+			if (lptr->size_ != -1) list.push_back(calc_dist(q_val, lptr));
+			if (rptr->size_ != -1) list.push_back(calc_dist(q_val, rptr));
+		}
+		if (list.empty()) return radius / ratio_;
+
+		std::nth_element(list.begin(), list.begin() + list.size() / 2, 
+			list.end());
+		float next = 2.0f * list[list.size() / 2] / w_;
+		next = std::max(next, radius / ratio_);
+		return std::min(next, radius / RADIUS_MIN_STEP);
+	}
+	return radius / ratio_;
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH::kfn_finish(			// finish c-k-AFN search of a session
+	RQALSH_Session *s) const			// search session (return)
+{
+	RQALSH_Context *ctx = s->ctx_;
+	Query_Stats *stats = ctx->stats_;
+
+	delete_tree_ptr(ctx->lptrs_, ctx->rptrs_);
+	if (s->defer_) verify_deferred(s);
+	if (stats != NULL) {
+		stats->index_io_   = ctx->page_io_;
+		stats->data_io_    = calc_data_io(ctx);
+		stats->cand_       = ctx->dist_io_ + ctx->num_defer_;
+		stats->stop_       = ctx->stop_;
+		stats->count_time_ = elapsed_ms(s->start_) - stats->hash_time_ - 
+			stats->verify_time_;
+	}
+}
+
+// -----------------------------------------------------------------------------
+uint64_t RQALSH::range_fn(			// c-range-FN search
+	float r,							// range (distance threshold)
+	const float *query,					// query object
+	const int   *index,					// mapping index for data objects
+	const char  *data_folder,			// data folder
+	Range_Callback callback,			// called for each object beyond <r>
+	void  *arg,							// argument of callback
+	const float *hash_val,				// hash values of query (optional)
+	RQALSH_Context *ctx) const			// search context (optional)
+{
+	timeval start_time;				// start time of this query
+	gettimeofday(&start_time, NULL);
+
+	RQALSH_Context *own = NULL;		// context of this query only
+	if (ctx == NULL) ctx = own = new RQALSH_Context(this);
+
+	bool  *flag  = ctx->flag_;
+	float *q_val = ctx->q_val_;
+	Page  **lptrs = ctx->lptrs_;
+	Page  **rptrs = ctx->rptrs_;
+	Query_Stats *stats = ctx->stats_;
+	uint64_t &page_io = ctx->page_io_;
+
+	if (stats != NULL) reset_stats(stats);
+	if (hash_val != NULL) {
+		memcpy(q_val, hash_val, m_ * SIZEFLOAT);
+	}
+	else {
+		calc_hash_values(1, &query, q_val);
+		if (stats != NULL) stats->hash_time_ = elapsed_ms(start_time);
+	}
+	init_search_params(ctx);
+
+	// -------------------------------------------------------------------------
+	//  one round of dynamic separation counting with the bucket width of <r>
+	// -------------------------------------------------------------------------
+	int   candidates = ctx->max_cand_ > 0 ? ctx->max_cand_ : n_pts_;
+	float width = r * w_ / 2.0f;	// bucket width
+	int   limit = STOP_NONE;		// limit of query reached in counting
+	int   num_flag = 0;
+	bool  more  = true;				// budget of candidates is not reached
+
+	memset(flag, true, m_ * SIZEBOOL);
+	if (stats != NULL) add_radius(r, stats);
+
+	while (num_flag < m_ && more && limit == STOP_NONE) {
+		for (int i = 0; i < m_; ++i) {
+			if (!flag[i]) continue;
+
+			Page *lptr = lptrs[i];
+			Page *rptr = rptrs[i];
+
+			float ldist = -1.0f;
+			float rdist = -1.0f;
+			if (lptr->size_ != -1) ldist = calc_dist(q_val[i], lptr);
+			if (rptr->size_ != -1) rdist = calc_dist(q_val[i], rptr);
+
+			if (ldist > width && ldist > rdist) {
+				more = range_chunk(lptr, true, r, candidates, query, index, 
+					data_folder, ctx, callback, arg);
+				update_left_buffer(rptr, lptr, page_io);
+				limit = check_limits(ctx, start_time, page_io);
+			}
+			else if (rdist > width && ldist <= rdist) {
+				more = range_chunk(rptr, false, r, candidates, query, index, 
+					data_folder, ctx, callback, arg);
+				update_right_buffer(lptr, rptr, page_io);
+				limit = check_limits(ctx, start_time, page_io);
+			}
+			else {
+				flag[i] = false;
+				++num_flag;
+			}
+			if (!more || limit != STOP_NONE) break;
+		}
+	}
+	if (!more) ctx->stop_ = STOP_CAND;
+	else if (limit != STOP_NONE) ctx->stop_ = limit;
+	else ctx->stop_ = STOP_NORMAL;
+
+	// -------------------------------------------------------------------------
+	//  release space
+	// -------------------------------------------------------------------------
+	delete_tree_ptr(lptrs, rptrs);
+
+	uint64_t io = page_io + calc_data_io(ctx);
+	if (stats != NULL) {
+		stats->index_io_   = page_io;
+		stats->data_io_    = calc_data_io(ctx);
+		stats->cand_       = ctx->dist_io_;
+		stats->stop_       = ctx->stop_;
+		stats->count_time_ = elapsed_ms(start_time) - stats->hash_time_ - 
+			stats->verify_time_;
 	}
-	fclose(fp);
+	if (own != NULL) { delete own; own = NULL; }
 
-	return 0;
+	return io;
 }
 
 // -----------------------------------------------------------------------------
-uint64_t RQALSH::kfn(				// c-k-AFN search
+//  the cursors to the right use the left buffers (<lptrs>), and those to the
+//  left use the right buffers (<rptrs>), since the buffers of kfn move the 
+//  same way. the keys of a chunk are no less than its own key and no more 
+//  than the key of the next chunk, so the projected distance of a chunk is a
+//  lower bound of those of its objects.
+// -----------------------------------------------------------------------------
+uint64_t RQALSH::knn(				// c-k-ANN search
 	int   top_k,						// top-k value
 	const float *query,					// query object
-	const int *index,					// mapping index for data objects
-	const char *data_folder,			// data folder
-	MaxK_List *list)					// k-FN results (return)
+	const int   *index,					// mapping index for data objects
+	const char  *data_folder,			// data folder
+	MinK_List   *list,					// k-NN results (return)
+	const float *hash_val,				// hash values of query (optional)
+	RQALSH_Context *ctx) const			// search context (optional)
 {
-	int   *freq    = new int[n_pts_];
-	bool  *checked = new bool[n_pts_];
-	bool  *flag    = new bool[m_];
-	float *q_val   = new float[m_];
-	float *data    = new float[dim_];
-	
-	Page **lptrs = new Page*[m_];
-	Page **rptrs = new Page*[m_];
-	for (int i = 0; i < m_; ++i) {
-		lptrs[i] = new Page();
-		rptrs[i] = new Page();
+	timeval start_time;				// start time of this query
+	gettimeofday(&start_time, NULL);
+
+	RQALSH_Context *own = NULL;		// context of this query only
+	if (ctx == NULL) ctx = own = new RQALSH_Context(this);
+
+	bool  *flag  = ctx->flag_;
+	float *q_val = ctx->q_val_;
+	Page  **lptrs = ctx->lptrs_;	// cursors to the right
+	Page  **rptrs = ctx->rptrs_;	// cursors to the left
+	Query_Stats *stats = ctx->stats_;
+	uint64_t &dist_io = ctx->dist_io_;
+	uint64_t &page_io = ctx->page_io_;
+
+	if (stats != NULL) reset_stats(stats);
+	if (hash_val != NULL) {
+		memcpy(q_val, hash_val, m_ * SIZEFLOAT);
+	}
+	else {
+		calc_hash_values(1, &query, q_val);
+		if (stats != NULL) stats->hash_time_ = elapsed_ms(start_time);
 	}
 
 	// -------------------------------------------------------------------------
 	//  initialize parameters
 	// -------------------------------------------------------------------------
-	memset(freq, 0, n_pts_ * SIZEFLOAT);
-	memset(checked, false, n_pts_ * SIZEBOOL);
+	if (ctx->nn_counter_ == NULL) {
+		ctx->nn_counter_ = new Collision_Counter(n_pts_, m_, nn_l_);
+	}
+	else ctx->nn_counter_->reset();
+
+	float *bound = new float[m_];	// key right of each left cursor
+	page_io = 0;
+	dist_io = 0;
+	ctx->num_defer_ = 0;
+	init_nn_buffer(q_val, lptrs, rptrs, bound, page_io);
 
-	init_search_params(query, q_val, lptrs, rptrs);
+	int   budget     = ctx->max_cand_ > 0 ? ctx->max_cand_ : CANDIDATES;
+	int   candidates = budget + top_k - 1; // threshold of candidates
+	int   limit      = STOP_NONE;	// limit of query reached in counting
+	bool  more       = true;		// budget of candidates is not reached
+	float kdist      = MAXREAL;		// k-th nearest neighbor distance
 
 	// -------------------------------------------------------------------------
-	//  c-k-AFN search
+	//  the first radius covers the median positive distance of the cursors
 	// -------------------------------------------------------------------------
-	int   candidates = CANDIDATES + top_k - 1; // threshold of candidates
-	float kdist  = MINREAL;			// k-th furthest neighbor distance
-	float radius = find_radius(q_val, (const Page**) lptrs, (const Page**) rptrs);
-	float width  = radius * w_ / 2.0f; // bucket width
+	std::vector<float> dists;
+	for (int i = 0; i < m_; ++i) {
+		if (lptrs[i]->size_ != -1) {
+			float key = lptrs[i]->leaf_node_->get_key(lptrs[i]->index_pos_);
+			if (key > q_val[i]) dists.push_back(key - q_val[i]);
+		}
+		if (rptrs[i]->size_ != -1 && q_val[i] > bound[i]) {
+			dists.push_back(q_val[i] - bound[i]);
+		}
+	}
+	float radius = 1.0f;
+	if (!dists.empty()) {
+		std::nth_element(dists.begin(), dists.begin() + dists.size() / 2, 
+			dists.end());
+		float dist = dists[dists.size() / 2];
+		int kappa = (int) ceil(log(2.0f * dist / nn_w_) / log(ratio_));
+		radius = pow(ratio_, kappa);
+	}
 
 	while (true) {
 		// ---------------------------------------------------------------------
-		//  step 1: initialize the stop condition for current round
+		//  step 1: scan the closer cursor of each table within <width>
 		// ---------------------------------------------------------------------
+		float width = radius * nn_w_ / 2.0f;
 		int num_flag = 0;
 		memset(flag, true, m_ * SIZEBOOL);
+		if (stats != NULL) add_radius(radius, stats);
 
-		// ---------------------------------------------------------------------
-		//  step 2: find frequent objects (dynamic separation counting)
-		// ---------------------------------------------------------------------
 		while (num_flag < m_) {
 			for (int i = 0; i < m_; ++i) {
 				if (!flag[i]) continue;
 
-				// -------------------------------------------------------------
-				//  step 2.1: compute <ldist> and <rdist>
-				// -------------------------------------------------------------
 				Page *lptr = lptrs[i];
 				Page *rptr = rptrs[i];
 
-				float ldist = -1.0f;
-				float rdist = -1.0f;
-				if (lptr->size_ != -1) ldist = calc_dist(q_val[i], lptr);
-				if (rptr->size_ != -1) rdist = calc_dist(q_val[i], rptr);
-
-				// -------------------------------------------------------------
-				//  step 2.2: determine the closer direction (left or right)
-				//  and do separation counting to find frequent objects.
-				//
-				//  For the frequent object, we calc the Lp distance with
-				//  query, and update the c-k-AFN results.
-				// -------------------------------------------------------------
-				if (ldist > width && ldist > rdist) {
-					int count = lptr->size_;
-					int start = lptr->leaf_pos_;
-					int end   = start + count;
-					
-					for (int j = start; j < end; ++j) {
-						int id = lptr->leaf_node_->get_entry_id(j);
-						if (++freq[id] > l_ && !checked[id]) {
-							checked[id] = true;
-							if (index != NULL) id = index[id];
-							read_data_new_format(id, dim_, B_, data_folder, data);
-
-							float dist = calc_l2_dist(dim_, data, query);
-							kdist = list->insert(dist, id + 1);
-							if (++dist_io_ >= candidates) break;
-						}
-					}
-					update_left_buffer(rptr, lptr);
+				float rdist = -1.0f;	// distance of the cursor to the right
+				float ldist = -1.0f;	// distance of the cursor to the left
+				if (lptr->size_ != -1) {
+					float key = lptr->leaf_node_->get_key(lptr->index_pos_);
+					rdist = std::max(0.0f, key - q_val[i]);
 				}
-				else if (rdist > width && ldist <= rdist) {
-					int count = rptr->size_;
-					int end   = rptr->leaf_pos_;
-					int start = end - count;
-
-					for (int j = end; j > start; --j) {
-						int id = rptr->leaf_node_->get_entry_id(j);
-						if (++freq[id] > l_ && !checked[id]) {
-							checked[id] = true;
-							if (index != NULL) id = index[id];
-							read_data_new_format(id, dim_, B_, data_folder, data);
-
-							float dist = calc_l2_dist(dim_, data, query);
-							kdist = list->insert(dist, id + 1);
-							if (++dist_io_ >= candidates) break;
-						}
-					}
-					update_right_buffer(lptr, rptr);
+				if (rptr->size_ != -1) {
+					ldist = std::max(0.0f, q_val[i] - bound[i]);
+				}
+
+				if (rdist >= 0.0f && rdist <= width && 
+					(ldist < 0.0f || rdist <= ldist)) {
+					more = nn_chunk(lptr, true, candidates, query, index, 
+						data_folder, ctx, list, kdist);
+					update_left_buffer(rptr, lptr, page_io);
+					limit = check_limits(ctx, start_time, page_io);
+				}
+				else if (ldist >= 0.0f && ldist <= width) {
+					more = nn_chunk(rptr, false, candidates, query, index, 
+						data_folder, ctx, list, kdist);
+					bound[i] = rptr->leaf_node_->get_key(rptr->index_pos_);
+					update_right_buffer(lptr, rptr, page_io);
+					limit = check_limits(ctx, start_time, page_io);
 				}
 				else {
 					flag[i] = false;
 					++num_flag;
 				}
-				if (num_flag >= m_ || dist_io_ >= candidates) break;
+				if (!more || limit != STOP_NONE) break;
 			}
-			if (num_flag >= m_ || dist_io_ >= candidates) break;
+			if (!more || limit != STOP_NONE) break;
 		}
+
 		// ---------------------------------------------------------------------
-		//  step 3: stop conditions 1 & 2
+		//  step 2: stop conditions and the limits of query
 		// ---------------------------------------------------------------------
-		if (kdist > radius / ratio_ && dist_io_ >= top_k) break;
-		if (dist_io_ >= candidates) break;
+		if (!more) { ctx->stop_ = STOP_CAND; break; }
+		if (limit != STOP_NONE) { ctx->stop_ = limit; break; }
+		if (kdist <= ratio_ * radius && dist_io >= (uint64_t) top_k) {
+			ctx->stop_ = STOP_NORMAL; break;
+		}
+		if (exhausted((const Page**) lptrs, (const Page**) rptrs)) {
+			ctx->stop_ = STOP_NORMAL; break;
+		}
 
 		// ---------------------------------------------------------------------
-		//  step 4: auto-update <radius>
+		//  step 3: virtual rehashing
 		// ---------------------------------------------------------------------
-		radius = radius / ratio_;
-		width  = radius * w_ / 2.0f;
+		radius = radius * ratio_;
 	}
+
 	// -------------------------------------------------------------------------
 	//  release space
 	// -------------------------------------------------------------------------
-	delete_tree_ptr(lptrs, rptrs);	
+	delete_tree_ptr(lptrs, rptrs);
+	delete[] bound; bound = NULL;
+
+	uint64_t io = page_io + calc_data_io(ctx);
+	if (stats != NULL) {
+		stats->index_io_   = page_io;
+		stats->data_io_    = calc_data_io(ctx);
+		stats->cand_       = dist_io;
+		stats->stop_       = ctx->stop_;
+		stats->count_time_ = elapsed_ms(start_time) - stats->hash_time_ - 
+			stats->verify_time_;
+	}
+	if (own != NULL) { delete own; own = NULL; }
+
+	return io;
+}
+
+// -----------------------------------------------------------------------------
+//  the queries of a batch share the leaf pages of the tails of each qab+tree.
+//  the leaves of the left (right) tail of table i that the batch has read are
+//  kept in <ltail[i]> (<rtail[i]>) in the order of the tail. each query moves
+//  its own cursors over these lists, and a leaf is read from disk only when a
+//  cursor goes beyond the end of its list. so each leaf page is read once per
+//  batch, and the index i/o of the batch is about m times the deepest scan.
+//
+//  each query runs the round robin of kfn on its own cursors, so its chunks,
+//  candidates and results are the same as kfn. the leaves stay in memory until
+//  the batch ends. the scheduler, max page io, deferral and radius schedule of
+//  the context are not used (only the defaults of kfn), but the budget of 
+//  candidates and the deadline of each query are used as kfn.
+// -----------------------------------------------------------------------------
+uint64_t RQALSH::kfn_batch(			// c-k-AFN search of a batch of queries
+	int   qn,							// number of queries
+	int   top_k,						// top-k value
+	const float **query,				// queries
+	const int *index,					// mapping index for data objects
+	const char *data_folder,			// data folder
+	MaxK_List **list,					// k-FN results of each query (return)
+	const float *hash_val,				// qn x m hash values (optional)
+	RQALSH_Context **ctx) const			// context of each query (optional)
+{
+	RQALSH_Context **own = NULL;	// contexts of this batch only
+	if (ctx == NULL) {
+		ctx = own = new RQALSH_Context*[qn];
+		for (int q = 0; q < qn; ++q) own[q] = new RQALSH_Context(this);
+	}
+
+	// -------------------------------------------------------------------------
+	//  read the first leaf of both tails of each table once for the batch
+	// -------------------------------------------------------------------------
+	Page  *buf   = new Page[2 * m_];
+	Page  **lptrs = new Page*[m_];
+	Page  **rptrs = new Page*[m_];
+	for (int i = 0; i < m_; ++i) {
+		lptrs[i] = &buf[i];
+		rptrs[i] = &buf[m_ + i];
+	}
+	uint64_t page_io = 0;			// shared by all queries of the batch
+	init_buffer(lptrs, rptrs, page_io);
+
+	std::vector<QAB_LeafNode*> *ltail = new std::vector<QAB_LeafNode*>[m_];
+	std::vector<QAB_LeafNode*> *rtail = new std::vector<QAB_LeafNode*>[m_];
+	for (int i = 0; i < m_; ++i) {
+		ltail[i].push_back(lptrs[i]->leaf_node_);
+		if (rptrs[i]->leaf_node_ != NULL) {
+			rtail[i].push_back(rptrs[i]->leaf_node_);
+		}
+	}
+
+	int  *ldepth = new int[m_];		// leaf of each left cursor in <ltail>
+	int  *rdepth = new int[m_];		// leaf of each right cursor in <rtail>
+	for (int q = 0; q < qn; ++q) {
+		RQALSH_Context *c = ctx[q];
+		Query_Stats *stats = c->stats_;
+		bool  *flag  = c->flag_;
+		float *q_val = c->q_val_;
+		Page  **lcur = c->lptrs_;
+		Page  **rcur = c->rptrs_;
+		uint64_t &dist_io = c->dist_io_;
+
+		timeval q_start;			// start time of this query
+		gettimeofday(&q_start, NULL);
+		if (stats != NULL) reset_stats(stats);
+		if (hash_val != NULL) {
+			memcpy(q_val, &hash_val[(uint64_t) q * m_], m_ * SIZEFLOAT);
+		}
+		else {
+			calc_hash_values(1, &query[q], q_val);
+			if (stats != NULL) stats->hash_time_ = elapsed_ms(q_start);
+		}
+		c->page_io_ = 0;
+		c->dist_io_ = 0;
+		c->reset_pack();
+		c->counter_->reset();
+		for (int i = 0; i < m_; ++i) {
+			*lcur[i]  = *lptrs[i];
+			*rcur[i]  = *rptrs[i];
+			ldepth[i] = 0;
+			rdepth[i] = 0;
+		}
+
+		// ---------------------------------------------------------------------
+		//  the rounds of kfn (round robin), where the cursors move over the 
+		//  shared leaves
+		// ---------------------------------------------------------------------
+		int   candidates = (c->max_cand_ > 0 ? c->max_cand_ : CANDIDATES) + 
+			top_k - 1;				// threshold of candidates
+		float kdist  = MINREAL;
+		float radius = find_radius(q_val, (const Page**) lcur, 
+			(const Page**) rcur);
+		float width  = radius * w_ / 2.0f;
+		while (true) {
+			int num_flag = 0;
+			int limit    = STOP_NONE;
+			memset(flag, true, m_ * SIZEBOOL);
+			if (stats != NULL) add_radius(radius, stats);
+
+			while (num_flag < m_) {
+				for (int i = 0; i < m_; ++i) {
+					if (!flag[i]) continue;
+
+					Page *lptr = lcur[i];
+					Page *rptr = rcur[i];
+
+					float ldist = -1.0f;
+					float rdist = -1.0f;
+					if (lptr->size_ != -1) ldist = calc_dist(q_val[i], lptr);
+					if (rptr->size_ != -1) rdist = calc_dist(q_val[i], rptr);
+
+					if (ldist > width && ldist > rdist) {
+						count_chunk(lptr, true, candidates, query[q], index, 
+							data_folder, c, list[q], kdist);
+						shared_left_buffer(ltail[i], ldepth[i], lptr, page_io);
+						limit = check_limits(c, q_start, 0);
+					}
+					else if (rdist > width && ldist <= rdist) {
+						count_chunk(rptr, false, candidates, query[q], index, 
+							data_folder, c, list[q], kdist);
+						shared_right_buffer(rtail[i], rdepth[i], rptr, page_io);
+						limit = check_limits(c, q_start, 0);
+					}
+					else {
+						flag[i] = false;
+						++num_flag;
+					}
+					if (num_flag >= m_ || (int) dist_io >= candidates) break;
+					if (limit != STOP_NONE) break;
+				}
+				if (num_flag >= m_ || (int) dist_io >= candidates) break;
+				if (limit != STOP_NONE) break;
+			}
+
+			if ((int) dist_io >= candidates) { c->stop_ = STOP_CAND; break; }
+			if (limit != STOP_NONE) { c->stop_ = limit; break; }
+			if ((kdist > radius / ratio_ && (int) dist_io >= top_k) ||
+				exhausted((const Page**) lcur, (const Page**) rcur)) {
+				c->stop_ = STOP_NORMAL; break;
+			}
+			radius = radius / ratio_;
+			width  = radius * w_ / 2.0f;
+		}
+		for (int i = 0; i < m_; ++i) {
+			lcur[i]->leaf_node_ = NULL; // the leaves are owned by the batch
+			rcur[i]->leaf_node_ = NULL;
+		}
+
+		if (stats != NULL) {
+			stats->data_io_    = calc_data_io(c);
+			stats->cand_       = dist_io;
+			stats->stop_       = c->stop_;
+			stats->count_time_ = elapsed_ms(q_start) - stats->hash_time_ - 
+				stats->verify_time_;
+		}
+	}
+
+	// -------------------------------------------------------------------------
+	//  the index i/o is shared evenly by the queries of the batch
+	// -------------------------------------------------------------------------
+	uint64_t io = page_io;
+	for (int q = 0; q < qn; ++q) {
+		io += calc_data_io(ctx[q]);
+		if (ctx[q]->stats_ != NULL) ctx[q]->stats_->index_io_ = page_io / qn;
+	}
 
-	delete[] freq;    freq    = NULL;
-	delete[] checked; checked = NULL;
-	delete[] flag;    flag    = NULL;
-	delete[] q_val;   q_val   = NULL;
-	delete[] data;    data    = NULL;
+	// -------------------------------------------------------------------------
+	//  release space
+	// -------------------------------------------------------------------------
+	for (int i = 0; i < m_; ++i) {
+		for (size_t j = 0; j < ltail[i].size(); ++j) delete ltail[i][j];
+		for (size_t j = 0; j < rtail[i].size(); ++j) {
+			if (j == 0 && rtail[i][0] == ltail[i][0]) continue;
+			delete rtail[i][j];
+		}
+	}
+	delete[] ltail;  ltail  = NULL;
+	delete[] rtail;  rtail  = NULL;
+	delete[] ldepth; ldepth = NULL;
+	delete[] rdepth; rdepth = NULL;
+	delete[] buf;    buf    = NULL;
+	delete[] lptrs;  lptrs  = NULL;
+	delete[] rptrs;  rptrs  = NULL;
+	if (own != NULL) {
+		for (int q = 0; q < qn; ++q) { delete own[q]; own[q] = NULL; }
+		delete[] own; own = NULL;
+	}
+	return io;
+}
 
-	return page_io_ + dist_io_;
+// -----------------------------------------------------------------------------
+//  thread <wid> scans the hash tables <wid>, <wid> + threads, ..., in the same
+//  way as step 2 of kfn. the page buffers and flags of a table are only used 
+//  by its thread, and the counters are shared. the page io of a query is 
+//  estimated by <threads> times the page io of this thread.
+// -----------------------------------------------------------------------------
+void RQALSH::count_task(			// separation counting of one thread
+	int   tid,							// thread id
+	int   wid,							// worker id
+	void  *arg)							// round of counting (Count_Round)
+{
+	Count_Round *round = (Count_Round*) arg;
+	const RQALSH *lsh = round->lsh_;
+	RQALSH_Context *ctx = round->ctx_;
+
+	int   m          = lsh->m_;
+	int   threads    = ctx->threads_;
+	int   candidates = round->candidates_;
+	float width      = round->width_;
+	float *data      = ctx->wdata_[wid];
+	Packed_File *pack = ctx->get_pack(wid);
+	bool  *flag      = ctx->flag_;
+	uint64_t &page_io = ctx->wio_[wid];
+	Collision_Counter *counter = ctx->counter_;
+	const uint64_t *allow = ctx->allow_;
+	const int *index = round->index_;
+
+	int num_own  = 0;				// number of tables of this thread
+	int num_flag = 0;
+	for (int i = wid; i < m; i += threads) ++num_own;
+
+	while (num_flag < num_own) {
+		for (int i = wid; i < m; i += threads) {
+			if (!flag[i]) continue;
+
+			Page *lptr = ctx->lptrs_[i];
+			Page *rptr = ctx->rptrs_[i];
+
+			float ldist = -1.0f;
+			float rdist = -1.0f;
+			if (lptr->size_ != -1) ldist = lsh->calc_dist(ctx->q_val_[i], lptr);
+			if (rptr->size_ != -1) rdist = lsh->calc_dist(ctx->q_val_[i], rptr);
+
+			if (ldist > width && ldist > rdist) {
+				int count = lptr->size_;
+				int start = lptr->leaf_pos_;
+				int end   = start + count;
+
+				for (int j = start; j < end; ++j) {
+					if (j + PREFETCH_DIST < end) {
+						counter->prefetch(lptr->leaf_node_->get_entry_id(
+							j + PREFETCH_DIST));
+					}
+					int id = lptr->leaf_node_->get_entry_id(j);
+					if (allow != NULL && 
+						!is_allowed(allow, index ? index[id] : id)) continue;
+					if (counter->add_shared(id) && 
+						!lsh->verify(round, id, data, pack)) break;
+				}
+				lsh->update_left_buffer(rptr, lptr, page_io);
+			}
+			else if (rdist > width && ldist <= rdist) {
+				int count = rptr->size_;
+				int end   = rptr->leaf_pos_;
+				int start = end - count;
+
+				for (int j = end; j > start; --j) {
+					if (j - PREFETCH_DIST > start) {
+						counter->prefetch(rptr->leaf_node_->get_entry_id(
+							j - PREFETCH_DIST));
+					}
+					int id = rptr->leaf_node_->get_entry_id(j);
+					if (allow != NULL && 
+						!is_allowed(allow, index ? index[id] : id)) continue;
+					if (counter->add_shared(id) && 
+						!lsh->verify(round, id, data, pack)) break;
+				}
+				lsh->update_right_buffer(lptr, rptr, page_io);
+			}
+			else {
+				flag[i] = false;
+				++num_flag;
+			}
+			if (num_flag >= num_own) break;
+			if (round->num_cand_.load(std::memory_order_relaxed) >= candidates) {
+				return;
+			}
+			if (round->limit_.load(std::memory_order_relaxed) != STOP_NONE) {
+				return;
+			}
+			int limit = lsh->check_limits(ctx, round->start_, 
+				ctx->page_io_ + page_io * threads);
+			if (limit != STOP_NONE) { round->limit_ = limit; return; }
+		}
+	}
 }
 
 // -----------------------------------------------------------------------------
-void RQALSH::init_search_params(	// init parameters
+float RQALSH::calc_obj_dist(		// distance of an object to query
+	int   id,							// object id (of this index)
 	const float *query,					// query object
-	float *q_val,						// hash values of query (return)
-	Page  **lptrs,						// left buffer (return)
-	Page  **rptrs)						// right buffer (return)
+	const int   *index,					// mapping index for data objects
+	const char  *data_folder,			// data folder
+	float *data,						// data buffer
+	Packed_File *pack) const			// packed data file (or NULL)
 {
-	page_io_ = 0;
-	dist_io_ = 0;
+	if (resident_ != NULL) {
+		const float *obj = &resident_[(uint64_t) id * pad_dim(dim_)];
+		return calc_l2_dist(dim_, obj, query);
+	}
+	if (pack != NULL) {
+		const float *obj = read_packed_object(id, dim_, B_, pack);
+		if (obj != NULL) return calc_l2_dist(dim_, obj, query);
+		++pack->io_;				// fall back to the data file
+	}
+	if (index != NULL) id = index[id];
+	read_data_new_format(id, dim_, B_, data_folder, data);
+
+	return calc_l2_dist(dim_, data, query);
+}
+
+// -----------------------------------------------------------------------------
+//  a claimed candidate takes the next slot of the verification queue. return 
+//  false if the threshold of candidates is reached, where a candidate beyond 
+//  the threshold is dropped, like the sequential search never counts it.
+// -----------------------------------------------------------------------------
+bool RQALSH::verify(				// verify a claimed candidate
+	Count_Round *round,					// round of counting
+	int   id,							// object id
+	float *data,						// data buffer
+	Packed_File *pack) const			// packed data file (or NULL)
+{
+	int candidates = round->candidates_;
+	int slot = round->num_cand_.fetch_add(1);
+	if (slot >= candidates) return false;
+
+	Result *cand = &round->ctx_->queue_[slot];
+	cand->key_ = calc_obj_dist(id, round->query_, round->index_, 
+		round->data_folder_, data, pack);
+	cand->id_  = round->index_ != NULL ? round->index_[id] : id;
+
+	return slot + 1 < candidates;
+}
+
+// -----------------------------------------------------------------------------
+//  count the ids of the current chunk of a page buffer, and verify the objects
+//  which become frequent. return false if the threshold of candidates is 
+//  reached.
+// -----------------------------------------------------------------------------
+bool RQALSH::count_chunk(			// separation counting of one chunk
+	const Page *ptr,					// page buffer
+	bool  left,							// left buffer (true) or right buffer
+	int   candidates,					// threshold of candidates
+	const float *query,					// query object
+	const int *index,					// mapping index for data objects
+	const char *data_folder,			// data folder
+	RQALSH_Context *ctx,				// search context
+	MaxK_List *list,					// k-FN results (return)
+	float &kdist) const					// k-th furthest distance (return)
+{
+	Collision_Counter *counter = ctx->counter_;
+	const uint64_t *allow = ctx->allow_;
+	QAB_LeafNode *leaf_node = ptr->leaf_node_;
+	Query_Stats *stats = ctx->stats_;
+	float *data = ctx->data_;
+
+	int count = ptr->size_;
+	int pos   = ptr->leaf_pos_;
+	int step  = left ? 1 : -1;		// scan to the right from the left buffer
+	if (stats != NULL) stats->collisions_ += count;
+
+	for (int j = 0; j < count; ++j, pos += step) {
+		if (j + PREFETCH_DIST < count) {
+			counter->prefetch(leaf_node->get_entry_id(pos+step*PREFETCH_DIST));
+		}
+		int id = leaf_node->get_entry_id(pos);
+		if (allow != NULL && 
+			!is_allowed(allow, index != NULL ? index[id] : id)) continue;
+		if (counter->add(id)) {
+			timeval start_time;
+			if (stats != NULL) gettimeofday(&start_time, NULL);
+
+			float dist = calc_obj_dist(id, query, index, data_folder, 
+				data, ctx->get_pack());
+			if (index != NULL) id = index[id];
+			kdist = list->insert(dist, id + 1);
+			if (stats != NULL) stats->verify_time_ += elapsed_ms(start_time);
+			if (++ctx->dist_io_ >= candidates) return false;
+		}
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+//  count the ids of the current chunk as count_chunk, and raise the lower 
+//  bounds of their distances to query by the chunk. the keys of a chunk are 
+//  no less than its own key and no more than the key of the next chunk, so
+//  the bound of a left chunk is 0 when the next chunk is in another leaf.
+//  return false if the threshold of candidates is reached.
+// -----------------------------------------------------------------------------
+bool RQALSH::defer_chunk(			// separation counting of one chunk (defer)
+	int   tid,							// hash table id
+	const Page *ptr,					// page buffer
+	bool  left,							// left buffer (true) or right buffer
+	RQALSH_Session *s) const			// search session (return)
+{
+	RQALSH_Context *ctx = s->ctx_;
+	Collision_Counter *counter = ctx->counter_;
+	const uint64_t *allow = ctx->allow_;
+	QAB_LeafNode *leaf_node = ptr->leaf_node_;
+	Query_Stats *stats = ctx->stats_;
+	float *bound = ctx->bound_;
+	float *data  = ctx->data_;
+	float &kdist = s->kdist_;
+
+	float q_val = ctx->q_val_[tid];
+	float gap   = 0.0f;
+	int   ipos  = ptr->index_pos_;
+	if (!left) gap = leaf_node->get_key(ipos) - q_val;
+	else if (ipos + 1 < leaf_node->get_num_keys()) {
+		gap = q_val - leaf_node->get_key(ipos + 1);
+	}
+	float lb = std::max(gap, 0.0f) * inv_norm_[tid];
+
+	int count = ptr->size_;
+	int pos   = ptr->leaf_pos_;
+	int step  = left ? 1 : -1;		// scan to the right from the left buffer
+	if (stats != NULL) stats->collisions_ += count;
+
+	for (int j = 0; j < count; ++j, pos += step) {
+		if (j + PREFETCH_DIST < count) {
+			counter->prefetch(leaf_node->get_entry_id(pos+step*PREFETCH_DIST));
+		}
+		int id = leaf_node->get_entry_id(pos);
+		if (allow != NULL && !is_allowed(allow, 
+			s->index_ != NULL ? s->index_[id] : id)) continue;
+		if (lb > 0.0f && bound[id] < lb) bound[id] = lb;
+		if (!counter->add(id)) continue;
+
+		if ((int) ctx->dist_io_ < s->verify_ && bound[id] > kdist) {
+			timeval start_time;
+			if (stats != NULL) gettimeofday(&start_time, NULL);
+
+			int oid = s->index_ != NULL ? s->index_[id] : id;
+			float dist = calc_obj_dist(id, s->query_, s->index_, 
+				s->data_folder_, data, ctx->get_pack());
+			kdist = s->list_->insert(dist, oid + 1);
+			if (stats != NULL) stats->verify_time_ += elapsed_ms(start_time);
+			++ctx->dist_io_;
+		}
+		else {
+			ctx->defer_list_[ctx->num_defer_++].id_ = id;
+		}
+		if ((int) (ctx->dist_io_ + ctx->num_defer_) >= s->candidates_) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+//  the final pass of deferral: verify the deferred candidates by descending 
+//  lower bounds until max_cand of candidates are verified
+// -----------------------------------------------------------------------------
+void RQALSH::verify_deferred(		// verify deferred candidates
+	RQALSH_Session *s) const			// search session (return)
+{
+	RQALSH_Context *ctx = s->ctx_;
+	Query_Stats *stats = ctx->stats_;
+	Result *cand = ctx->defer_list_;
+	float  *data = ctx->data_;
+
+	int num = ctx->num_defer_;
+	for (int i = 0; i < num; ++i) cand[i].key_ = ctx->bound_[cand[i].id_];
+	qsort(cand, num, sizeof(Result), ResultCompDesc);
+
+	timeval start_time;
+	if (stats != NULL) gettimeofday(&start_time, NULL);
+	for (int i = 0; i < num && (int) ctx->dist_io_ < s->verify_; ++i) {
+		if (ctx->deadline_ > 0.0f && elapsed_ms(s->start_) >= ctx->deadline_) {
+			ctx->stop_ = STOP_DEADLINE;
+			break;
+		}
+		int id = cand[i].id_;
+		float dist = calc_obj_dist(id, s->query_, s->index_, 
+			s->data_folder_, data, ctx->get_pack());
+		if (s->index_ != NULL) id = s->index_[id];
+		s->kdist_ = s->list_->insert(dist, id + 1);
+		++ctx->dist_io_;
+	}
+	if (stats != NULL) stats->verify_time_ += elapsed_ms(start_time);
+}
+
+// -----------------------------------------------------------------------------
+//  count the ids of the current chunk as count_chunk, and report the frequent
+//  objects beyond <r>. return false if the threshold of candidates is reached.
+// -----------------------------------------------------------------------------
+bool RQALSH::range_chunk(			// separation counting of one chunk (range)
+	const Page *ptr,					// page buffer
+	bool  left,							// left buffer (true) or right buffer
+	float r,							// range (distance threshold)
+	int   candidates,					// threshold of candidates
+	const float *query,					// query object
+	const int *index,					// mapping index for data objects
+	const char *data_folder,			// data folder
+	RQALSH_Context *ctx,				// search context
+	Range_Callback callback,			// called for each object beyond <r>
+	void  *arg) const					// argument of callback
+{
+	Collision_Counter *counter = ctx->counter_;
+	const uint64_t *allow = ctx->allow_;
+	QAB_LeafNode *leaf_node = ptr->leaf_node_;
+	Query_Stats *stats = ctx->stats_;
+	float *data = ctx->data_;
+
+	int count = ptr->size_;
+	int pos   = ptr->leaf_pos_;
+	int step  = left ? 1 : -1;		// scan to the right from the left buffer
+	if (stats != NULL) stats->collisions_ += count;
+
+	for (int j = 0; j < count; ++j, pos += step) {
+		if (j + PREFETCH_DIST < count) {
+			counter->prefetch(leaf_node->get_entry_id(pos+step*PREFETCH_DIST));
+		}
+		int id = leaf_node->get_entry_id(pos);
+		if (allow != NULL && 
+			!is_allowed(allow, index != NULL ? index[id] : id)) continue;
+		if (counter->add(id)) {
+			timeval start_time;
+			if (stats != NULL) gettimeofday(&start_time, NULL);
+
+			float dist = calc_obj_dist(id, query, index, data_folder, 
+				data, ctx->get_pack());
+			if (index != NULL) id = index[id];
+			if (dist > r) callback(id, dist, arg);
+			if (stats != NULL) stats->verify_time_ += elapsed_ms(start_time);
+			if (++ctx->dist_io_ >= candidates) return false;
+		}
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+//  count the ids of the current chunk as count_chunk for c-k-ANN search.
+//  return false if the threshold of candidates is reached.
+// -----------------------------------------------------------------------------
+bool RQALSH::nn_chunk(				// separation counting of one chunk (knn)
+	const Page *ptr,					// page buffer
+	bool  right,						// cursor to the right (true) or left
+	int   candidates,					// threshold of candidates
+	const float *query,					// query object
+	const int *index,					// mapping index for data objects
+	const char *data_folder,			// data folder
+	RQALSH_Context *ctx,				// search context
+	MinK_List *list,					// k-NN results (return)
+	float &kdist) const					// k-th nearest distance (return)
+{
+	Collision_Counter *counter = ctx->nn_counter_;
+	const uint64_t *allow = ctx->allow_;
+	QAB_LeafNode *leaf_node = ptr->leaf_node_;
+	Query_Stats *stats = ctx->stats_;
+	float *data = ctx->data_;
+
+	int count = ptr->size_;
+	int pos   = ptr->leaf_pos_;
+	int step  = right ? 1 : -1;
+	if (stats != NULL) stats->collisions_ += count;
+
+	for (int j = 0; j < count; ++j, pos += step) {
+		if (j + PREFETCH_DIST < count) {
+			counter->prefetch(leaf_node->get_entry_id(pos+step*PREFETCH_DIST));
+		}
+		int id = leaf_node->get_entry_id(pos);
+		if (allow != NULL && 
+			!is_allowed(allow, index != NULL ? index[id] : id)) continue;
+		if (counter->add(id)) {
+			timeval start_time;
+			if (stats != NULL) gettimeofday(&start_time, NULL);
+
+			float dist = calc_obj_dist(id, query, index, data_folder, 
+				data, ctx->get_pack());
+			if (index != NULL) id = index[id];
+			kdist = list->insert(dist, id + 1);
+			if (stats != NULL) stats->verify_time_ += elapsed_ms(start_time);
+			if (++ctx->dist_io_ >= candidates) return false;
+		}
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+int RQALSH::check_limits(			// check page io and deadline of query
+	const RQALSH_Context *ctx,			// search context
+	const timeval &start,				// start time of query
+	uint64_t page_io) const				// page io so far
+{
+	if (ctx->max_page_io_ > 0 && page_io >= ctx->max_page_io_) {
+		return STOP_PAGE_IO;
+	}
+	if (ctx->deadline_ > 0.0f && elapsed_ms(start) >= ctx->deadline_) {
+		return STOP_DEADLINE;
+	}
+	return STOP_NONE;
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH::init_search_params(	// init parameters
+	RQALSH_Context *ctx) const			// search context (return)
+{
+	Page **lptrs = ctx->lptrs_;
+	Page **rptrs = ctx->rptrs_;
+	uint64_t &page_io = ctx->page_io_;
+
+	page_io = 0;
+	ctx->dist_io_ = 0;
+	ctx->num_defer_ = 0;
+	ctx->reset_pack();
+	ctx->counter_->reset();
 
+	init_buffer(lptrs, rptrs, page_io);
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH::init_buffer(			// init page buffers at both tails
+	Page **lptrs,						// left buffer (return)
+	Page **rptrs,						// right buffer (return)
+	uint64_t &page_io) const			// io for scanning pages (return)
+{
 	for (int i = 0; i < m_; ++i) {
 		lptrs[i]->leaf_node_ = NULL;
 		lptrs[i]->index_pos_ = -1;
@@ -422,12 +2152,10 @@ void RQALSH::init_search_params(	// init parameters
 	int num_keys    = -1;
 
 	for (int i = 0; i < m_; ++i) {
-		float q_v = calc_hash_value(i, query);
 		QAB_Tree   *tree = trees_[i];
 		Page *lptr = lptrs[i];
 		Page *rptr = rptrs[i];
 
-		q_val[i] = q_v;
 		block = tree->root_;
 		if (block == 1) {
 			// -----------------------------------------------------------------
@@ -435,7 +2163,7 @@ void RQALSH::init_search_params(	// init parameters
 			// -----------------------------------------------------------------
 			lptr->leaf_node_ = new QAB_LeafNode();
 			lptr->leaf_node_->init_restore(trees_[i], block);
-			++page_io_;
+			++page_io;
 
 			leaf_node   = lptr->leaf_node_;
 			num_keys    = leaf_node->get_num_keys();
@@ -471,7 +2199,7 @@ void RQALSH::init_search_params(	// init parameters
 			block = tree->root_;
 			index_node = new QAB_IndexNode();
 			index_node->init_restore(tree, block);
-			++page_io_;
+			++page_io;
 									// find the left most leaf node
 			while (index_node->get_level() > 1) {
 				block = index_node->get_son(0);
@@ -479,13 +2207,13 @@ void RQALSH::init_search_params(	// init parameters
 
 				index_node = new QAB_IndexNode();
 				index_node->init_restore(tree, block);
-				++page_io_;			// access a new node (a new page)
+				++page_io;			// access a new node (a new page)
 			}
 
 			block = index_node->get_son(0);
 			lptr->leaf_node_ = new QAB_LeafNode();
 			lptr->leaf_node_->init_restore(tree, block);
-			++page_io_;
+			++page_io;
 
 			lptr->index_pos_ = 0;
 			lptr->leaf_pos_  = 0;
@@ -508,7 +2236,7 @@ void RQALSH::init_search_params(	// init parameters
 			block = tree->root_;
 			index_node = new QAB_IndexNode();
 			index_node->init_restore(tree, block);
-			++page_io_;
+			++page_io;
 									// find the right most leaf node
 			while (index_node->get_level() > 1) {
 				num_entries = index_node->get_num_entries();
@@ -517,14 +2245,14 @@ void RQALSH::init_search_params(	// init parameters
 
 				index_node = new QAB_IndexNode();
 				index_node->init_restore(tree, block);
-				++page_io_;			// access a new node (a new page)
+				++page_io;			// access a new node (a new page)
 			}
 
 			num_entries = index_node->get_num_entries();
 			block = index_node->get_son(num_entries - 1);
 			rptr->leaf_node_ = new QAB_LeafNode();
 			rptr->leaf_node_->init_restore(tree, block);
-			++page_io_;
+			++page_io;
 
 			leaf_node   = rptr->leaf_node_;
 			num_keys    = leaf_node->get_num_keys();
@@ -542,11 +2270,69 @@ void RQALSH::init_search_params(	// init parameters
 	}
 }
 
+// -----------------------------------------------------------------------------
+//  each table is descended to the chunk of the projected key of query, which
+//  is the first chunk of the cursor to the right, and the cursor to the left
+//  starts at the chunk before it
+// -----------------------------------------------------------------------------
+void RQALSH::init_nn_buffer(		// init page buffers at projected keys
+	const float *q_val,					// hash values of query
+	Page **lptrs,						// cursors to the right (return)
+	Page **rptrs,						// cursors to the left (return)
+	float *bound,						// key right of each left cursor (return)
+	uint64_t &page_io) const			// io for scanning pages (return)
+{
+	for (int i = 0; i < m_; ++i) {
+		QAB_Tree *tree = trees_[i];
+		Page *lptr = lptrs[i];
+		Page *rptr = rptrs[i];
+
+		int block = tree->root_;
+		if (block != 1) {
+			// -----------------------------------------------------------------
+			//  descend the index nodes (block 1 is the root iff it is a leaf)
+			// -----------------------------------------------------------------
+			QAB_IndexNode *index_node = new QAB_IndexNode();
+			index_node->init_restore(tree, block);
+			++page_io;
+			while (true) {
+				int pos = std::max(0, index_node->find_position_by_key(q_val[i]));
+				int level = index_node->get_level();
+				block = index_node->get_son(pos);
+				delete index_node; index_node = NULL;
+				if (level <= 1) break;
+
+				index_node = new QAB_IndexNode();
+				index_node->init_restore(tree, block);
+				++page_io;
+			}
+		}
+		QAB_LeafNode *leaf_node = new QAB_LeafNode();
+		leaf_node->init_restore(tree, block);
+		++page_io;
+
+		int pos         = std::max(0, leaf_node->find_position_by_key(q_val[i]));
+		int num_keys    = leaf_node->get_num_keys();
+		int increment   = leaf_node->get_increment();
+		int num_entries = leaf_node->get_num_entries();
+
+		lptr->leaf_node_ = leaf_node;
+		lptr->index_pos_ = pos;
+		lptr->leaf_pos_  = pos * increment;
+		if (pos == num_keys - 1) lptr->size_ = num_entries - pos * increment;
+		else lptr->size_ = increment;
+		bound[i] = leaf_node->get_key(pos);
+
+		*rptr = *lptr;
+		update_right_buffer(lptr, rptr, page_io);
+	}
+}
+
 // -----------------------------------------------------------------------------
 float RQALSH::find_radius(			// find proper radius
 	const float *q_val,					// hash value of query
 	const Page **lptrs,					// left buffer
-	const Page **rptrs)					// right buffer
+	const Page **rptrs) const			// right buffer
 {
 	// -------------------------------------------------------------------------
 	//  find an array of projected distance which is closest to the query in
@@ -582,7 +2368,8 @@ float RQALSH::find_radius(			// find proper radius
 // -----------------------------------------------------------------------------
 void RQALSH::update_left_buffer(	// update left buffer
 	const Page *rptr,					// right buffer
-	Page *lptr)							// left buffer (return)
+	Page *lptr,							// left buffer (return)
+	uint64_t &page_io) const			// io for scanning pages (return)
 {
 	QAB_LeafNode* leaf_node     = NULL;
 	QAB_LeafNode* old_leaf_node = NULL;
@@ -616,7 +2403,7 @@ void RQALSH::update_left_buffer(	// update left buffer
 			} else {
 				lptr->size_ = increment;
 			}
-			++page_io_;
+			++page_io;
 		}
 		else {
 			lptr->leaf_node_ = NULL;
@@ -634,7 +2421,8 @@ void RQALSH::update_left_buffer(	// update left buffer
 // -----------------------------------------------------------------------------
 void RQALSH::update_right_buffer(	// update right buffer
 	const Page* lptr,					// left buffer
-	Page* rptr)							// right buffer (return)
+	Page* rptr,							// right buffer (return)
+	uint64_t &page_io) const			// io for scanning pages (return)
 {
 	QAB_LeafNode* leaf_node     = NULL;
 	QAB_LeafNode* old_leaf_node = NULL;
@@ -660,7 +2448,7 @@ void RQALSH::update_right_buffer(	// update right buffer
 			int num_entries  = leaf_node->get_num_entries();
 			rptr->leaf_pos_  = num_entries - 1;
 			rptr->size_      = num_entries - pos * increment;
-			++page_io_;
+			++page_io;
 		}
 		else {
 			rptr->leaf_node_ = NULL;
@@ -675,10 +2463,95 @@ void RQALSH::update_right_buffer(	// update right buffer
 	}
 }
 
+// -----------------------------------------------------------------------------
+//  update left buffer as update_left_buffer, where the next leaf is taken from
+//  the leaves of the left tail read so far, and it is read from disk only if 
+//  the buffer is at the last of them
+// -----------------------------------------------------------------------------
+void RQALSH::shared_left_buffer(	// update left buffer over shared leaves
+	std::vector<QAB_LeafNode*> &tail,	// leaves of left tail (return)
+	int   &depth,						// leaf of buffer in <tail> (return)
+	Page  *lptr,						// left buffer (return)
+	uint64_t &page_io) const			// io for scanning pages (return)
+{
+	QAB_LeafNode *leaf_node = lptr->leaf_node_;
+	if (lptr->index_pos_ < leaf_node->get_num_keys() - 1) {
+		lptr->index_pos_++;
+
+		int pos         = lptr->index_pos_;
+		int increment   = leaf_node->get_increment();
+		lptr->leaf_pos_ = pos * increment;
+		if (pos == leaf_node->get_num_keys() - 1) {
+			lptr->size_ = leaf_node->get_num_entries() - pos * increment;
+		} else {
+			lptr->size_ = increment;
+		}
+		return;
+	}
+
+	if (depth + 1 == (int) tail.size()) {
+		leaf_node = tail.back()->get_right_sibling();
+		if (leaf_node == NULL) {
+			lptr->leaf_node_ = NULL;
+			lptr->index_pos_ = -1;
+			lptr->leaf_pos_  = -1;
+			lptr->size_      = -1;
+			return;
+		}
+		tail.push_back(leaf_node);
+		++page_io;
+	}
+	leaf_node = tail[++depth];
+	lptr->leaf_node_ = leaf_node;
+	lptr->index_pos_ = 0;
+	lptr->leaf_pos_  = 0;
+	lptr->size_      = std::min(leaf_node->get_increment(), 
+		leaf_node->get_num_entries());
+}
+
+// -----------------------------------------------------------------------------
+void RQALSH::shared_right_buffer(	// update right buffer over shared leaves
+	std::vector<QAB_LeafNode*> &tail,	// leaves of right tail (return)
+	int   &depth,						// leaf of buffer in <tail> (return)
+	Page  *rptr,						// right buffer (return)
+	uint64_t &page_io) const			// io for scanning pages (return)
+{
+	QAB_LeafNode *leaf_node = rptr->leaf_node_;
+	if (rptr->index_pos_ > 0) {
+		rptr->index_pos_--;
+
+		int pos         = rptr->index_pos_;
+		int increment   = leaf_node->get_increment();
+		rptr->leaf_pos_ = pos * increment + increment - 1;
+		rptr->size_     = increment;
+		return;
+	}
+
+	if (depth + 1 == (int) tail.size()) {
+		leaf_node = tail.back()->get_left_sibling();
+		if (leaf_node == NULL) {
+			rptr->leaf_node_ = NULL;
+			rptr->index_pos_ = -1;
+			rptr->leaf_pos_  = -1;
+			rptr->size_      = -1;
+			return;
+		}
+		tail.push_back(leaf_node);
+		++page_io;
+	}
+	leaf_node = tail[++depth];
+	int pos          = leaf_node->get_num_keys() - 1;
+	rptr->leaf_node_ = leaf_node;
+	rptr->index_pos_ = pos;
+	rptr->leaf_pos_  = leaf_node->get_num_entries() - 1;
+	rptr->size_      = leaf_node->get_num_entries() - 
+		pos * leaf_node->get_increment();
+}
+
 // -----------------------------------------------------------------------------
 inline float RQALSH::calc_dist(		// calc projected distance
 	float q_val,						// hash value of query
-	const Page *ptr)					// page buffer
+	const Page *ptr) const				// page buffer
 {
 	int   pos  = ptr->index_pos_;
 	float key  = ptr->leaf_node_->get_key(pos);
@@ -687,9 +2560,9 @@ inline float RQALSH::calc_dist(		// calc projected distance
 }
 
 // -----------------------------------------------------------------------------
-void RQALSH::delete_tree_ptr(		// delete the pointers of QAB+Trees
+void RQALSH::delete_tree_ptr(		// release leaf nodes of page buffers
 	Page **lptrs,						// left buffer (return)
-	Page **rptrs)						// right buffer (return)
+	Page **rptrs) const					// right buffer (return)
 {
 	for (int i = 0; i < m_; ++i) {
 		// ---------------------------------------------------------------------
@@ -705,10 +2578,6 @@ void RQALSH::delete_tree_ptr(		// delete the pointers of QAB+Trees
 		if (rptrs[i]->leaf_node_) {
 			delete rptrs[i]->leaf_node_; rptrs[i]->leaf_node_ = NULL;
 		}
-
-		if (lptrs[i] != NULL) { delete[] lptrs[i]; lptrs[i] = NULL; }
-		if (rptrs[i] != NULL) { delete[] rptrs[i]; rptrs[i] = NULL; }
+		lptrs[i]->leaf_node_ = NULL;
 	}
-	delete[] lptrs; lptrs = NULL;
-	delete[] rptrs; rptrs = NULL;
 }
@@ -7,6 +7,8 @@
 #include <cmath>
 #include <cstring>
 #include <vector>
+#include <queue>
+#include <atomic>
 
 #include "def.h"
 #include "util.h"
@@ -14,11 +16,29 @@
 #include "pri_queue.h"
 #include "qab_node.h"
 #include "qab_tree.h"
+#include "collision_counter.h"
 
 class QAB_Node;
 class QAB_LeafNode;
 class QAB_Tree;
 class MaxK_List;
+class MinK_List;
+class Collision_Counter;
+class RQALSH;
+class RQALSH_Session;
+
+// -----------------------------------------------------------------------------
+//  schedulers of hash tables in a round of c-k-AFN search
+// -----------------------------------------------------------------------------
+const int SCHED_ROUND_ROBIN = 0;	// visit the tables in turn
+const int SCHED_PRIORITY    = 1;	// visit the most extreme (table, side)
+
+// -----------------------------------------------------------------------------
+//  schedules of radius between the rounds of c-k-AFN search
+// -----------------------------------------------------------------------------
+const int RADIUS_RATIO    = 0;		// divide by the approximation ratio
+const int RADIUS_STEP     = 1;		// divide by a finer geometric step
+const int RADIUS_ADAPTIVE = 2;		// median projected distance of tables
 
 // -----------------------------------------------------------------------------
 //  Page: a buffer of one page for c-k-AFN search
@@ -30,11 +50,190 @@ struct Page {
 	int size_;						// size for one scan
 };
 
+// -----------------------------------------------------------------------------
+//  RQALSH_Context: per-query state of c-k-AFN search. It is owned by the 
+//  caller, so that one index can serve several queries at the same time when
+//  each thread uses its own context.
+//
+//  The caller may also set the limits of a query (0 means no limit). A query 
+//  which reaches one of them returns the k-FN results found so far, and 
+//  <stop_> tells which condition ends the search.
+//
+//  If <stats_> is set, kfn fills it. With several threads per query, the 
+//  collisions and the time of verification are not counted.
+//
+//  If <allow_> is set, the objects out of the allow-list are skipped when 
+//  their ids are counted, so they never cost a page read of data or take the
+//  budget of candidates. A search also ends when all page buffers reach the 
+//  ends of the qab+trees, since fewer than k objects may be allowed.
+//
+//  If <defer_> >= 1 (single thread only), <defer_> * max_cand objects may 
+//  become candidates, but at most max_cand of them are verified. Each object
+//  keeps the largest lower bound |<a_i, o - q>| / ||a_i|| of its distance to
+//  query over the chunks it is counted in. A candidate is verified at once if
+//  its bound beats the k-th distance, and otherwise it is deferred to a final
+//  pass, which verifies the deferred ones by descending bound.
+//
+//  <rsched_> sets the radius of each round after the first one (kfn only): 
+//  the radius is divided by the approximation ratio (default), by <step_>, or
+//  it moves to the median projected distance of the page buffers, within a
+//  step between RADIUS_MIN_STEP and the ratio.
+// -----------------------------------------------------------------------------
+class RQALSH_Context {
+public:
+	int   threads_;					// number of threads per query
+	uint64_t page_io_;				// io for scanning pages
+	uint64_t dist_io_;				// io for computing distance
+
+	int   max_cand_;				// budget of candidates (0: CANDIDATES)
+	uint64_t max_page_io_;			// max page io (0: no limit)
+	float deadline_;				// wall-clock deadline in ms (0: no limit)
+	int   stop_;					// stop condition of last search (return)
+	int   sched_;					// scheduler of tables (single thread)
+	float defer_;					// admission factor of deferral (0: off)
+	int   rsched_;					// schedule of radius
+	float step_;					// step of RADIUS_STEP (0: sqrt(ratio))
+	Query_Stats *stats_;			// statistics of query (or NULL)
+	const uint64_t *allow_;			// allow-list of data objects (or NULL)
+
+	bool  *flag_;					// flags of hash tables in a round
+	float *q_val_;					// hash values of query
+	float *data_;					// buffer of one data object
+	Page  **lptrs_;					// left buffers
+	Page  **rptrs_;					// right buffers
+	Collision_Counter *counter_;	// collision counters
+	Collision_Counter *nn_counter_;	// collision counters of knn (or NULL)
+
+	float **wdata_;					// data buffer of each thread
+	uint64_t *wio_;					// page io of each thread in a round
+	Result *queue_;					// verification queue of candidates
+	int   queue_size_;				// capacity of <queue_>
+
+	float *bound_;					// projected lower bounds of objects
+	Result *defer_list_;			// deferred candidates (id, lower bound)
+	int   defer_size_;				// capacity of <defer_list_>
+	int   num_defer_;				// number of deferred candidates
+
+	Packed_File *pack_;				// packed data file of each thread (or NULL)
+
+	// -------------------------------------------------------------------------
+	RQALSH_Context(					// constructor
+		const RQALSH *lsh,				// index to be searched
+		int   threads = 1);				// number of threads per query
+
+	// -------------------------------------------------------------------------
+	~RQALSH_Context();				// destructor
+
+	// -------------------------------------------------------------------------
+	inline Packed_File *get_pack(int wid = 0) const {
+		return pack_ != NULL ? &pack_[wid] : NULL;
+	}
+
+	// -------------------------------------------------------------------------
+	void reset_pack();				// forget the pages read of packed file
+
+	// -------------------------------------------------------------------------
+	uint64_t get_pack_io() const;	// pages read from packed file
+
+protected:
+	int m_;							// number of hashtables
+};
+
+// -----------------------------------------------------------------------------
+//  Count_Round: shared state of one round of separation counting, where the 
+//  hash tables are split across the threads of one query
+// -----------------------------------------------------------------------------
+struct Count_Round {
+	const RQALSH *lsh_;				// index to be searched
+	RQALSH_Context *ctx_;			// search context
+	const float *query_;			// query object
+	const int   *index_;			// mapping index for data objects
+	const char  *data_folder_;		// data folder
+	float width_;					// bucket width of this round
+	int   candidates_;				// threshold of candidates
+	timeval start_;					// start time of query
+	std::atomic<int> num_cand_;		// number of claimed candidates
+	std::atomic<int> limit_;		// limit reached by a thread (or STOP_NONE)
+};
+
+// -----------------------------------------------------------------------------
+//  RQALSH_Session: an anytime c-k-AFN search of one query. Each call of next 
+//  runs one round of radius, so that <list> holds the k-FN results of all the
+//  rounds so far, and the caller can stop as soon as they are good enough. 
+//  The page buffers and collision counters stay in the context between calls,
+//  so running a session to the end costs the same as kfn.
+//
+//  The deadline of the context counts from the constructor, including the 
+//  time between calls. The leaf nodes are released once the search ends or 
+//  the session is deleted, and the context may then be used again.
+// -----------------------------------------------------------------------------
+class RQALSH_Session {
+public:
+	RQALSH_Session(					// constructor
+		const RQALSH *lsh,				// index to be searched
+		int   top_k,					// top-k value
+		const float *query,				// query object
+		const int   *index,				// mapping index for data objects
+		const char  *data_folder,		// data folder
+		MaxK_List   *list,				// k-FN results (return)
+		const float *q_val = NULL,		// hash values of query (optional)
+		RQALSH_Context *ctx = NULL);	// search context (optional)
+
+	// -------------------------------------------------------------------------
+	~RQALSH_Session();				// destructor
+
+	// -------------------------------------------------------------------------
+	bool next();					// run one round, false if search ends
+
+	// -------------------------------------------------------------------------
+	inline bool is_done() const { return done_; }
+
+	// -------------------------------------------------------------------------
+	inline int get_rounds() const { return rounds_; }
+
+	// -------------------------------------------------------------------------
+	inline int get_stop() const { return ctx_->stop_; }
+
+	// -------------------------------------------------------------------------
+	uint64_t get_io() const;		// page i/o of index and data so far
+
+	// -------------------------------------------------------------------------
+	//  state of search between rounds (used by RQALSH)
+	// -------------------------------------------------------------------------
+	const RQALSH *lsh_;				// index to be searched
+	int   top_k_;					// top-k value
+	const float *query_;			// query object
+	const int   *index_;			// mapping index for data objects
+	const char  *data_folder_;		// data folder
+	MaxK_List   *list_;				// k-FN results
+	RQALSH_Context *ctx_;			// search context
+	RQALSH_Context *own_;			// context of this session only (or NULL)
+	timeval start_;					// start time of query
+
+	int   candidates_;				// threshold of candidates
+	int   verify_;					// max number of verified candidates
+	float kdist_;					// k-th furthest neighbor distance
+	float radius_;					// radius of next round
+	float width_;					// bucket width of next round
+	int   rounds_;					// number of rounds so far
+	bool  done_;					// search ends
+	bool  priority_;				// use the priority scheduler
+	bool  defer_;					// defer candidates by lower bounds
+	Count_Round round_;				// round of counting (multiple threads)
+	std::priority_queue<Result, std::vector<Result>, Cmp> heap_; // (priority)
+
+protected:
+	// -------------------------------------------------------------------------
+	void finish();					// release leaf nodes and fill statistics
+};
+
 // -----------------------------------------------------------------------------
 //  RQALSH: structure of RQALSH indexed by Query-Aware B+tree (QAB+Tree), which
 //  is used for c-Approximate Furthest Neighbor (c-AFN) search.
 // -----------------------------------------------------------------------------
 class RQALSH {
+	friend class RQALSH_Session;
+
 public:
 	RQALSH();						// default constructor
 	~RQALSH();						// destructor
@@ -47,6 +246,7 @@ public:
 		int   beta,						// false positive percentage
 		float delta,					// error probability
 		float ratio,					// approximation ratio
+		int   family,					// family of hash functions
 		const float **data,				// data objects
 		const char  *path);				// index path
 
@@ -54,8 +254,63 @@ public:
 	int load(						// load index
 		const char *path);				// index path
 
+	// -------------------------------------------------------------------------
+	//  view of a loaded index for a query-time ratio >= the ratio of <base>. 
+	//  it shares the hash functions and qab+trees of <base>, and searches the
+	//  first m(ratio) of them with w(ratio) and l(ratio). <base> must outlive
+	//  the view.
+	// -------------------------------------------------------------------------
+	int view(						// view index with another ratio
+		const RQALSH *base,				// loaded index
+		float ratio);					// approximation ratio
+
 	// -------------------------------------------------------------------------
 	void display();					// display parameters
+
+	// -------------------------------------------------------------------------
+	inline int get_num_objects() const { return n_pts_; }
+
+	// -------------------------------------------------------------------------
+	inline int get_dim() const { return dim_; }
+
+	// -------------------------------------------------------------------------
+	inline int get_page_size() const { return B_; }
+
+	// -------------------------------------------------------------------------
+	inline int get_num_tables() const { return m_; }
+
+	// -------------------------------------------------------------------------
+	inline int get_threshold() const { return l_; }
+
+	// -------------------------------------------------------------------------
+	inline int get_nn_threshold() const { return nn_l_; }
+
+	// -------------------------------------------------------------------------
+	//  keep the objects in memory: row i (stride pad_dim(d)) is object i of 
+	//  this index, so the candidates are verified with no data page i/o. the
+	//  matrix is owned by the caller (e.g., RQALSH*).
+	// -------------------------------------------------------------------------
+	inline void set_resident(const float *mat) { resident_ = mat; }
+
+	// -------------------------------------------------------------------------
+	//  read the objects from a packed data file, where object i of this index
+	//  is at position i (see write_packed_data), with no mapping of ids
+	// -------------------------------------------------------------------------
+	inline void set_packed(const char *fname) { strcpy(packed_, fname); }
+
+	// -------------------------------------------------------------------------
+	inline const char *get_packed() const { 
+		return resident_ == NULL && packed_[0] != '\0' ? packed_ : NULL; 
+	}
+
+	// -------------------------------------------------------------------------
+	//  a verified object costs one data page, except that resident objects 
+	//  cost none and packed objects cost one page per page of packed file
+	// -------------------------------------------------------------------------
+	inline uint64_t calc_data_io(const RQALSH_Context *ctx) const { 
+		if (resident_ != NULL) return 0;
+		return ctx->pack_ != NULL ? ctx->get_pack_io() : ctx->dist_io_;
+	}
 	
 	// -------------------------------------------------------------------------
 	uint64_t kfn(					// c-k-AFN search
@@ -63,7 +318,69 @@ public:
 		const float *query,				// query object
 		const int   *index,				// mapping index for data objects
 		const char  *data_folder,		// data folder
-		MaxK_List   *list);				// k-FN results (return)
+		MaxK_List   *list,				// k-FN results (return)
+		const float *q_val = NULL,		// hash values of query (optional)
+		RQALSH_Context *ctx = NULL) const; // search context (optional)
+
+	// -------------------------------------------------------------------------
+	//  c-k-ANN search on the same qab+trees (QALSH): each table is entered at 
+	//  the chunk of the projected key of query, and two cursors expand to the
+	//  left and right while the projected distances are within the bucket 
+	//  width of <radius> * w' / 2, where w' and l' are the bucket width and 
+	//  collision threshold of QALSH for the m tables and ratio of the index.
+	//  the radius starts at the median projected distance of the cursors, and
+	//  it is multiplied by ratio (virtual rehashing) until the k-th distance 
+	//  is within ratio * radius. the limits of the context are used as kfn 
+	//  (one thread only).
+	// -------------------------------------------------------------------------
+	uint64_t knn(					// c-k-ANN search
+		int   top_k,					// top-k value
+		const float *query,				// query object
+		const int   *index,				// mapping index for data objects
+		const char  *data_folder,		// data folder
+		MinK_List   *list,				// k-NN results (return)
+		const float *q_val = NULL,		// hash values of query (optional)
+		RQALSH_Context *ctx = NULL) const; // search context (optional)
+
+	// -------------------------------------------------------------------------
+	//  c-k-AFN search of a batch of queries, which share the leaf pages of the
+	//  tails of each qab+tree: each leaf page is read once per batch, and each
+	//  query counts the chunks it needs in the order of kfn, so the results 
+	//  are the same as kfn (round robin, one thread, radius divided by ratio).
+	// -------------------------------------------------------------------------
+	uint64_t kfn_batch(				// c-k-AFN search of a batch of queries
+		int   qn,						// number of queries
+		int   top_k,					// top-k value
+		const float **query,			// queries
+		const int   *index,				// mapping index for data objects
+		const char  *data_folder,		// data folder
+		MaxK_List   **list,				// k-FN results of each query (return)
+		const float *q_val = NULL,		// qn x m hash values (optional)
+		RQALSH_Context **ctx = NULL) const; // context of each query (optional)
+
+	// -------------------------------------------------------------------------
+	//  c-range-FN search: report each object beyond distance <r> from query 
+	//  which collides with it in more than <l_> tables, where a collision is a
+	//  projected distance larger than <r> * <w_> / 2. each table is scanned 
+	//  from both tails until the projected distances are within this width. 
+	//  the reported objects are verified, so there are no false positives.
+	//  the limits of the context are used as kfn (one thread only).
+	// -------------------------------------------------------------------------
+	uint64_t range_fn(				// c-range-FN search
+		float r,						// range (distance threshold)
+		const float *query,				// query object
+		const int   *index,				// mapping index for data objects
+		const char  *data_folder,		// data folder
+		Range_Callback callback,		// called for each object beyond <r>
+		void  *arg,						// argument of callback
+		const float *q_val = NULL,		// hash values of query (optional)
+		RQALSH_Context *ctx = NULL) const; // search context (optional)
+
+	// -------------------------------------------------------------------------
+	void calc_hash_values(			// calc hash values of a batch of queries
+		int   qn,						// number of queries
+		const float **query,			// queries
+		float *q_val) const;			// qn x m hash values (return)
 
 protected:
 	int   n_pts_;					// cardinality
@@ -75,16 +392,77 @@ protected:
 	float w_;						// bucket width
 	int   m_;						// number of hashtables
 	int   l_;						// collision threshold
+	float nn_w_;					// bucket width of c-k-ANN search
+	int   nn_l_;					// collision threshold of c-k-ANN search
 	char  path_[200];				// index path
 
-	float **a_;						// hash functions
+	int   pdim_;					// row stride of <a_> (padded <dim_>)
+	float *a_;						// m x pdim hash functions (gaussian, pca)
+
+	int   family_;					// family of hash functions
+	float kurt_;					// excess kurtosis of projection (build)
+	float scale_;					// nonzero value of sparse family
+	int   *sp_start_;				// start of each row in <sp_idx_> (m + 1)
+	int   *sp_mid_;					// start of negatives of each row
+	int   *sp_idx_;					// dimensions of nonzeros of each row
+	int   hdim_;					// size of Hadamard transform (power of 2)
+	int   nblk_;					// number of Hadamard blocks
+	float *sign_;					// nblk x HADAMARD_ROUNDS x hdim signs
+	float *inv_norm_;				// 1 / ||a_i|| of each hash function
 	QAB_Tree **trees_;				// query-aware b+ trees
-	uint64_t dist_io_;				// io for computing distance
-	uint64_t page_io_;				// io for scanning pages
+	const RQALSH *base_;			// owner of shared members (view only)
+	const float *resident_;			// objects in memory (or NULL)
+	char  packed_[200];				// packed data file (or empty)
+
+	// -------------------------------------------------------------------------
+	float calc_obj_dist(			// distance of an object to query
+		int   id,						// object id (of this index)
+		const float *query,				// query object
+		const int   *index,				// mapping index for data objects
+		const char  *data_folder,		// data folder
+		float *data,					// data buffer
+		Packed_File *pack) const;		// packed data file (or NULL)
+
+	// -------------------------------------------------------------------------
+	void calc_params(				// calc <w> <m> and <l> of a ratio
+		float ratio,					// approximation ratio
+		float &w,						// bucket width (return)
+		int   &m,						// number of hashtables (return)
+		int   &l) const;				// collision threshold (return)
+
+	// -------------------------------------------------------------------------
+	void calc_tables(				// calc <m> and <l> of <p1> and <p2>
+		float p1,						// collision prob of far objects
+		float p2,						// collision prob of close objects
+		int   &m,						// number of hashtables (return)
+		int   &l) const;				// collision threshold (return)
 
 	// -------------------------------------------------------------------------
 	float calc_l2_prob(				// calc <p1> and <p2> for L2 distance
-		float x);						// x = w / (2.0 * r)
+		float x) const;					// x = w / (2.0 * r)
+
+	// -------------------------------------------------------------------------
+	void init_pca(					// init hash functions of pca family
+		const float **data,				// data objects
+		float *a);						// m x d hash functions (return)
+
+	// -------------------------------------------------------------------------
+	float calc_kurtosis(			// estimate excess kurtosis of projection
+		float s,						// sparsity (1 / s nonzeros)
+		const float **data);			// data objects
+
+	// -------------------------------------------------------------------------
+	void init_sparse(				// generate index lists of sparse family
+		float s);						// sparsity (1 / s nonzeros)
+
+	// -------------------------------------------------------------------------
+	void init_hadamard();			// init sizes of Hadamard family
+
+	// -------------------------------------------------------------------------
+	void init_norms();				// init norms of hash functions
+
+	// -------------------------------------------------------------------------
+	void init_nn();					// init <nn_w_> and <nn_l_>
 
 	// -------------------------------------------------------------------------
 	int bulkload(					// build QAB+Trees by bulkloading
@@ -93,7 +471,7 @@ protected:
 	// -------------------------------------------------------------------------
 	float calc_hash_value(			// calc hash value
 		int   tid,						// hash table id
-		const float *data);				// one data object
+		const float *data) const;		// one data object
 
 	// -------------------------------------------------------------------------
 	int write_params();				// write parameters to disk
@@ -106,38 +484,156 @@ protected:
 		int  tid,						// tree id
 		char *fname);					// file name (return)
 
+	// -------------------------------------------------------------------------
+	void kfn_start(					// start c-k-AFN search of a session
+		const float *hash_val,			// hash values of query (optional)
+		RQALSH_Session *s) const;		// search session (return)
+
+	// -------------------------------------------------------------------------
+	bool kfn_round(					// one round of c-k-AFN search
+		RQALSH_Session *s) const;		// search session (return)
+
+	// -------------------------------------------------------------------------
+	void kfn_finish(				// finish c-k-AFN search of a session
+		RQALSH_Session *s) const;		// search session (return)
+
 	// -------------------------------------------------------------------------
 	void init_search_params(		// init parameters
-		const float *query,				// query object
-		float *q_val,					// hash values of query (return)
-		Page  **lptrs,					// left buffer (return)
-		Page  **rptrs);					// right buffer (return)
+		RQALSH_Context *ctx) const;		// search context (return)
+
+	// -------------------------------------------------------------------------
+	void init_buffer(				// init page buffers at both tails
+		Page **lptrs,					// left buffer (return)
+		Page **rptrs,					// right buffer (return)
+		uint64_t &page_io) const;		// io for scanning pages (return)
 
 	// -------------------------------------------------------------------------
 	float find_radius(				// find proper radius
 		const float *q_val,				// hash value of query
 		const Page **lptrs,				// left buffer
-		const Page **rptrs);			// right buffer
+		const Page **rptrs) const;		// right buffer
 
 	// -------------------------------------------------------------------------
 	void update_left_buffer(		// update left buffer
 		const Page *rptr,				// right buffer
-		Page *lptr);					// left buffer (return)
+		Page *lptr,						// left buffer (return)
+		uint64_t &page_io) const;		// io for scanning pages (return)
 
 	// -------------------------------------------------------------------------
 	void update_right_buffer(		// update right buffer
 		const Page *lptr,				// left buffer
-		Page *rptr);					// right buffer (return)
+		Page *rptr,						// right buffer (return)
+		uint64_t &page_io) const;		// io for scanning pages (return)
+
+	// -------------------------------------------------------------------------
+	void shared_left_buffer(		// update left buffer over shared leaves
+		std::vector<QAB_LeafNode*> &tail, // leaves of left tail (return)
+		int   &depth,					// leaf of buffer in <tail> (return)
+		Page  *lptr,					// left buffer (return)
+		uint64_t &page_io) const;		// io for scanning pages (return)
+
+	// -------------------------------------------------------------------------
+	void shared_right_buffer(		// update right buffer over shared leaves
+		std::vector<QAB_LeafNode*> &tail, // leaves of right tail (return)
+		int   &depth,					// leaf of buffer in <tail> (return)
+		Page  *rptr,					// right buffer (return)
+		uint64_t &page_io) const;		// io for scanning pages (return)
 
 	// -------------------------------------------------------------------------
 	float calc_dist(				// calc projected distance
 		float q_val,					// hash value of query
-		const Page *ptr);				// page buffer
+		const Page *ptr) const;			// page buffer
 	
 	// -------------------------------------------------------------------------
-	void delete_tree_ptr(			// delete the pointers of QAB+Trees
+	static void count_task(			// separation counting of one thread
+		int   tid,						// thread id
+		int   wid,						// worker id
+		void  *arg);					// round of counting (Count_Round)
+
+	// -------------------------------------------------------------------------
+	bool verify(					// verify a claimed candidate
+		Count_Round *round,				// round of counting
+		int   id,						// object id
+		float *data,					// data buffer
+		Packed_File *pack) const;		// packed data file (or NULL)
+
+	// -------------------------------------------------------------------------
+	bool count_chunk(				// separation counting of one chunk
+		const Page *ptr,				// page buffer
+		bool  left,						// left buffer (true) or right buffer
+		int   candidates,				// threshold of candidates
+		const float *query,				// query object
+		const int   *index,				// mapping index for data objects
+		const char  *data_folder,		// data folder
+		RQALSH_Context *ctx,			// search context
+		MaxK_List *list,				// k-FN results (return)
+		float &kdist) const;			// k-th furthest distance (return)
+
+	// -------------------------------------------------------------------------
+	bool defer_chunk(				// separation counting of one chunk (defer)
+		int   tid,						// hash table id
+		const Page *ptr,				// page buffer
+		bool  left,						// left buffer (true) or right buffer
+		RQALSH_Session *s) const;		// search session (return)
+
+	// -------------------------------------------------------------------------
+	void verify_deferred(			// verify deferred candidates
+		RQALSH_Session *s) const;		// search session (return)
+
+	// -------------------------------------------------------------------------
+	void init_nn_buffer(			// init page buffers at projected keys
+		const float *q_val,				// hash values of query
+		Page **lptrs,					// cursors to the right (return)
+		Page **rptrs,					// cursors to the left (return)
+		float *bound,					// key right of each left cursor (return)
+		uint64_t &page_io) const;		// io for scanning pages (return)
+
+	// -------------------------------------------------------------------------
+	bool nn_chunk(					// separation counting of one chunk (knn)
+		const Page *ptr,				// page buffer
+		bool  right,					// cursor to the right (true) or left
+		int   candidates,				// threshold of candidates
+		const float *query,				// query object
+		const int   *index,				// mapping index for data objects
+		const char  *data_folder,		// data folder
+		RQALSH_Context *ctx,			// search context
+		MinK_List *list,				// k-NN results (return)
+		float &kdist) const;			// k-th nearest distance (return)
+
+	// -------------------------------------------------------------------------
+	bool exhausted(					// all page buffers are at the ends
+		const Page **lptrs,				// left buffers
+		const Page **rptrs) const;		// right buffers
+
+	// -------------------------------------------------------------------------
+	float next_radius(				// radius of next round
+		float radius,					// radius of this round
+		const RQALSH_Context *ctx) const; // search context
+
+	// -------------------------------------------------------------------------
+	bool range_chunk(				// separation counting of one chunk (range)
+		const Page *ptr,				// page buffer
+		bool  left,						// left buffer (true) or right buffer
+		float r,						// range (distance threshold)
+		int   candidates,				// threshold of candidates
+		const float *query,				// query object
+		const int   *index,				// mapping index for data objects
+		const char  *data_folder,		// data folder
+		RQALSH_Context *ctx,			// search context
+		Range_Callback callback,		// called for each object beyond <r>
+		void  *arg) const;				// argument of callback
+
+
+	// -------------------------------------------------------------------------
+	int check_limits(				// check page io and deadline of query
+		const RQALSH_Context *ctx,		// search context
+		const timeval &start,			// start time of query
+		uint64_t page_io) const;		// page io so far
+
+	// -------------------------------------------------------------------------
+	void delete_tree_ptr(			// release leaf nodes of page buffers
 		Page **lptrs,					// left buffer (return)
-		Page **rptrs);					// right buffer (return)
+		Page **rptrs) const;			// right buffer (return)
 };
 
 #endif // __RQALSH_H
@@ -9,6 +9,8 @@ RQALSH_STAR::RQALSH_STAR()			// default constructor
 	L_     = -1;
 	M_     = -1;
 	cand_  = NULL;
+	cand_data_ = NULL;
+	pack_path_[0] = '\0';
 	lsh_   = NULL;
 }
 
@@ -19,6 +21,10 @@ RQALSH_STAR::~RQALSH_STAR()			// destructor
 	g_memory -= SIZEINT * L_ * M_;
 	
 	if (lsh_ != NULL) { delete lsh_; lsh_ = NULL; }
+	if (cand_data_ != NULL) {
+		g_memory -= SIZEFLOAT * L_ * M_ * pad_dim(dim_);
+		delete_matrix(cand_data_); cand_data_ = NULL;
+	}
 }
 
 // -----------------------------------------------------------------------------
@@ -31,8 +37,12 @@ int RQALSH_STAR::build(				// build index
 	int   beta,							// false positive percentage
 	float delta,						// error probability
 	float ratio,						// approximation ratio
+	int   family,						// family of hash functions
 	const float **data,					// data objects
-	const char  *path)					// index path
+	const char  *path,					// index path
+	int   threads,						// number of threads of selection
+	int   in_mem,						// keep candidates in memory (0 or 1)
+	int   packed)						// write packed candidate file (0 or 1)
 {
 	// -------------------------------------------------------------------------
 	//  init parameters
@@ -52,7 +62,7 @@ int RQALSH_STAR::build(				// build index
 	g_memory += SIZEINT * n_cand;
 	cand_ = new int[n_cand];
 
-	data_dependent_select(data, cand_);
+	data_dependent_select(data, threads, cand_);
 
 	// -------------------------------------------------------------------------
 	//  build rqalsh for representative data if necessary
@@ -67,7 +77,7 @@ int RQALSH_STAR::build(				// build index
 		}
 
 		lsh_ = new RQALSH();
-		lsh_->build(n_cand, dim_, B_, beta, delta, ratio, 
+		lsh_->build(n_cand, dim_, B_, beta, delta, ratio, family, 
 			(const float **) cand_data, path_);
 
 		for (int i = 0; i < n_cand; ++i) {
@@ -93,65 +103,99 @@ int RQALSH_STAR::build(				// build index
 	fwrite(cand_,   SIZEINT, n_cand, fp);
 	fclose(fp);
 
+	// -------------------------------------------------------------------------
+	//  keep the candidates in memory as an aligned matrix if necessary
+	// -------------------------------------------------------------------------
+	if (in_mem) {
+		g_memory += SIZEFLOAT * n_cand * pad_dim(dim_);
+		cand_data_ = new_matrix(n_cand, dim_);
+		for (int i = 0; i < n_cand; ++i) {
+			memcpy(&cand_data_[(uint64_t) i * pad_dim(dim_)], data[cand_[i]], 
+				dim_ * SIZEFLOAT);
+		}
+		if (lsh_ != NULL) lsh_->set_resident(cand_data_);
+
+		strcpy(fname, path_); strcat(fname, "rqalsh_star_data");
+		fp = fopen(fname, "wb");
+		if (!fp) { printf("Could not create %s\n", fname); return 1; }
+
+		write_matrix(n_cand, dim_, cand_data_, fp);
+		fclose(fp);
+	}
+
+	// -------------------------------------------------------------------------
+	//  write the candidates to their own packed data file if necessary
+	// -------------------------------------------------------------------------
+	if (packed) {
+		strcpy(pack_path_, path_); strcat(pack_path_, "rqalsh_star_cand");
+		if (write_packed_data(n_cand, dim_, B_, cand_, data, pack_path_)) {
+			return 1;
+		}
+		if (lsh_ != NULL) lsh_->set_packed(pack_path_);
+	}
 	return 0;
 }
 
+// -----------------------------------------------------------------------------
+//  each iteration scores the runs of ids in parallel, and merges the top-M of
+//  the runs and their largest norms in the order of ids (see Select_Round)
 // -----------------------------------------------------------------------------
 void RQALSH_STAR::data_dependent_select( // data dependent selection
 	const float **data,					// data objects
+	int   threads,						// number of threads
 	int   *cand)						// candidate id (return)
 {
 	// -------------------------------------------------------------------------
-	//  calc the shift data
+	//  calc the centroid and the l2-norm of shift data
 	// -------------------------------------------------------------------------
 	int   max_id = -1;
 	float max_norm = -1.0f;
 	float *norm = new float[n_pts_];
-	float **shift_data = new float*[n_pts_];
-	for (int i = 0; i < n_pts_; ++i) shift_data[i] = new float[dim_];
+	float *centroid = new float[dim_];
 
-	calc_shift_data(data, max_id, max_norm, norm, shift_data);
+	calc_shift_norm(data, centroid, max_id, max_norm, norm);
 
 	// -------------------------------------------------------------------------
 	//  data dependent selection
 	// -------------------------------------------------------------------------
+	int    chunks = std::max(1, std::min(threads, n_pts_));
 	float  *proj  = new float[dim_];
 	Result *score = new Result[n_pts_];
+	Result *top   = new Result[chunks * M_];
+
+	Select_Round round;
+	round.n_           = n_pts_;
+	round.d_           = dim_;
+	round.m_           = M_;
+	round.chunks_      = chunks;
+	round.data_        = data;
+	round.centroid_    = centroid;
+	round.proj_        = proj;
+	round.norm_        = norm;
+	round.close_angle_ = NULL;
+	round.score_       = score;
+	round.max_id_      = new int[chunks];
+	round.max_norm_    = new float[chunks];
 
 	for (int i = 0; i < L_; ++i) {
 		// ---------------------------------------------------------------------
 		//  select the projection vector with largest norm and normalize it
 		// ---------------------------------------------------------------------
 		for (int j = 0; j < dim_; ++j) {
-			proj[j] = shift_data[max_id][j] / norm[max_id];
+			proj[j] = (data[max_id][j] - centroid[j]) / norm[max_id];
 		}
 
 		// ---------------------------------------------------------------------
-		//  calculate offsets and distortions
+		//  calculate offsets and distortions, and the top-M of each run
 		// ---------------------------------------------------------------------
-		for (int j = 0; j < n_pts_; ++j) {
-			if (norm[j] >= 0.0f) {
-				float offset = calc_inner_product(dim_, shift_data[j], proj);
-
-				float distortion = 0.0F;
-				for (int k = 0; k < dim_; ++k) {
-					distortion += SQR(shift_data[j][k] - offset * proj[k]);
-				}
-				score[j].id_  = j;
-				score[j].key_ = offset * offset - distortion;
-			}
-			else {
-				score[j].id_  = j;
-				score[j].key_ = MINREAL;
-			}
-		}
+		parallel_for(chunks, threads, score_task, &round);
 
 		// ---------------------------------------------------------------------
 		//  collect the objects that are well-represented by this projection
 		// ---------------------------------------------------------------------
-		qsort(score, n_pts_, sizeof(Result), ResultCompDesc);
+		merge_top_m(&round, top);
 		for (int j = 0; j < M_; ++j) {
-			int id = score[j].id_;
+			int id = top[j].id_;
 
 			cand[i * M_ + j] = id;
 			norm[id] = -1.0f;
@@ -160,37 +204,63 @@ void RQALSH_STAR::data_dependent_select( // data dependent selection
 		// ---------------------------------------------------------------------
 		//  find the next largest norm and the corresponding object
 		// ---------------------------------------------------------------------
-		max_id = -1;
-		max_norm = -1.0f;
-		for (int j = 0; j < n_pts_; ++j) {
-			if (norm[j] > max_norm) { max_norm = norm[j]; max_id = j; }
-		}
+		parallel_for(chunks, threads, max_norm_task, &round);
+		max_id = merge_max_norm(&round, max_norm);
 	}
 	// -------------------------------------------------------------------------
 	//  release space
 	// -------------------------------------------------------------------------
-	delete[] norm;  norm  = NULL;
-	delete[] proj;  proj  = NULL;
-	delete[] score; score = NULL;
+	delete[] norm;     norm     = NULL;
+	delete[] proj;     proj     = NULL;
+	delete[] score;    score    = NULL;
+	delete[] centroid; centroid = NULL;
+	delete[] top;      top      = NULL;
+	delete[] round.max_id_;   round.max_id_   = NULL;
+	delete[] round.max_norm_; round.max_norm_ = NULL;
+}
 
-	for (int i = 0; i < n_pts_; ++i) {
-		delete[] shift_data[i]; shift_data[i] = NULL;
+// -----------------------------------------------------------------------------
+void RQALSH_STAR::score_task(		// score one run of ids
+	int   tid,							// thread id
+	int   c,							// run id
+	void  *arg)							// round of selection (Select_Round)
+{
+	Select_Round *round = (Select_Round*) arg;
+	int   dim  = round->d_;
+	const float *proj = round->proj_;
+	const float *norm = round->norm_;
+	Result *score = round->score_;
+
+	int lo = chunk_begin(round->n_, round->chunks_, c);
+	int hi = chunk_begin(round->n_, round->chunks_, c + 1);
+	for (int j = lo; j < hi; ++j) {
+		if (norm[j] >= 0.0f) {
+			float offset = calc_shift_inner_product(dim, round->data_[j], 
+				round->centroid_, proj);
+			float distortion = SQR(norm[j]) - offset * offset;
+			score[j].id_  = j;
+			score[j].key_ = offset * offset - distortion;
+		}
+		else {
+			score[j].id_  = j;
+			score[j].key_ = MINREAL;
+		}
 	}
-	delete[] shift_data; shift_data = NULL;
+	top_m_desc(hi - lo, round->m_, &score[lo]);
 }
 
 // -----------------------------------------------------------------------------
-void RQALSH_STAR::calc_shift_data( 	// calculate shift data objects
+void RQALSH_STAR::calc_shift_norm(	// calc centroid and l2-norm of shift data
 	const float **data,					// data objects
+	float *centroid,					// centroid of data objects (return)
 	int   &max_id,						// data id with max l2-norm (return)
 	float &max_norm,					// max l2-norm (return)
-	float *norm,						// l2-norm of shift data (return)
-	float **shift_data) 				// shift data (return)
+	float *norm)						// l2-norm of shift data (return)
 {
 	// -------------------------------------------------------------------------
 	//  calculate the centroid of data objects
 	// -------------------------------------------------------------------------
-	std::vector<float> centroid(dim_, 0.0f);
+	memset(centroid, 0, dim_ * SIZEFLOAT);
 	for (int i = 0; i < n_pts_; ++i) {
 		for (int j = 0; j < dim_; ++j) {
 			centroid[j] += data[i][j];
@@ -199,7 +269,7 @@ void RQALSH_STAR::calc_shift_data( 	// calculate shift data objects
 	for (int i = 0; i < dim_; ++i) centroid[i] /= n_pts_;
 
 	// -------------------------------------------------------------------------
-	//  calc shift data and their l2-norm and find max l2-norm and its id
+	//  calc l2-norm of shift data and find max l2-norm and its id
 	// -------------------------------------------------------------------------
 	max_id   = -1;
 	max_norm = MINREAL;
@@ -208,7 +278,6 @@ void RQALSH_STAR::calc_shift_data( 	// calculate shift data objects
 		norm[i] = 0.0f;
 		for (int j = 0; j < dim_; ++j) {
 			float tmp = data[i][j] - centroid[j];
-			shift_data[i][j] = tmp;
 			norm[i] += SQR(tmp);
 		}
 		norm[i] = sqrt(norm[i]);
@@ -226,6 +295,8 @@ void RQALSH_STAR::display()			// display parameters
 	printf("    B    = %d\n", B_);
 	printf("    L    = %d\n", L_);
 	printf("    M    = %d\n", M_);
+	printf("    mem  = %s\n", cand_data_ != NULL ? "yes" : "no");
+	printf("    pack = %s\n", pack_path_[0] != '\0' ? "yes" : "no");
 	printf("    path = %s\n", path_);
 	printf("\n");
 }
@@ -262,40 +333,118 @@ int RQALSH_STAR::load(				// restore parameters
 	// -------------------------------------------------------------------------
 	if (n_cand > CANDIDATES) {
 		lsh_ = new RQALSH();
-		lsh_->load(path_);
+		if (lsh_->load(path_)) return 1;
+	}
+
+	// -------------------------------------------------------------------------
+	//  load candidates in memory if they are kept
+	// -------------------------------------------------------------------------
+	strcpy(fname, path_); strcat(fname, "rqalsh_star_data");
+	fp = fopen(fname, "rb");
+	if (fp) {
+		g_memory += SIZEFLOAT * n_cand * pad_dim(dim_);
+		cand_data_ = new_matrix(n_cand, dim_);
+		read_matrix(n_cand, dim_, cand_data_, fp);
+		fclose(fp);
+
+		if (lsh_ != NULL) lsh_->set_resident(cand_data_);
+	}
+
+	// -------------------------------------------------------------------------
+	//  read candidates from their packed data file if it exists
+	// -------------------------------------------------------------------------
+	strcpy(fname, path_); strcat(fname, "rqalsh_star_cand");
+	fp = fopen(fname, "rb");
+	if (fp) {
+		fclose(fp);
+		strcpy(pack_path_, fname);
+		if (lsh_ != NULL) lsh_->set_packed(pack_path_);
 	}
 	return 0;
 }
 
+// -----------------------------------------------------------------------------
+void RQALSH_STAR::calc_hash_values(	// calc hash values of a batch of queries
+	int   qn,							// number of queries
+	const float **query,				// queries
+	float *q_val) const					// qn x m hash values (return)
+{
+	if (lsh_ != NULL) lsh_->calc_hash_values(qn, query, q_val);
+}
+
 // -----------------------------------------------------------------------------
 uint64_t RQALSH_STAR::kfn(			// c-k-AFN search
 	int top_k,							// top-k value
 	const float *query,					// query object
 	const char *data_folder,			// data folder
-	MaxK_List *list)					// k-FN results (return)
+	MaxK_List *list,					// k-FN results (return)
+	const float *q_val,					// hash values of query (optional)
+	RQALSH_Context *ctx,				// search context (optional)
+	const uint64_t *allow) const		// allow-list (optional)
 {
 	// -------------------------------------------------------------------------
 	//  use index to speed up c-k-AFN search
 	// -------------------------------------------------------------------------
 	int n_cand = L_ * M_;
-	int candidates = CANDIDATES + top_k - 1;
-
-	if (n_cand > candidates) {
-		return lsh_->kfn(top_k, query, (const int*) cand_, data_folder, list);
+	int budget = CANDIDATES;
+	if (ctx != NULL && ctx->max_cand_ > 0) budget = ctx->max_cand_;
+	int candidates = budget + top_k - 1;
+
+	if (lsh_ != NULL && n_cand > candidates) {
+		RQALSH_Context *own = NULL;	// context of this query only
+		if (ctx == NULL && allow != NULL) ctx = own = new RQALSH_Context(lsh_);
+		if (ctx != NULL) ctx->allow_ = allow;
+
+		uint64_t io = lsh_->kfn(top_k, query, (const int*) cand_, data_folder, 
+			list, q_val, ctx);
+		if (own != NULL) { delete own; own = NULL; }
+		return io;
 	}
 
 	// -------------------------------------------------------------------------
 	//  otherwise, linear scan directly
 	// -------------------------------------------------------------------------
-	float *data = new float[dim_];		
-	for (int i = 0; i < n_cand; ++i) {
-		int id  = cand_[i];
-		read_data_new_format(id, dim_, B_, data_folder, data);
+	Query_Stats *stats = ctx != NULL ? ctx->stats_ : NULL;
+	timeval start_time;
+	if (stats != NULL) {
+		reset_stats(stats);
+		gettimeofday(&start_time, NULL);
+	}
+
+	int num = 0;					// number of verified candidates
+	int io  = 0;					// number of data pages read
+	if (cand_data_ == NULL && pack_path_[0] != '\0') {
+		io = (int) packed_scan(n_cand, dim_, B_, cand_, pack_path_, query, 
+			allow, list, num);
+	}
+	else {
+		float *data = new float[dim_];		
+		for (int i = 0; i < n_cand; ++i) {
+			int id  = cand_[i];
+			if (allow != NULL && !is_allowed(allow, id)) continue;
 
-		float dist = calc_l2_dist(dim_, (const float*) data, query);
-		list->insert(dist, id + 1);
+			float dist = 0.0f;
+			if (cand_data_ != NULL) {
+				const float *obj = &cand_data_[(uint64_t) i * pad_dim(dim_)];
+				dist = calc_l2_dist(dim_, obj, query);
+			}
+			else {
+				read_data_new_format(id, dim_, B_, data_folder, data);
+				dist = calc_l2_dist(dim_, (const float*) data, query);
+				++io;
+			}
+			list->insert(dist, id + 1);
+			++num;
+		}
+		delete[] data; data = NULL;
+	}
+	if (ctx != NULL) ctx->stop_ = STOP_NORMAL;
+	if (stats != NULL) {			// all candidates are verified
+		stats->data_io_     = io;
+		stats->cand_        = num;
+		stats->verify_time_ = elapsed_ms(start_time);
+		stats->stop_        = STOP_NORMAL;
 	}
-	delete[] data; data = NULL;
 	
-	return (uint64_t) n_cand;
+	return (uint64_t) io;
 }
@@ -35,8 +35,12 @@ public:
 		int   beta,						// false positive percentage
 		float delta,					// error probability
 		float ratio,					// approximation ratio
+		int   family,					// family of hash functions
 		const float **data, 			// data objects
-		const char  *path);				// index path
+		const char  *path,				// index path
+		int   threads = 1,				// number of threads of selection
+		int   in_mem = 0,				// keep candidates in memory (0 or 1)
+		int   packed = 0);				// write packed candidate file (0 or 1)
 
 	// -------------------------------------------------------------------------
 	int load(   					// load index
@@ -45,12 +49,32 @@ public:
 	// -------------------------------------------------------------------------
 	void display();			        // display parameters
 
+	// -------------------------------------------------------------------------
+	//  c-k-AFN search. the allow-list is set to the context of the index of
+	//  sample objects, so the candidates out of it are never counted. if the
+	//  candidates are kept in memory, they are verified with no data i/o, and
+	//  if they are packed, they are read from their own dense pages.
 	// -------------------------------------------------------------------------
 	uint64_t kfn(					// c-k-AFN search
 		int   top_k,					// top-k value
 		const float *query,				// query objects
 		const char  *data_folder,		// data folder
-		MaxK_List   *list);				// k-FN results (return)
+		MaxK_List   *list,				// k-FN results (return)
+		const float *q_val = NULL,		// hash values of query (optional)
+		RQALSH_Context *ctx = NULL,		// search context (optional)
+		const uint64_t *allow = NULL) const; // allow-list (optional)
+
+	// -------------------------------------------------------------------------
+	inline int get_num_hashes() { return lsh_ ? lsh_->get_num_tables() : 0; }
+
+	// -------------------------------------------------------------------------
+	inline const RQALSH *get_index() const { return lsh_; }
+
+	// -------------------------------------------------------------------------
+	void calc_hash_values(			// calc hash values of a batch of queries
+		int   qn,						// number of queries
+		const float **query,			// queries
+		float *q_val) const;			// qn x m hash values (return)
 
 protected:
 	int    n_pts_;					// number of data objects
@@ -60,20 +84,29 @@ protected:
 	int    M_;						// number of candidates
 	char   path_[200];				// index path
 	int    *cand_;				    // candidate id
+	float  *cand_data_;				// candidates in memory (or NULL)
+	char   pack_path_[200];			// packed data file of candidates (or "")
 	RQALSH *lsh_;					// index of sample data objects
 
 	// -------------------------------------------------------------------------
 	void data_dependent_select(		// data dependent selection
 		const float **data,				// data objects
+		int  threads,					// number of threads
 		int  *cand);					// candidate id (return)
 
 	// -------------------------------------------------------------------------
-	void calc_shift_data(			// calculate shift data objects
+	static void score_task(			// score one run of ids
+		int   tid,						// thread id
+		int   c,						// run id
+		void  *arg);					// round of selection (Select_Round)
+
+	// -------------------------------------------------------------------------
+	void calc_shift_norm(			// calc centroid and l2-norm of shift data
 		const float **data,				// data objects
+		float *centroid,				// centroid of data objects (return)
 		int   &max_id,					// data id with max l2-norm (return)
 		float &max_norm,				// max l2-norm (return)
-		float *norm,					// l2-norm of shift data (return)
-		float **shift_data); 			// shift data (return)
+		float *norm);					// l2-norm of shift data (return)
 }; 
 
 #endif // __RQALSH_STAR_H
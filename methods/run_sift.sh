@@ -57,6 +57,8 @@ oFolder=${rPath}/rqalsh/
 ./rqalsh -alg 4 -qn ${qn} -d ${d} -qs ${dPath}.q -ts ${dPath}.fn${c} \
     -df ${dFolder} -of ${oFolder}
 
+./rqalsh -alg 10 -qn 100 -of ${oFolder}
+
 # ------------------------------------------------------------------------------
 #  Drusilla_Select
 # ------------------------------------------------------------------------------
@@ -1,5 +1,13 @@
 #include "util.h"
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 timeval  g_start_time;
 timeval  g_end_time;
 
@@ -227,6 +235,206 @@ int read_data_new_format(			// read data with new format from disk
 	return 0;
 }
 
+// -----------------------------------------------------------------------------
+int write_packed_data(				// write candidates to a packed data file
+	int   n,							// number of candidates
+	int   d,							// dimensionality
+	int   B,							// page size
+	const int   *ids,					// ids of candidates
+	const float **data,					// data set
+	const char  *fname)					// file name of packed data
+{
+	int num = packed_num(d, B);		// number of objects in one page
+	if (num <= 0) { printf("Page size %d is too small\n", B); return 1; }
+
+	FILE *fp = fopen(fname, "wb");
+	if (!fp) { printf("Could not create %s\n", fname); return 1; }
+
+	char *buffer = new char[B];		// one buffer page size
+	for (int i = 0; i < n; i += num) {
+		memset(buffer, 0, B * SIZECHAR);
+		for (int j = i; j < n && j < i + num; ++j) {
+			memcpy(&buffer[(j - i) * d * SIZEFLOAT], data[ids[j]], 
+				d * SIZEFLOAT);
+		}
+		fwrite(buffer, B, 1, fp);
+	}
+	fclose(fp);
+	delete[] buffer; buffer = NULL;
+
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+static int read_packed_page(		// read one page of packed data file
+	FILE  *fp,							// packed data file
+	int   page,							// page id
+	int   B,							// page size
+	float *buf)							// buffer of one page (return)
+{
+	if (fseek(fp, (long) page * B, SEEK_SET) != 0 || 
+		fread(buf, B, 1, fp) != 1) {
+		printf("Could not read page %d of packed data file\n", page);
+		return 1;
+	}
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+int open_packed_file(				// open a packed data file
+	int   B,							// page size
+	const char *fname,					// file name of packed data
+	Packed_File *pf)					// packed data file (return)
+{
+	pf->num_pages_ = 0;
+	pf->read_ = NULL;
+	pf->buf_  = NULL;
+	pf->io_   = 0;
+	pf->fp_   = fopen(fname, "rb");
+	if (!pf->fp_) { printf("Could not open %s\n", fname); return 1; }
+
+	if (fseek(pf->fp_, 0, SEEK_END) != 0) {
+		printf("Could not read %s\n", fname);
+		fclose(pf->fp_); pf->fp_ = NULL;
+		return 1;
+	}
+	pf->num_pages_ = (int) (ftell(pf->fp_) / B);
+	pf->read_ = new bool[pf->num_pages_];
+	pf->buf_  = new float[(uint64_t) pf->num_pages_ * B / SIZEFLOAT];
+	reset_packed_file(pf);
+
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+void reset_packed_file(				// forget the pages read so far
+	Packed_File *pf)					// packed data file
+{
+	if (pf->read_ != NULL) memset(pf->read_, 0, pf->num_pages_ * sizeof(bool));
+	pf->io_ = 0;
+}
+
+// -----------------------------------------------------------------------------
+void close_packed_file(				// close a packed data file
+	Packed_File *pf)					// packed data file
+{
+	if (pf->fp_   != NULL) { fclose(pf->fp_);   pf->fp_   = NULL; }
+	if (pf->read_ != NULL) { delete[] pf->read_; pf->read_ = NULL; }
+	if (pf->buf_  != NULL) { delete[] pf->buf_;  pf->buf_  = NULL; }
+	pf->num_pages_ = 0;
+}
+
+// -----------------------------------------------------------------------------
+//  the page of object <pos> is read only if it has not been read since the 
+//  last reset. return the object in the buffer, or NULL if its page cannot be
+//  read.
+// -----------------------------------------------------------------------------
+const float *read_packed_object(	// read an object from packed data file
+	int   pos,							// position of object
+	int   d,							// dimensionality
+	int   B,							// page size
+	Packed_File *pf)					// packed data file
+{
+	int num  = packed_num(d, B);
+	int page = pos / num;
+	if (page >= pf->num_pages_) {
+		printf("Object %d is out of packed data file\n", pos);
+		return NULL;
+	}
+	float *buf = &pf->buf_[(uint64_t) page * B / SIZEFLOAT];
+	if (!pf->read_[page]) {
+		if (read_packed_page(pf->fp_, page, B, buf)) return NULL;
+		pf->read_[page] = true;
+		++pf->io_;
+	}
+	return &buf[(pos % num) * d];
+}
+
+// -----------------------------------------------------------------------------
+//  the candidates are verified in the order of the file, so each page is read
+//  once, and a page without allowed candidates is not read at all. the scan 
+//  stops at a page that cannot be read. return the number of pages read.
+// -----------------------------------------------------------------------------
+uint64_t packed_scan(				// verify all candidates of packed file
+	int   n,							// number of candidates
+	int   d,							// dimensionality
+	int   B,							// page size
+	const int   *ids,					// ids of candidates
+	const char  *fname,					// file name of packed data
+	const float *query,					// query object
+	const uint64_t *allow,				// allow-list (or NULL)
+	MaxK_List   *list,					// k-FN results (return)
+	int   &num)							// number of verified candidates (return)
+{
+	num = 0;
+	FILE *fp = fopen(fname, "rb");
+	if (!fp) { printf("Could not open %s\n", fname); return 0; }
+
+	int   per  = packed_num(d, B);
+	int   cur  = -1;				// page in buffer
+	float *page = new float[B / SIZEFLOAT];
+	uint64_t io = 0;
+	for (int i = 0; i < n; ++i) {
+		int id = ids[i];
+		if (allow != NULL && !is_allowed(allow, id)) continue;
+
+		if (i / per != cur) {
+			cur = i / per;
+			if (read_packed_page(fp, cur, B, page)) break;
+			++io;
+		}
+		float dist = calc_l2_dist(d, &page[(i % per) * d], query);
+		list->insert(dist, id + 1);
+		++num;
+	}
+	fclose(fp);
+	delete[] page; page = NULL;
+
+	return io;
+}
+
+// -----------------------------------------------------------------------------
+//  the allowed candidates are copied to the rows of <mat> in their order, and
+//  <pos> keeps the position of each row. as packed_scan, a page is read only
+//  if it has an allowed candidate.
+// -----------------------------------------------------------------------------
+uint64_t read_packed_data(			// read allowed candidates of packed file
+	int   n,							// number of candidates
+	int   d,							// dimensionality
+	int   B,							// page size
+	const int   *ids,					// ids of candidates
+	const char  *fname,					// file name of packed data
+	const uint64_t *allow,				// allow-list (or NULL)
+	int   *pos,							// positions of rows (return)
+	float *mat,							// rows from new_matrix (return)
+	int   &num)							// number of rows (return)
+{
+	num = 0;
+	FILE *fp = fopen(fname, "rb");
+	if (!fp) { printf("Could not open %s\n", fname); return 0; }
+
+	int   ld   = pad_dim(d);
+	int   per  = packed_num(d, B);
+	int   cur  = -1;				// page in buffer
+	float *page = new float[B / SIZEFLOAT];
+	uint64_t io = 0;
+	for (int i = 0; i < n; ++i) {
+		if (allow != NULL && !is_allowed(allow, ids[i])) continue;
+
+		if (i / per != cur) {
+			cur = i / per;
+			if (read_packed_page(fp, cur, B, page)) break;
+			++io;
+		}
+		memcpy(&mat[(uint64_t) num * ld], &page[(i % per) * d], d * SIZEFLOAT);
+		pos[num++] = i;
+	}
+	fclose(fp);
+	delete[] page; page = NULL;
+
+	return io;
+}
+
 // -----------------------------------------------------------------------------
 inline int read_buffer_from_page(	// read buffer from page
 	int   B,							// page size
@@ -259,6 +467,7 @@ inline void read_data_from_buffer(	// read data from buffer
 // -----------------------------------------------------------------------------
 int read_ground_truth(				// read ground truth results from disk
 	int    qn,							// number of query objects
+	int    max_k,						// number of results per query
 	const  char *fname,					// address of truth set
 	Result **R)							// ground truth results (return)
 {
@@ -272,11 +481,18 @@ int read_ground_truth(				// read ground truth results from disk
 	int tmp1 = -1;
 	int tmp2 = -1;
 	fscanf(fp, "%d %d\n", &tmp1, &tmp2);
-	assert(tmp1 == qn && tmp2 == MAXK);
+	if (tmp1 != qn || tmp2 < max_k) {
+		printf("%s has %d queries with top-%d, but %d with top-%d needed\n",
+			fname, tmp1, tmp2, qn, max_k);
+		fclose(fp);
+		return 1;
+	}
 
+	Result skip;					// a truth set with a larger k is fine
 	for (int i = 0; i < qn; ++i) {
-		for (int j = 0; j < MAXK; ++j) {
-			fscanf(fp, "%d %f ", &R[i][j].id_, &R[i][j].key_);
+		for (int j = 0; j < tmp2; ++j) {
+			Result *r = j < max_k ? &R[i][j] : &skip;
+			fscanf(fp, "%d %f ", &r->id_, &r->key_);
 		}
 		fscanf(fp, "\n");
 	}
@@ -316,6 +532,423 @@ float calc_inner_product(			// calc inner product (data type is float)
 	return ret;
 }
 
+// -----------------------------------------------------------------------------
+//  SIMD vectors for the kernels below (AVX if enabled, otherwise SSE2)
+// -----------------------------------------------------------------------------
+#if defined(__AVX__)
+typedef __m256 vfloat;
+const int VLEN = 8;
+#define VZERO()      _mm256_setzero_ps()
+#define VLOAD(p)     _mm256_loadu_ps(p)
+#define VADD(a, b)   _mm256_add_ps(a, b)
+#define VMUL(a, b)   _mm256_mul_ps(a, b)
+#define VSUB(a, b)   _mm256_sub_ps(a, b)
+
+static inline float vsum(vfloat v)	// horizontal sum of a vector
+{
+	__m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+	x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+	return _mm_cvtss_f32(x);
+}
+#elif defined(__SSE2__)
+typedef __m128 vfloat;
+const int VLEN = 4;
+#define VZERO()      _mm_setzero_ps()
+#define VLOAD(p)     _mm_loadu_ps(p)
+#define VADD(a, b)   _mm_add_ps(a, b)
+#define VMUL(a, b)   _mm_mul_ps(a, b)
+#define VSUB(a, b)   _mm_sub_ps(a, b)
+
+static inline float vsum(vfloat v)	// horizontal sum of a vector
+{
+	__m128 x = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+	return _mm_cvtss_f32(x);
+}
+#endif
+
+// -----------------------------------------------------------------------------
+//  the shift object <p1> - <c> is formed in registers, so the data dependent 
+//  selection needs no shifted copy of the data set
+// -----------------------------------------------------------------------------
+float calc_shift_inner_product(		// calc inner product of (p1 - c) and p2
+	int   dim,							// dimension
+	const float *p1,					// 1st point
+	const float *c,						// shift of 1st point (e.g., centroid)
+	const float *p2)					// 2nd point
+{
+	int   i   = 0;
+	float ret = 0.0f;
+#if defined(__SSE2__)
+	vfloat acc = VZERO();
+	for (; i + VLEN <= dim; i += VLEN) {
+		vfloat s = VSUB(VLOAD(p1 + i), VLOAD(c + i));
+		acc = VADD(acc, VMUL(s, VLOAD(p2 + i)));
+	}
+	ret = vsum(acc);
+#endif
+	for (; i < dim; ++i) ret += (p1[i] - c[i]) * p2[i];
+
+	return ret;
+}
+
+// -----------------------------------------------------------------------------
+//  micro-kernel: inner products of <R> rows of <p1> and <C> rows of <p2> over
+//  <len> dimensions, which are accumulated into <ret> (row stride <ld>)
+// -----------------------------------------------------------------------------
+template<int R, int C>
+static inline void dot_kernel(
+	int   len,							// number of dimensions
+	const float **p1,					// <R> rows of 1st set
+	const float **p2,					// <C> rows of 2nd set
+	int   ld,							// row stride of <ret>
+	float *ret)							// inner products (return)
+{
+	int k = 0;
+	float sum[R][C];
+#if defined(__SSE2__)
+	vfloat acc[R][C];
+	for (int r = 0; r < R; ++r) {
+		for (int c = 0; c < C; ++c) acc[r][c] = VZERO();
+	}
+	for (; k + VLEN <= len; k += VLEN) {
+		vfloat b[C];
+		for (int c = 0; c < C; ++c) b[c] = VLOAD(p2[c] + k);
+		for (int r = 0; r < R; ++r) {
+			vfloat a = VLOAD(p1[r] + k);
+			for (int c = 0; c < C; ++c) acc[r][c] = VADD(acc[r][c], VMUL(a, b[c]));
+		}
+	}
+	for (int r = 0; r < R; ++r) {
+		for (int c = 0; c < C; ++c) sum[r][c] = vsum(acc[r][c]);
+	}
+#else
+	for (int r = 0; r < R; ++r) {
+		for (int c = 0; c < C; ++c) sum[r][c] = 0.0f;
+	}
+#endif
+	for (; k < len; ++k) {
+		for (int r = 0; r < R; ++r) {
+			for (int c = 0; c < C; ++c) sum[r][c] += p1[r][k] * p2[c][k];
+		}
+	}
+	for (int r = 0; r < R; ++r) {
+		for (int c = 0; c < C; ++c) ret[r * ld + c] += sum[r][c];
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  the dimensions are split into blocks of <GEMM_BLK_D> and the rows of <p2>
+//  into blocks of <GEMM_BLK_N>, so that one block of <p2> stays in cache while
+//  it is multiplied with all rows of <p1>. each step of the inner loop is a
+//  4 x 2 register block, i.e., 6 loads for 8 multiply-adds.
+// -----------------------------------------------------------------------------
+void calc_inner_products(			// calc inner products of two sets (GEMM)
+	int   n1,							// number of objects in 1st set
+	int   n2,							// number of objects in 2nd set
+	int   dim,							// dimension
+	const float **p1,					// 1st set (e.g., query set)
+	const float *p2,					// 2nd set (e.g., hash functions)
+	int   ld,							// row stride of <p2>
+	float *ret)							// n1 x n2 inner products (return)
+{
+	memset(ret, 0, (uint64_t) n1 * n2 * SIZEFLOAT);
+
+	const float *a[4];
+	const float *b[4];
+	for (int k0 = 0; k0 < dim; k0 += GEMM_BLK_D) {
+		int len = MIN(GEMM_BLK_D, dim - k0);
+
+		for (int j0 = 0; j0 < n2; j0 += GEMM_BLK_N) {
+			int j1 = MIN(j0 + GEMM_BLK_N, n2);
+
+			int i = 0;
+			for (; i + 4 <= n1; i += 4) {
+				for (int r = 0; r < 4; ++r) a[r] = p1[i + r] + k0;
+
+				int j = j0;
+				for (; j + 2 <= j1; j += 2) {
+					b[0] = p2 + (uint64_t) j * ld + k0; b[1] = b[0] + ld;
+					dot_kernel<4, 2>(len, a, b, n2, &ret[i * n2 + j]);
+				}
+				if (j < j1) {
+					b[0] = p2 + (uint64_t) j * ld + k0;
+					dot_kernel<4, 1>(len, a, b, n2, &ret[i * n2 + j]);
+				}
+			}
+			// -----------------------------------------------------------------
+			//  the rest rows (e.g., a single query) are GEMV with 1 x 4 
+			//  blocks, i.e., 5 loads for 4 multiply-adds
+			// -----------------------------------------------------------------
+			for (; i < n1; ++i) {
+				a[0] = p1[i] + k0;
+				int j = j0;
+				for (; j + 4 <= j1; j += 4) {
+					b[0] = p2 + (uint64_t) j * ld + k0;
+					b[1] = b[0] + ld; b[2] = b[1] + ld; b[3] = b[2] + ld;
+					dot_kernel<1, 4>(len, a, b, n2, &ret[i * n2 + j]);
+				}
+				for (; j < j1; ++j) {
+					b[0] = p2 + (uint64_t) j * ld + k0;
+					dot_kernel<1, 1>(len, a, b, n2, &ret[i * n2 + j]);
+				}
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  the projection matrices are stored row by row in one block aligned to 
+//  <ALIGN_BYTES>, and each row is padded with zeros to a multiple of it, so 
+//  that each row starts at a cache line
+// -----------------------------------------------------------------------------
+int pad_dim(						// row stride of an aligned matrix
+	int   dim)							// dimension
+{
+	int num = ALIGN_BYTES / SIZEFLOAT;
+	return (dim + num - 1) / num * num;
+}
+
+// -----------------------------------------------------------------------------
+float* new_matrix(					// new aligned matrix (zero padded)
+	int   rows,							// number of rows
+	int   dim)							// dimension (stride: pad_dim(dim))
+{
+	uint64_t size = (uint64_t) rows * pad_dim(dim) * SIZEFLOAT;
+	void *mat = NULL;
+	if (posix_memalign(&mat, ALIGN_BYTES, size > 0 ? size : ALIGN_BYTES)) {
+		return NULL;
+	}
+	memset(mat, 0, size);
+	return (float*) mat;
+}
+
+// -----------------------------------------------------------------------------
+void delete_matrix(					// delete aligned matrix
+	float *mat)							// matrix from new_matrix
+{
+	free(mat);
+}
+
+// -----------------------------------------------------------------------------
+void write_matrix(					// write aligned matrix (without padding)
+	int   rows,							// number of rows
+	int   dim,							// dimension
+	const float *mat,					// matrix from new_matrix
+	FILE  *fp)							// file pointer
+{
+	int ld = pad_dim(dim);
+	if (ld == dim) {
+		fwrite(mat, SIZEFLOAT, (uint64_t) rows * dim, fp);
+		return;
+	}
+	float *buf = new float[(uint64_t) rows * dim];
+	for (int i = 0; i < rows; ++i) {
+		memcpy(&buf[(uint64_t) i * dim], &mat[(uint64_t) i * ld], 
+			dim * SIZEFLOAT);
+	}
+	fwrite(buf, SIZEFLOAT, (uint64_t) rows * dim, fp);
+	delete[] buf; buf = NULL;
+}
+
+// -----------------------------------------------------------------------------
+//  the rows are read by one fread into the front of the matrix, and then they
+//  are moved to their padded positions from the last one backwards
+// -----------------------------------------------------------------------------
+void read_matrix(					// read aligned matrix (without padding)
+	int   rows,							// number of rows
+	int   dim,							// dimension
+	float *mat,							// matrix from new_matrix (return)
+	FILE  *fp)							// file pointer
+{
+	int ld = pad_dim(dim);
+	fread(mat, SIZEFLOAT, (uint64_t) rows * dim, fp);
+	if (ld == dim) return;
+
+	for (int i = rows - 1; i >= 0; --i) {
+		float *row = &mat[(uint64_t) i * ld];
+		memmove(row, &mat[(uint64_t) i * dim], dim * SIZEFLOAT);
+		memset(row + dim, 0, (ld - dim) * SIZEFLOAT);
+	}
+}
+
+// -----------------------------------------------------------------------------
+int hadamard_dim(					// size of Hadamard transform
+	int   dim)							// dimension
+{
+	int hdim = 1;
+	while (hdim < dim) hdim <<= 1;
+	return hdim;
+}
+
+// -----------------------------------------------------------------------------
+void fwht(							// fast Walsh-Hadamard transform (in-place)
+	int   hdim,							// size (power of 2)
+	float *x)							// vector (return)
+{
+	for (int h = 1; h < hdim; h <<= 1) {
+		for (int i = 0; i < hdim; i += h << 1) {
+			float *u = &x[i];
+			float *v = &x[i + h];
+			for (int j = 0; j < h; ++j) {
+				float a = u[j], b = v[j];
+				u[j] = a + b;
+				v[j] = a - b;
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  <ret> = H D_3 H D_2 H D_1 [data; 0] / hdim, where H is the (unnormalized) 
+//  Hadamard matrix and D_i are the random sign diagonals. the first two 
+//  rounds are orthonormal up to the scale, so each projection is close to 
+//  the one by a N(0, 1) vector, i.e., its variance is ||data||^2.
+// -----------------------------------------------------------------------------
+void calc_hadamard_proj(			// calc one block of Hadamard projections
+	int   dim,							// dimension
+	int   hdim,							// size of transform (power of 2)
+	const float *sign,					// HADAMARD_ROUNDS x hdim sign diagonals
+	const float *data,					// one data object
+	float *ret)							// hdim projections (return)
+{
+	for (int j = 0; j < dim; ++j) ret[j] = data[j] * sign[j];
+	for (int j = dim; j < hdim; ++j) ret[j] = 0.0f;
+	fwht(hdim, ret);
+
+	for (int r = 1; r < HADAMARD_ROUNDS; ++r) {
+		const float *s = &sign[r * hdim];
+		for (int j = 0; j < hdim; ++j) ret[j] *= s[j];
+		fwht(hdim, ret);
+	}
+
+	float scale = 1.0f / (float) pow((float) hdim, 
+		(HADAMARD_ROUNDS - 1) / 2.0f);
+	for (int j = 0; j < hdim; ++j) ret[j] *= scale;
+}
+
+// -----------------------------------------------------------------------------
+//  projection t is the (t % hdim)-th output of block (t / hdim), and each
+//  block has its own HADAMARD_ROUNDS sign diagonals in <sign>
+// -----------------------------------------------------------------------------
+void calc_hadamard_projs(			// calc Hadamard projections of a set
+	int   n,							// number of objects
+	int   dim,							// dimension
+	int   hdim,							// size of transform (power of 2)
+	int   t0,							// first projection id
+	int   t1,							// last projection id (exclusive)
+	const float *sign,					// blocks of sign diagonals
+	const float **data,					// objects
+	float *ret)							// n x (t1 - t0) projections (return)
+{
+	int   num = t1 - t0;
+	float *buf = new float[hdim];
+	for (int i = 0; i < n; ++i) {
+		float *val = &ret[(uint64_t) i * num];
+		for (int b = t0 / hdim; b * hdim < t1; ++b) {
+			calc_hadamard_proj(dim, hdim, &sign[b * HADAMARD_ROUNDS * hdim], 
+				data[i], buf);
+
+			int lo = std::max(t0, b * hdim);
+			int hi = std::min(t1, (b + 1) * hdim);
+			for (int t = lo; t < hi; ++t) val[t - t0] = buf[t - b * hdim];
+		}
+	}
+	delete[] buf; buf = NULL;
+}
+
+// -----------------------------------------------------------------------------
+void write_signs(					// write sign diagonals (one byte each)
+	int   size,							// number of signs
+	const float *sign,					// signs (+1 or -1)
+	FILE  *fp)							// file pointer
+{
+	char *buf = new char[size];
+	for (int i = 0; i < size; ++i) buf[i] = sign[i] > 0.0f ? 1 : -1;
+	fwrite(buf, SIZECHAR, size, fp);
+	delete[] buf; buf = NULL;
+}
+
+// -----------------------------------------------------------------------------
+void read_signs(					// read sign diagonals (one byte each)
+	int   size,							// number of signs
+	float *sign,						// signs (+1 or -1) (return)
+	FILE  *fp)							// file pointer
+{
+	char *buf = new char[size];
+	fread(buf, SIZECHAR, size, fp);
+	for (int i = 0; i < size; ++i) sign[i] = buf[i] > 0 ? 1.0f : -1.0f;
+	delete[] buf; buf = NULL;
+}
+
+// -----------------------------------------------------------------------------
+//  subspace iteration V <- orth(X^T X V) over the centered objects X. the 
+//  rows of V are orthonormalized by Gram-Schmidt in order, so the i-th row 
+//  converges to the i-th principal direction. a row which is dependent on
+//  the previous ones (rank of X < k) is left as zero.
+// -----------------------------------------------------------------------------
+void calc_pca(						// calc top principal directions
+	int   n,							// number of objects
+	int   d,							// dimension
+	int   k,							// number of directions
+	int   iters,						// number of subspace iterations
+	const float **data,					// objects
+	float *ret)							// k x d start / unit directions (return)
+{
+	float *mean = new float[d];
+	float *x    = new float[(uint64_t) n * d];
+	float *next = new float[(uint64_t) k * d];
+	float *y    = new float[k];
+
+	memset(mean, 0, d * SIZEFLOAT);
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < d; ++j) mean[j] += data[i][j];
+	}
+	for (int j = 0; j < d; ++j) mean[j] /= n;
+	for (int i = 0; i < n; ++i) {
+		float *xi = &x[(uint64_t) i * d];
+		for (int j = 0; j < d; ++j) xi[j] = data[i][j] - mean[j];
+	}
+
+	for (int it = 0; it <= iters; ++it) {
+		// ---------------------------------------------------------------------
+		//  the first pass only orthonormalizes the start directions
+		// ---------------------------------------------------------------------
+		if (it > 0) {
+			memset(next, 0, (uint64_t) k * d * SIZEFLOAT);
+			for (int i = 0; i < n; ++i) {
+				const float *xi = &x[(uint64_t) i * d];
+				for (int t = 0; t < k; ++t) {
+					y[t] = calc_inner_product(d, xi, &ret[(uint64_t) t * d]);
+				}
+				for (int t = 0; t < k; ++t) {
+					float *v = &next[(uint64_t) t * d];
+					for (int j = 0; j < d; ++j) v[j] += y[t] * xi[j];
+				}
+			}
+			memcpy(ret, next, (uint64_t) k * d * SIZEFLOAT);
+		}
+		for (int t = 0; t < k; ++t) {
+			float *v = &ret[(uint64_t) t * d];
+			for (int s = 0; s < t; ++s) {
+				const float *u = &ret[(uint64_t) s * d];
+				float proj = calc_inner_product(d, v, u);
+				for (int j = 0; j < d; ++j) v[j] -= proj * u[j];
+			}
+			float norm = sqrt(calc_inner_product(d, v, v));
+			if (norm > FLOATZERO) {
+				for (int j = 0; j < d; ++j) v[j] /= norm;
+			}
+			else memset(v, 0, d * SIZEFLOAT);
+		}
+	}
+	delete[] mean; mean = NULL;
+	delete[] x;    x    = NULL;
+	delete[] next; next = NULL;
+	delete[] y;    y    = NULL;
+}
+
 // -----------------------------------------------------------------------------
 float calc_recall(					// calc recall (percentage)
 	int   k,							// top-k value
@@ -352,7 +985,8 @@ uint64_t linear(					// linear scan search
 	int   top_k,						// top-k value
 	const float *query,					// query object
 	const char  *data_folder,			// data folder
-	MaxK_List   *list)					// k-FN results (return)
+	MaxK_List   *list,					// k-FN results (return)
+	const uint64_t *allow)				// allow-list (optional)
 {
 	// -------------------------------------------------------------------------
 	//  calc <num> and <total_file>, where <num> is the number of data in one 
@@ -390,10 +1024,57 @@ uint64_t linear(					// linear scan search
 		if (i < total_file - 1) size = num;
 		else size = n - num * (total_file - 1);
 
-		for (int j = 0; j < size; ++j) {
+		for (int j = 0; j < size; ++j, ++id) {
+			if (allow != NULL && !is_allowed(allow, id)) continue;
+
+			read_data_from_buffer(j, d, (const char *)buffer, data);
+			dist = calc_l2_dist(d, (const float *) data, query);
+			list->insert(dist, id);
+		}
+	}
+	delete[] buffer; buffer = NULL;
+	delete[] data; data = NULL;
+	
+	return (uint64_t) total_file;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t linear_range(				// linear scan range-FN search
+	int   n,							// number of data objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	float r,							// range (distance threshold)
+	const float *query,					// query object
+	const char  *data_folder,			// data folder
+	Range_Callback callback,			// called for each object beyond <r>
+	void  *arg)							// argument of callback
+{
+	int num = (int) floor((float) B / (d * SIZEFLOAT));
+	int total_file = (int) ceil((float) n / num);
+	if (total_file == 0) return 0;
+
+	char  data_path[200];
+	strcpy(data_path, data_folder);
+	strcat(data_path, "data/");
+
+	int   id      = 0;
+	int   size    = 0;
+	float dist    = -1.0f;
+	char  *buffer = new char[B];	// one page buffer
+	float *data   = new float[d];	// one data object
+
+	for (int i = 0; i < total_file; ++i) {
+		char fname[200];
+		get_data_filename(i, data_path, fname);	
+		read_buffer_from_page(B, fname, buffer);
+
+		if (i < total_file - 1) size = num;
+		else size = n - num * (total_file - 1);
+
+		for (int j = 0; j < size; ++j, ++id) {
 			read_data_from_buffer(j, d, (const char *)buffer, data);
 			dist = calc_l2_dist(d, (const float *) data, query);
-			list->insert(dist, id++);
+			if (dist > r) callback(id, dist, arg);
 		}
 	}
 	delete[] buffer; buffer = NULL;
@@ -402,11 +1083,69 @@ uint64_t linear(					// linear scan search
 	return (uint64_t) total_file;
 }
 
+// -----------------------------------------------------------------------------
+uint64_t linear_nn(					// linear scan c-k-ANN search
+	int   n,							// number of data objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	const float *query,					// query object
+	const char  *data_folder,			// data folder
+	MinK_List   *list)					// k-NN results (return)
+{
+	int num = (int) floor((float) B / (d * SIZEFLOAT));
+	int total_file = (int) ceil((float) n / num);
+	if (total_file == 0) return 0;
+
+	char  data_path[200];
+	strcpy(data_path, data_folder);
+	strcat(data_path, "data/");
+
+	int   id      = 0;
+	int   size    = 0;
+	float dist    = -1.0f;
+	char  *buffer = new char[B];	// one page buffer
+	float *data   = new float[d];	// one data object
+
+	for (int i = 0; i < total_file; ++i) {
+		char fname[200];
+		get_data_filename(i, data_path, fname);	
+		read_buffer_from_page(B, fname, buffer);
+
+		if (i < total_file - 1) size = num;
+		else size = n - num * (total_file - 1);
+
+		for (int j = 0; j < size; ++j, ++id) {
+			read_data_from_buffer(j, d, (const char *)buffer, data);
+			dist = calc_l2_dist(d, (const float *) data, query);
+			list->insert(dist, id + 1);
+		}
+	}
+	delete[] buffer; buffer = NULL;
+	delete[] data; data = NULL;
+	
+	return (uint64_t) total_file;
+}
+
+// -----------------------------------------------------------------------------
+int top_k_values(					// top-k values of the rounds
+	int max_k,							// max top-k value
+	int *top_k)							// top-k values (return, MAX_ROUND+1)
+{
+	int rounds = 0;
+	for (int i = 0; i < MAX_ROUND && TOPK[i] < max_k; ++i) {
+		top_k[rounds++] = TOPK[i];
+	}
+	top_k[rounds++] = max_k;
+
+	return rounds;
+}
+
 // -----------------------------------------------------------------------------
 int ground_truth(					// find ground truth
 	int   n,							// number of data  objects
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
+	int   max_k,						// number of results per query
 	const float **data,					// data set
 	const float **query,				// query set
 	const char  *truth_set) 			// address of truth set
@@ -421,9 +1160,9 @@ int ground_truth(					// find ground truth
 	// -------------------------------------------------------------------------
 	//  find ground truth results (using linear scan method)
 	// -------------------------------------------------------------------------
-	fprintf(fp, "%d %d\n", qn, MAXK);
+	fprintf(fp, "%d %d\n", qn, max_k);
 
-	MaxK_List *list = new MaxK_List(MAXK);
+	MaxK_List *list = new MaxK_List(max_k);
 	for (int i = 0; i < qn; ++i) {
 		list->reset();
 		for (int j = 0; j < n; ++j) {
@@ -431,7 +1170,7 @@ int ground_truth(					// find ground truth
 			list->insert(dist, j + 1);
 		}
 
-		for (int j = 0; j < MAXK; ++j) {
+		for (int j = 0; j < max_k; ++j) {
 			fprintf(fp, "%d %f ", list->ith_id(j), list->ith_key(j));
 		}
 		fprintf(fp, "\n");
@@ -445,4 +1184,167 @@ int ground_truth(					// find ground truth
 	printf("Ground Truth: %f Seconds\n\n", truth_time);
 
 	return 0;
-}
\ No newline at end of file
+}
+
+// -----------------------------------------------------------------------------
+void gen_allow_list(				// generate a random allow-list
+	int   n,							// number of data objects
+	float sel,							// selectivity (fraction allowed)
+	uint64_t *allow)					// allow-list (return)
+{
+	memset(allow, 0, allow_words(n) * sizeof(uint64_t));
+	for (int i = 0; i < n; ++i) {
+		float u = (float) rand() / ((float) RAND_MAX + 1.0f);
+		if (u < sel) allow[i >> 6] |= 1ULL << (i & 63);
+	}
+}
+
+// -----------------------------------------------------------------------------
+//  the k-FN of each query among the allowed objects by linear scan, which 
+//  replace the truth set of the unfiltered search
+// -----------------------------------------------------------------------------
+void filter_truth(					// ground truth of filtered search
+	int   n,							// number of data objects
+	int   qn,							// number of query objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	int   max_k,						// number of results per query
+	const float **query,				// query set
+	const char  *data_folder,			// data folder
+	const uint64_t *allow,				// allow-list
+	Result **R)							// truth set (return)
+{
+	MaxK_List *list = new MaxK_List(max_k);
+	for (int i = 0; i < qn; ++i) {
+		list->reset();
+		linear(n, d, B, max_k, query[i], data_folder, list, allow);
+		for (int j = 0; j < max_k; ++j) {
+			R[i][j].id_  = list->ith_id(j);
+			R[i][j].key_ = list->ith_key(j);
+		}
+	}
+	delete list; list = NULL;
+}
+
+// -----------------------------------------------------------------------------
+float elapsed_ms(					// time (ms) elapsed since <start>
+	const timeval &start)				// start time
+{
+	timeval now;
+	gettimeofday(&now, NULL);
+
+	return (now.tv_sec - start.tv_sec) * 1000.0f + 
+		(now.tv_usec - start.tv_usec) / 1000.0f;
+}
+
+// -----------------------------------------------------------------------------
+void reset_stats(					// reset statistics of a query
+	Query_Stats *stats)					// statistics (return)
+{
+	memset(stats, 0, sizeof(Query_Stats));
+	stats->stop_ = STOP_NONE;
+}
+
+// -----------------------------------------------------------------------------
+void add_radius(					// add one round of radius to statistics
+	float radius,						// radius of this round
+	Query_Stats *stats)					// statistics (return)
+{
+	if (stats->num_radius_ < STATS_RADII) {
+		stats->radius_[stats->num_radius_++] = radius;
+	}
+	++stats->rounds_;
+}
+
+// -----------------------------------------------------------------------------
+//  tasks are claimed one at a time from a shared counter, so that the threads
+//  stay busy even if the cost of tasks (e.g., queries) is uneven. <func> is 
+//  called from <threads> threads at the same time and must be reentrant.
+// -----------------------------------------------------------------------------
+static void run_tasks(				// run tasks of one thread
+	int   tid,							// thread id
+	int   n,							// number of tasks
+	std::atomic<int> *next,				// next task id
+	void  (*func)(int, int, void*),		// task with thread id and task id
+	void  *arg)							// argument of task
+{
+	int i = -1;
+	while ((i = next->fetch_add(1)) < n) func(tid, i, arg);
+}
+
+// -----------------------------------------------------------------------------
+void parallel_for(					// run func(tid, i, arg) for i in [0, n)
+	int   n,							// number of tasks
+	int   threads,						// number of threads
+	void  (*func)(int, int, void*),		// task with thread id and task id
+	void  *arg)							// argument of task
+{
+	std::atomic<int> next(0);
+	if (threads <= 1) {
+		run_tasks(0, n, &next, func, arg);
+		return;
+	}
+
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; ++t) {
+		pool.push_back(std::thread(run_tasks, t, n, &next, func, arg));
+	}
+	run_tasks(0, n, &next, func, arg);
+	for (int t = 0; t < (int) pool.size(); ++t) pool[t].join();
+}
+
+// -----------------------------------------------------------------------------
+void merge_top_m(					// merge the top-m scores of the runs
+	const Select_Round *round,			// round of selection
+	Result *top)						// chunks x m buffer (return, top-m)
+{
+	int n = round->n_, m = round->m_, chunks = round->chunks_;
+
+	int num = 0;
+	for (int c = 0; c < chunks; ++c) {
+		int lo  = chunk_begin(n, chunks, c);
+		int cnt = std::min(m, chunk_begin(n, chunks, c + 1) - lo);
+		memcpy(&top[num], &round->score_[lo], sizeof(Result) * cnt);
+		num += cnt;
+	}
+	top_m_desc(num, m, top);
+}
+
+// -----------------------------------------------------------------------------
+//  the first object with the largest norm in the run, where the norms of the 
+//  objects at close angle to the projection (Drusilla_Select) are set to 0
+// -----------------------------------------------------------------------------
+void max_norm_task(					// largest norm of one run of ids
+	int   tid,							// thread id
+	int   c,							// run id
+	void  *arg)							// round of selection (Select_Round)
+{
+	Select_Round *round = (Select_Round*) arg;
+	float *norm = round->norm_;
+	const bool *close_angle = round->close_angle_;
+
+	int   hi = chunk_begin(round->n_, round->chunks_, c + 1);
+	int   max_id = -1;
+	float max_norm = -1.0f;
+	for (int j = chunk_begin(round->n_, round->chunks_, c); j < hi; ++j) {
+		if (close_angle && norm[j] > 0.0f && close_angle[j]) { norm[j] = 0.0f; }
+		if (norm[j] > max_norm) { max_norm = norm[j]; max_id = j; }
+	}
+	round->max_id_[c]   = max_id;
+	round->max_norm_[c] = max_norm;
+}
+
+// -----------------------------------------------------------------------------
+int merge_max_norm(					// merge the largest norms of the runs
+	const Select_Round *round,			// round of selection
+	float &max_norm)					// max l2-norm (return)
+{
+	int max_id = -1;
+	max_norm = -1.0f;
+	for (int c = 0; c < round->chunks_; ++c) {
+		if (round->max_norm_[c] > max_norm) {
+			max_norm = round->max_norm_[c]; max_id = round->max_id_[c];
+		}
+	}
+	return max_id;
+}
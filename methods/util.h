@@ -28,6 +28,98 @@ extern float    g_recall;			// global parameter: recall
 extern uint64_t g_io;				// global parameter: i/o cost
 extern uint64_t g_memory;			// global parameter: memory usage
 
+// -----------------------------------------------------------------------------
+//  stop conditions of c-k-AFN search
+// -----------------------------------------------------------------------------
+const int STOP_NONE     = -1;		// no limit is reached
+const int STOP_NORMAL   = 0;		// k-th distance > radius / c (stop cond. 1)
+const int STOP_CAND     = 1;		// budget of candidates (stop cond. 2)
+const int STOP_PAGE_IO  = 2;		// max page i/o of query
+const int STOP_DEADLINE = 3;		// wall-clock deadline of query
+
+static const char *stop_name[4] = { "normal", "candidates", "page_io", 
+	"deadline" };
+
+// -----------------------------------------------------------------------------
+//  families of hash functions (random projections)
+// -----------------------------------------------------------------------------
+const int PROJ_GAUSSIAN = 0;		// dense N(0, 1) entries
+const int PROJ_SPARSE   = 1;		// very sparse {-1, 0, +1} * sqrt(s) entries
+const int PROJ_HADAMARD = 2;		// randomized Hadamard transforms (HD)^3
+const int PROJ_PCA      = 3;		// top principal directions and N(0, 1)
+
+static const char *proj_name[4] = { "gaussian", "sparse", "hadamard", 
+	"pca" };
+
+// -----------------------------------------------------------------------------
+//  Query_Stats: statistics of one c-k-AFN query. The searches of RQALSH, 
+//  RQALSH*, QDAFN and Drusilla_Select fill it when it is given, and the 
+//  times are in ms.
+// -----------------------------------------------------------------------------
+struct Query_Stats {
+	int   rounds_;					// number of rounds (radii) executed
+	int   num_radius_;				// number of radii in <radius_>
+	float radius_[STATS_RADII];		// radius schedule (first STATS_RADII)
+	uint64_t index_io_;				// index pages read
+	uint64_t data_io_;				// data pages read
+	uint64_t cand_;					// candidates verified
+	uint64_t collisions_;			// collisions (or entries) counted
+	float hash_time_;				// time for hashing query
+	float count_time_;				// time for counting (index search)
+	float verify_time_;				// time for verification
+	int   stop_;					// stop condition (or STOP_NONE)
+};
+
+// -----------------------------------------------------------------------------
+//  callback of range-FN search, which is called once for each object whose 
+//  distance to query is larger than the range
+// -----------------------------------------------------------------------------
+typedef void (*Range_Callback)(
+	int   id,							// object id
+	float dist,							// distance to query
+	void  *arg);						// argument of caller
+
+// -----------------------------------------------------------------------------
+//  allow-list of filtered search: a bitmap of ceil(n / 64) words, where bit 
+//  <id> is set if data object <id> may be counted, verified and returned. a 
+//  NULL allow-list allows all objects.
+// -----------------------------------------------------------------------------
+inline int allow_words(int n) { return (n + 63) >> 6; }
+
+inline bool is_allowed(const uint64_t *allow, int id) 
+{
+	return (allow[id >> 6] >> (id & 63)) & 1ULL;
+}
+
+// -----------------------------------------------------------------------------
+//  Select_Round: shared state of one iteration of the data dependent selection
+//  of RQALSH* and Drusilla_Select. the objects are split into <chunks_> runs 
+//  of ids, each run keeps its own top-m scores and largest norm, and the runs
+//  are merged in the order of ids, so the candidates are the same as those of
+//  a single thread. the shift data (data minus centroid) are never stored: 
+//  the offset is one pass of calc_shift_inner_product, and the distortion is
+//  ||s||^2 - offset^2 by the l2-norm of shift data.
+// -----------------------------------------------------------------------------
+struct Select_Round {
+	int   n_;							// number of data objects
+	int   d_;							// dimensionality
+	int   m_;							// number of candidates
+	int   chunks_;						// number of runs of ids
+	const float **data_;				// data objects
+	const float *centroid_;				// centroid of data objects
+	const float *proj_;					// projection vector
+	float  *norm_;						// l2-norm of shift data
+	bool   *close_angle_;				// close angle to projection (or NULL)
+	Result *score_;						// scores, top-m in front of each run
+	int    *max_id_;					// id with max norm of each run
+	float  *max_norm_;					// max norm of each run
+};
+
+inline int chunk_begin(int n, int chunks, int c)
+{
+	return (int) ((int64_t) n * c / chunks);
+}
+
 // -------------------------------------------------------------------------
 void create_dir(					// create directory
 	char *path);						// input path
@@ -82,6 +174,80 @@ int read_data_new_format(			// read data with new format from disk
 	const char *output_path,			// output path
 	float *data);						// real data (return)
 
+// -----------------------------------------------------------------------------
+//  packed data file: the objects of a candidate set are stored in one file in
+//  the order of candidates, <packed_num> objects per page of <B> bytes, so 
+//  object <pos> is in page pos / packed_num(d, B) of this file
+// -----------------------------------------------------------------------------
+inline int packed_num(int d, int B) { return B / (d * SIZEFLOAT); }
+
+// -----------------------------------------------------------------------------
+int write_packed_data(				// write candidates to a packed data file
+	int   n,							// number of candidates
+	int   d,							// dimensionality
+	int   B,							// page size
+	const int   *ids,					// ids of candidates
+	const float **data,					// data set
+	const char  *fname);				// file name of packed data
+
+// -----------------------------------------------------------------------------
+//  Packed_File: an open packed data file and the pages read from it since the
+//  last reset_packed_file. the file has only about n / packed_num(d, B) pages,
+//  so each page costs one page i/o however often its objects are read.
+// -----------------------------------------------------------------------------
+struct Packed_File {
+	FILE  *fp_;						// packed data file (or NULL)
+	int   num_pages_;				// number of pages of file
+	bool  *read_;					// is a page in <buf_>
+	float *buf_;					// buffer of all pages
+	uint64_t io_;					// number of pages read
+};
+
+// -----------------------------------------------------------------------------
+int open_packed_file(				// open a packed data file
+	int   B,							// page size
+	const char *fname,					// file name of packed data
+	Packed_File *pf);					// packed data file (return)
+
+// -----------------------------------------------------------------------------
+void reset_packed_file(				// forget the pages read so far
+	Packed_File *pf);					// packed data file
+
+// -----------------------------------------------------------------------------
+void close_packed_file(				// close a packed data file
+	Packed_File *pf);					// packed data file
+
+// -----------------------------------------------------------------------------
+const float *read_packed_object(	// read an object from packed data file
+	int   pos,							// position of object
+	int   d,							// dimensionality
+	int   B,							// page size
+	Packed_File *pf);					// packed data file
+
+// -----------------------------------------------------------------------------
+uint64_t packed_scan(				// verify all candidates of packed file
+	int   n,							// number of candidates
+	int   d,							// dimensionality
+	int   B,							// page size
+	const int   *ids,					// ids of candidates
+	const char  *fname,					// file name of packed data
+	const float *query,					// query object
+	const uint64_t *allow,				// allow-list (or NULL)
+	MaxK_List   *list,					// k-FN results (return)
+	int   &num);						// number of verified candidates (return)
+
+// -----------------------------------------------------------------------------
+uint64_t read_packed_data(			// read allowed candidates of packed file
+	int   n,							// number of candidates
+	int   d,							// dimensionality
+	int   B,							// page size
+	const int   *ids,					// ids of candidates
+	const char  *fname,					// file name of packed data
+	const uint64_t *allow,				// allow-list (or NULL)
+	int   *pos,							// positions of rows (return)
+	float *mat,							// rows from new_matrix (return)
+	int   &num);						// number of rows (return)
+
 // -----------------------------------------------------------------------------
 int read_buffer_from_page(			// read data from page
 	int   B,							// page size
@@ -98,9 +264,15 @@ void read_data_from_buffer(			// read data from buffer
 // -----------------------------------------------------------------------------
 int read_ground_truth(				// read ground truth results from disk
 	int    qn,							// number of query objects
+	int    max_k,						// number of results per query
 	const  char *fname,					// address of truth set
 	Result **R);						// ground truth results (return)
 
+// -----------------------------------------------------------------------------
+int top_k_values(					// top-k values of the rounds
+	int max_k,							// max top-k value
+	int *top_k);						// top-k values (return, MAX_ROUND+1)
+
 // -----------------------------------------------------------------------------
 float calc_l2_dist(					// calc L_2 norm (data type is float)
 	int   dim,							// dimension
@@ -113,6 +285,99 @@ float calc_inner_product(			// calc inner product (data type is float)
 	const float *p1,					// 1st point
 	const float *p2);					// 2nd point
 
+// -----------------------------------------------------------------------------
+float calc_shift_inner_product(		// calc inner product of (p1 - c) and p2
+	int   dim,							// dimension
+	const float *p1,					// 1st point
+	const float *c,						// shift of 1st point (e.g., centroid)
+	const float *p2);					// 2nd point
+
+// -----------------------------------------------------------------------------
+void calc_inner_products(			// calc inner products of two sets (GEMM)
+	int   n1,							// number of objects in 1st set
+	int   n2,							// number of objects in 2nd set
+	int   dim,							// dimension
+	const float **p1,					// 1st set (e.g., query set)
+	const float *p2,					// 2nd set (e.g., hash functions)
+	int   ld,							// row stride of <p2>
+	float *ret);						// n1 x n2 inner products (return)
+
+// -----------------------------------------------------------------------------
+int pad_dim(						// row stride of an aligned matrix
+	int   dim);							// dimension
+
+// -----------------------------------------------------------------------------
+float* new_matrix(					// new aligned matrix (zero padded)
+	int   rows,							// number of rows
+	int   dim);							// dimension (stride: pad_dim(dim))
+
+// -----------------------------------------------------------------------------
+void delete_matrix(					// delete aligned matrix
+	float *mat);						// matrix from new_matrix
+
+// -----------------------------------------------------------------------------
+void write_matrix(					// write aligned matrix (without padding)
+	int   rows,							// number of rows
+	int   dim,							// dimension
+	const float *mat,					// matrix from new_matrix
+	FILE  *fp);							// file pointer
+
+// -----------------------------------------------------------------------------
+void read_matrix(					// read aligned matrix (without padding)
+	int   rows,							// number of rows
+	int   dim,							// dimension
+	float *mat,							// matrix from new_matrix (return)
+	FILE  *fp);							// file pointer
+
+// -----------------------------------------------------------------------------
+int hadamard_dim(					// size of Hadamard transform
+	int   dim);							// dimension
+
+// -----------------------------------------------------------------------------
+void fwht(							// fast Walsh-Hadamard transform (in-place)
+	int   hdim,							// size (power of 2)
+	float *x);							// vector (return)
+
+// -----------------------------------------------------------------------------
+void calc_hadamard_proj(			// calc one block of Hadamard projections
+	int   dim,							// dimension
+	int   hdim,							// size of transform (power of 2)
+	const float *sign,					// HADAMARD_ROUNDS x hdim sign diagonals
+	const float *data,					// one data object
+	float *ret);						// hdim projections (return)
+
+// -----------------------------------------------------------------------------
+void calc_hadamard_projs(			// calc Hadamard projections of a set
+	int   n,							// number of objects
+	int   dim,							// dimension
+	int   hdim,							// size of transform (power of 2)
+	int   t0,							// first projection id
+	int   t1,							// last projection id (exclusive)
+	const float *sign,					// blocks of sign diagonals
+	const float **data,					// objects
+	float *ret);						// n x (t1 - t0) projections (return)
+
+// -----------------------------------------------------------------------------
+void write_signs(					// write sign diagonals (one byte each)
+	int   size,							// number of signs
+	const float *sign,					// signs (+1 or -1)
+	FILE  *fp);							// file pointer
+
+// -----------------------------------------------------------------------------
+void read_signs(					// read sign diagonals (one byte each)
+	int   size,							// number of signs
+	float *sign,						// signs (+1 or -1) (return)
+	FILE  *fp);							// file pointer
+
+// -----------------------------------------------------------------------------
+void calc_pca(						// calc top principal directions
+	int   n,							// number of objects
+	int   d,							// dimension
+	int   k,							// number of directions
+	int   iters,						// number of subspace iterations
+	const float **data,					// objects
+	float *ret);						// k x d start / unit directions (return)
+
 // -----------------------------------------------------------------------------
 float calc_recall(					// calc recall (percentage)
 	int   k,							// top-k value
@@ -133,15 +398,91 @@ uint64_t linear(					// linear scan search
 	int   top_k,						// top-k value
 	const float *query,					// query object
 	const char  *data_folder,			// data folder
-	MaxK_List   *list);					// k-FN results (return)
+	MaxK_List   *list,					// k-FN results (return)
+	const uint64_t *allow = NULL);		// allow-list (optional)
+
+// -----------------------------------------------------------------------------
+uint64_t linear_range(				// linear scan range-FN search
+	int   n,							// number of data objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	float r,							// range (distance threshold)
+	const float *query,					// query object
+	const char  *data_folder,			// data folder
+	Range_Callback callback,			// called for each object beyond <r>
+	void  *arg);						// argument of callback
+
+// -----------------------------------------------------------------------------
+uint64_t linear_nn(					// linear scan c-k-ANN search
+	int   n,							// number of data objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	const float *query,					// query object
+	const char  *data_folder,			// data folder
+	MinK_List   *list);					// k-NN results (return)
 
 // -----------------------------------------------------------------------------
 int ground_truth(					// find ground truth
 	int   n,							// number of data  objects
 	int   qn,							// number of query objects
 	int   d,							// dimensionality
+	int   max_k,						// number of results per query
 	const float **data,					// data set
 	const float **query,				// query set
 	const char  *truth_set);			// address of truth set
 
+// -----------------------------------------------------------------------------
+void gen_allow_list(				// generate a random allow-list
+	int   n,							// number of data objects
+	float sel,							// selectivity (fraction allowed)
+	uint64_t *allow);					// allow-list (return)
+
+// -----------------------------------------------------------------------------
+void filter_truth(					// ground truth of filtered search
+	int   n,							// number of data objects
+	int   qn,							// number of query objects
+	int   d,							// dimensionality
+	int   B,							// page size
+	int   max_k,						// number of results per query
+	const float **query,				// query set
+	const char  *data_folder,			// data folder
+	const uint64_t *allow,				// allow-list
+	Result **R);						// truth set (return)
+
+// -----------------------------------------------------------------------------
+float elapsed_ms(					// time (ms) elapsed since <start>
+	const timeval &start);				// start time
+
+// -----------------------------------------------------------------------------
+void reset_stats(					// reset statistics of a query
+	Query_Stats *stats);				// statistics (return)
+
+// -----------------------------------------------------------------------------
+void add_radius(					// add one round of radius to statistics
+	float radius,						// radius of this round
+	Query_Stats *stats);				// statistics (return)
+
+// -----------------------------------------------------------------------------
+void parallel_for(					// run func(tid, i, arg) for i in [0, n)
+	int   n,							// number of tasks
+	int   threads,						// number of threads
+	void  (*func)(int, int, void*),		// task with thread id and task id
+	void  *arg);						// argument of task
+
+// -----------------------------------------------------------------------------
+void merge_top_m(					// merge the top-m scores of the runs
+	const Select_Round *round,			// round of selection
+	Result *top);						// chunks x m buffer (return, top-m)
+
+// -----------------------------------------------------------------------------
+void max_norm_task(					// largest norm of one run of ids
+	int   tid,							// thread id
+	int   c,							// run id
+	void  *arg);						// round of selection (Select_Round)
+
+// -----------------------------------------------------------------------------
+int merge_max_norm(					// merge the largest norms of the runs
+	const Select_Round *round,			// round of selection
+	float &max_norm);					// max l2-norm (return)
+
 #endif